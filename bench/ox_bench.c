@@ -0,0 +1,478 @@
+// Microbenchmarks of the core modules, results are printed as JSON
+//
+//   ox_bench [--samples N] [--output PATH] [filter]
+//
+// Only benchmarks whose name contains 'filter' run. Every benchmark is run
+// once to warm up, then timed 'samples' times; each sample covers 'ops'
+// operations and is reported per operation. Log records go to stderr, so
+// stdout holds nothing but the JSON.
+
+#include "ox_core.h"
+#include "ox_ecs.h"
+#include "ox_list.h"
+#include "ox_memory.h"
+#include "ox_slab.h"
+#include "ox_snapshot.h"
+#include "ox_time.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_SAMPLES_DEFAULT 15
+#define BENCH_SAMPLES_MAX     1000
+#define BENCH_BATCH           1024
+#define BENCH_MASKS           1024
+#define BENCH_SNAPSHOT_PATH   "ox_bench.snapshot"
+
+#if defined(OX_DEBUG_BUILD)
+#define BENCH_MEMORY_BACKEND "memtrack"
+#elif defined(OX_MEM_USE_SLAB)
+#define BENCH_MEMORY_BACKEND "slab"
+#else
+#define BENCH_MEMORY_BACKEND "system"
+#endif
+
+typedef void (*bench_fn)(void* data);
+
+typedef struct {
+  const char* filter;
+  FILE* output;
+  int samples;
+  bool first;
+} bench_t;
+
+typedef struct {
+  float x;
+  float y;
+  float z;
+} bench_vec3_t;
+
+typedef struct {
+  size_t size;
+  void* blocks[BENCH_BATCH];
+} mem_ctx_t;
+
+typedef struct {
+  ox_list_head_t head;
+  ox_list_entry_t entries[BENCH_BATCH];
+} list_ctx_t;
+
+typedef struct {
+  ox_component_mask_t masks[BENCH_MASKS];
+  ox_component_mask_t filter;
+  size_t matches; // Keeps the results alive
+} mask_ctx_t;
+
+typedef struct {
+  ox_world_t* world;
+  ox_entity_id* entities;
+  size_t count;
+} entity_ctx_t;
+
+typedef struct {
+  ox_world_t* world;
+  ox_query_id query;
+  float sum; // Keeps the results alive
+} query_ctx_t;
+
+typedef struct {
+  ox_world_t* world;
+  long result;
+} snapshot_ctx_t;
+
+static int compare_doubles(const void* a, const void* b)
+{
+  const double lhs = *(const double*)a;
+  const double rhs = *(const double*)b;
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+static void bench_run(bench_t* bench, const char* name, const size_t count,
+                      const size_t ops, const bench_fn fn, void* data)
+{
+  if (bench->filter && !strstr(name, bench->filter)) {
+    return;
+  }
+
+  double samples[BENCH_SAMPLES_MAX];
+  fn(data);
+
+  for (int i = 0; i < bench->samples; ++i) {
+    const uint64_t start = ox_time_ns();
+    fn(data);
+    samples[i] = (double)(ox_time_ns() - start) / (double)ops;
+  }
+
+  qsort(samples, (size_t)bench->samples, sizeof(double), compare_doubles);
+
+  fprintf(bench->output,
+          "%s    { \"name\": \"%s\", \"count\": %zu, \"ops\": %zu, "
+          "\"min_ns_per_op\": %.3f, \"median_ns_per_op\": %.3f }",
+          bench->first ? "" : ",\n", name, count, ops, samples[0],
+          samples[bench->samples / 2]);
+  bench->first = false;
+  fflush(bench->output);
+}
+
+static void bench_mem_batch(void* data)
+{
+  mem_ctx_t* ctx = data;
+  for (size_t i = 0; i < BENCH_BATCH; ++i) {
+    ctx->blocks[i] = ox_mem_acquire(ctx->size, OX_SOURCE_LOCATION);
+  }
+  for (size_t i = 0; i < BENCH_BATCH; ++i) {
+    ox_mem_release(ctx->blocks[i]);
+  }
+}
+
+// Acquire and release right away, the best case of every allocator
+static void bench_mem_pair(void* data)
+{
+  mem_ctx_t* ctx = data;
+  for (size_t i = 0; i < BENCH_BATCH; ++i) {
+    void* block = ox_mem_acquire(ctx->size, OX_SOURCE_LOCATION);
+    ox_mem_release(block);
+  }
+}
+
+static void bench_list(void* data)
+{
+  list_ctx_t* ctx = data;
+  ox_list_init(&ctx->head);
+  for (size_t i = 0; i < BENCH_BATCH; ++i) {
+    if (i % 2) {
+      ox_list_add_tail(&ctx->head, &ctx->entries[i]);
+    } else {
+      ox_list_add_head(&ctx->head, &ctx->entries[i]);
+    }
+  }
+
+  // Every other entry first, so removal doesn't just walk the list
+  for (size_t i = 0; i < BENCH_BATCH; i += 2) {
+    ox_list_remove(&ctx->entries[i]);
+  }
+  for (size_t i = 1; i < BENCH_BATCH; i += 2) {
+    ox_list_remove(&ctx->entries[i]);
+  }
+}
+
+static void bench_mask_includes(void* data)
+{
+  mask_ctx_t* ctx = data;
+  for (size_t i = 0; i < BENCH_MASKS; ++i) {
+    ctx->matches += ox_component_mask_includes(&ctx->masks[i], &ctx->filter);
+  }
+}
+
+static void bench_mask_excludes(void* data)
+{
+  mask_ctx_t* ctx = data;
+  for (size_t i = 0; i < BENCH_MASKS; ++i) {
+    ctx->matches += ox_component_mask_excludes(&ctx->masks[i], &ctx->filter);
+  }
+}
+
+static void bench_mask_equals(void* data)
+{
+  mask_ctx_t* ctx = data;
+  for (size_t i = 0; i < BENCH_MASKS; ++i) {
+    ctx->matches += ox_component_mask_equals(&ctx->masks[i], &ctx->filter);
+  }
+}
+
+static void bench_mask_hash(void* data)
+{
+  mask_ctx_t* ctx = data;
+  for (size_t i = 0; i < BENCH_MASKS; ++i) {
+    ctx->matches += (size_t)ox_component_mask_hash(&ctx->masks[i]);
+  }
+}
+
+static void bench_entity_single(void* data)
+{
+  entity_ctx_t* ctx = data;
+  for (size_t i = 0; i < ctx->count; ++i) {
+    ctx->entities[i] = ox_world_create_entity(ctx->world);
+  }
+  for (size_t i = 0; i < ctx->count; ++i) {
+    ox_world_destroy_entity(ctx->world, ctx->entities[i]);
+  }
+}
+
+static void bench_entity_bulk(void* data)
+{
+  entity_ctx_t* ctx = data;
+  ox_world_create_entities(ctx->world, ctx->entities, ctx->count);
+  ox_world_destroy_entities(ctx->world, ctx->entities, ctx->count);
+}
+
+static void bench_query(void* data)
+{
+  query_ctx_t* ctx = data;
+  ox_query_iter_t iter;
+  ox_query_iter_init(&iter, ctx->world, ctx->query);
+
+  while (ox_query_iter_next(&iter)) {
+    bench_vec3_t* positions = iter.columns[0];
+    const bench_vec3_t* velocities = iter.columns[1];
+    for (size_t i = 0; i < iter.count; ++i) {
+      positions[i].x += velocities[i].x;
+      positions[i].y += velocities[i].y;
+      positions[i].z += velocities[i].z;
+    }
+    ctx->sum += positions[0].x;
+  }
+}
+
+static void bench_snapshot_save(void* data)
+{
+  snapshot_ctx_t* ctx = data;
+  if (ox_world_save_snapshot(ctx->world, BENCH_SNAPSHOT_PATH) != OX_SUCCESS) {
+    ctx->result = OX_FAILURE;
+  }
+}
+
+// Loads into a fresh world every time, its init and term are timed too
+static void bench_snapshot_load(void* data)
+{
+  snapshot_ctx_t* ctx = data;
+  static ox_world_t world;
+  ox_snapshot_t snapshot;
+  if (ox_world_init(&world) != OX_SUCCESS) {
+    ctx->result = OX_FAILURE;
+    return;
+  }
+
+  ox_component_registry_t* registry = &world.component_registry;
+  ox_component_register(registry, "position", sizeof(bench_vec3_t));
+  ox_component_register(registry, "velocity", sizeof(bench_vec3_t));
+
+  if (ox_snapshot_open(&snapshot, BENCH_SNAPSHOT_PATH) != OX_SUCCESS) {
+    ctx->result = OX_FAILURE;
+  } else {
+    if (ox_world_load_snapshot(&world, &snapshot) != OX_SUCCESS) {
+      ctx->result = OX_FAILURE;
+    }
+    ox_snapshot_close(&snapshot);
+  }
+
+  ox_world_term(&world);
+}
+
+static void bench_memory(bench_t* bench)
+{
+  static const size_t sizes[] = { 16, 256, 4096, 65536 };
+  static mem_ctx_t ctx;
+
+  for (size_t i = 0; i < OX_ARRAY_SIZE(sizes); ++i) {
+    char name[64];
+    ctx.size = sizes[i];
+
+    snprintf(name, sizeof(name), "mem_acquire_release_batch/%zu", sizes[i]);
+    bench_run(bench, name, BENCH_BATCH, BENCH_BATCH * 2, bench_mem_batch,
+              &ctx);
+
+    snprintf(name, sizeof(name), "mem_acquire_release_pair/%zu", sizes[i]);
+    bench_run(bench, name, BENCH_BATCH, BENCH_BATCH * 2, bench_mem_pair,
+              &ctx);
+  }
+}
+
+static void bench_containers(bench_t* bench)
+{
+  static list_ctx_t list;
+  bench_run(bench, "list_insert_remove", BENCH_BATCH, BENCH_BATCH * 2,
+            bench_list, &list);
+
+  // Masks with a few scattered bits, a quarter of them match the filter
+  static mask_ctx_t masks;
+  ox_component_mask_init(&masks.filter);
+  ox_component_mask_set(&masks.filter, (ox_component_id){ 3 });
+  ox_component_mask_set(&masks.filter, (ox_component_id){ 200 });
+
+  uint64_t seed = 0x9E3779B97F4A7C15ull;
+  for (size_t i = 0; i < BENCH_MASKS; ++i) {
+    ox_component_mask_init(&masks.masks[i]);
+    for (int bit = 0; bit < 8; ++bit) {
+      seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+      ox_component_mask_set(&masks.masks[i], (ox_component_id){
+                                               (int)((seed >> 33) %
+                                                     OX_COMPONENTS_MAX) });
+    }
+    if (i % 4 == 0) {
+      ox_component_mask_set(&masks.masks[i], (ox_component_id){ 3 });
+      ox_component_mask_set(&masks.masks[i], (ox_component_id){ 200 });
+    }
+  }
+
+  bench_run(bench, "mask_includes", BENCH_MASKS, BENCH_MASKS,
+            bench_mask_includes, &masks);
+  bench_run(bench, "mask_excludes", BENCH_MASKS, BENCH_MASKS,
+            bench_mask_excludes, &masks);
+  bench_run(bench, "mask_equals", BENCH_MASKS, BENCH_MASKS, bench_mask_equals,
+            &masks);
+  bench_run(bench, "mask_hash", BENCH_MASKS, BENCH_MASKS, bench_mask_hash,
+            &masks);
+}
+
+// Counts stay below the rows one archetype can hold
+static const size_t entity_counts[] = { 1000, 10000, 60000 };
+
+static long bench_entities(bench_t* bench)
+{
+  static ox_world_t world;
+  if (ox_world_init(&world) != OX_SUCCESS) {
+    return OX_FAILURE;
+  }
+
+  const size_t max_count = entity_counts[OX_ARRAY_SIZE(entity_counts) - 1];
+  ox_entity_id* entities = ox_mem_acquire(sizeof(ox_entity_id) * max_count,
+                                          OX_SOURCE_LOCATION);
+  if (!entities) {
+    ox_world_term(&world);
+    return OX_FAILURE;
+  }
+
+  for (size_t i = 0; i < OX_ARRAY_SIZE(entity_counts); ++i) {
+    char name[64];
+    entity_ctx_t ctx = { &world, entities, entity_counts[i] };
+
+    snprintf(name, sizeof(name), "entity_create_destroy/%zu", ctx.count);
+    bench_run(bench, name, ctx.count, ctx.count * 2, bench_entity_single,
+              &ctx);
+
+    snprintf(name, sizeof(name), "entity_create_destroy_bulk/%zu",
+             ctx.count);
+    bench_run(bench, name, ctx.count, ctx.count * 2, bench_entity_bulk, &ctx);
+  }
+
+  ox_mem_release(entities);
+  ox_world_term(&world);
+  return OX_SUCCESS;
+}
+
+static long bench_queries(bench_t* bench)
+{
+  for (size_t i = 0; i < OX_ARRAY_SIZE(entity_counts); ++i) {
+    static ox_world_t world;
+    if (ox_world_init(&world) != OX_SUCCESS) {
+      return OX_FAILURE;
+    }
+
+    ox_component_registry_t* registry = &world.component_registry;
+    const ox_component_id position =
+      ox_component_register(registry, "position", sizeof(bench_vec3_t));
+    const ox_component_id velocity =
+      ox_component_register(registry, "velocity", sizeof(bench_vec3_t));
+
+    const ox_component_id terms[] = { position, velocity };
+    const ox_query_id query = ox_world_register_query(
+      &world, &(ox_query_desc_t){ .include = terms, .include_count = 2 });
+
+    ox_component_mask_t mask;
+    ox_component_mask_init(&mask);
+    ox_component_mask_set(&mask, position);
+    ox_component_mask_set(&mask, velocity);
+    const ox_archetype_id archetype = ox_world_get_archetype(&world, &mask);
+
+    // Spawned components are uninitialized
+    const size_t count = entity_counts[i];
+    ox_entity_id* entities =
+      ox_mem_acquire(sizeof(ox_entity_id) * count, OX_SOURCE_LOCATION);
+    if (!entities ||
+        ox_world_spawn_entities(&world, archetype, entities, count) ==
+          SIZE_MAX) {
+      ox_mem_release(entities);
+      ox_world_term(&world);
+      return OX_FAILURE;
+    }
+    ox_mem_release(entities);
+
+    ox_query_iter_t iter;
+    ox_query_iter_init(&iter, &world, query);
+    while (ox_query_iter_next(&iter)) {
+      memset(iter.columns[0], 0, sizeof(bench_vec3_t) * iter.count);
+      memset(iter.columns[1], 0, sizeof(bench_vec3_t) * iter.count);
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "query_iterate/%zu", count);
+    query_ctx_t ctx = { &world, query, 0.f };
+    bench_run(bench, name, count, count, bench_query, &ctx);
+
+    snapshot_ctx_t snapshot = { &world, OX_SUCCESS };
+    snprintf(name, sizeof(name), "snapshot_save/%zu", count);
+    bench_run(bench, name, count, count, bench_snapshot_save, &snapshot);
+
+    snprintf(name, sizeof(name), "snapshot_load/%zu", count);
+    if (snapshot.result == OX_SUCCESS) {
+      bench_run(bench, name, count, count, bench_snapshot_load, &snapshot);
+    }
+    remove(BENCH_SNAPSHOT_PATH);
+
+    ox_world_term(&world);
+    if (snapshot.result != OX_SUCCESS) {
+      return OX_FAILURE;
+    }
+  }
+
+  return OX_SUCCESS;
+}
+
+int main(const int argc, char* argv[])
+{
+  bench_t bench = { NULL, stdout, BENCH_SAMPLES_DEFAULT, true };
+  const char* output_path = NULL;
+
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+      bench.samples = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+      output_path = argv[++i];
+    } else {
+      bench.filter = argv[i];
+    }
+  }
+
+  if (bench.samples <= 0 || bench.samples > BENCH_SAMPLES_MAX) {
+    (void)fprintf(stderr,
+                  "Usage: %s [--samples 1-%d] [--output PATH] [filter]\n",
+                  argv[0], BENCH_SAMPLES_MAX);
+    return EXIT_FAILURE;
+  }
+
+  if (output_path) {
+    bench.output = fopen(output_path, "w");
+    if (!bench.output) {
+      (void)fprintf(stderr, "Can't create '%s'\n", output_path);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (ox_memory_init() != OX_SUCCESS) {
+    return EXIT_FAILURE;
+  }
+
+  fprintf(bench.output,
+          "{\n  \"memory_backend\": \"%s\",\n  \"samples\": %d,\n"
+          "  \"benchmarks\": [\n",
+          BENCH_MEMORY_BACKEND, bench.samples);
+
+  bench_memory(&bench);
+  bench_containers(&bench);
+  long result = bench_entities(&bench);
+  if (result == OX_SUCCESS) {
+    result = bench_queries(&bench);
+  }
+
+  fprintf(bench.output, "\n  ]\n}\n");
+  if (bench.output != stdout) {
+    fclose(bench.output);
+  }
+
+  ox_memory_exit();
+  return result == OX_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,560 @@
+#include "ox_command.h"
+
+#include "ox_core.h"
+#include "ox_log.h"
+#include "ox_memory.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OX_COMMAND_PAYLOAD_ALIGN _Alignof(max_align_t)
+
+typedef enum {
+  OX_COMMAND_SPAWN,
+  OX_COMMAND_DESTROY,
+  OX_COMMAND_ADD,
+  OX_COMMAND_REMOVE,
+} ox_command_type_t;
+
+struct ox_command {
+  ox_command_type_t type;
+  ox_entity_id entity;
+  ox_component_id component;
+  size_t data;  // Payload offset of the value (ADD) or the entries (SPAWN)
+  size_t count; // Number of spawn entries
+};
+
+// Stored in the payload, one per component of a spawned entity
+typedef struct {
+  ox_component_id component;
+  size_t data; // Payload offset, SIZE_MAX zero-fills
+} ox_command_spawn_entry_t;
+
+// Flattened view of a command used while flushing
+typedef struct {
+  const struct ox_command* command;
+  const unsigned char* payload;
+  size_t order;
+  ox_archetype_id archetype; // Spawn destination
+} ox_command_ref_t;
+
+// Folded outcome of every command recorded for one entity
+typedef struct {
+  ox_entity_id entity;
+  ox_archetype_id src;
+  ox_archetype_id dst;
+  size_t first_ref;
+  size_t ref_count;
+  bool destroy;
+} ox_command_plan_t;
+
+static long ox_command_grow(void** data, size_t* capacity, const size_t used,
+                            const size_t needed, const size_t element_size)
+{
+  if (needed <= *capacity) {
+    return OX_SUCCESS;
+  }
+
+  size_t new_capacity = *capacity ? *capacity * 2 : 64;
+  while (new_capacity < needed) {
+    new_capacity *= 2;
+  }
+
+  void* grown =
+    ox_mem_acquire(new_capacity * element_size, OX_SOURCE_LOCATION);
+  if (!grown) {
+    return OX_FAILURE;
+  }
+
+  if (used != 0) {
+    memcpy(grown, *data, used * element_size);
+  }
+  ox_mem_release(*data);
+  *data = grown;
+  *capacity = new_capacity;
+  return OX_SUCCESS;
+}
+
+static ox_command_buffer_t* ox_command_local(ox_command_queue_t* queue)
+{
+  const int index = ox_job_thread_index();
+  if (index < 0) {
+    OX_LOG_ERR("Commands must be recorded from a job thread");
+    return NULL;
+  }
+  return &queue->buffers[index];
+}
+
+static struct ox_command* ox_command_push(ox_command_buffer_t* buffer)
+{
+  if (ox_command_grow((void**)&buffer->commands, &buffer->capacity,
+                      buffer->count, buffer->count + 1,
+                      sizeof(struct ox_command)) != OX_SUCCESS) {
+    OX_LOG_ERR("Failed to grow command buffer");
+    return NULL;
+  }
+
+  struct ox_command* command = &buffer->commands[buffer->count++];
+  memset(command, 0, sizeof(*command));
+  return command;
+}
+
+// Reserves aligned payload bytes and returns their offset, or SIZE_MAX
+static size_t ox_command_alloc_payload(ox_command_buffer_t* buffer,
+                                       const size_t size)
+{
+  const size_t offset = (buffer->payload_size + OX_COMMAND_PAYLOAD_ALIGN - 1) &
+                        ~(OX_COMMAND_PAYLOAD_ALIGN - 1);
+  if (ox_command_grow((void**)&buffer->payload, &buffer->payload_capacity,
+                      buffer->payload_size, offset + size,
+                      1) != OX_SUCCESS) {
+    OX_LOG_ERR("Failed to grow command payload");
+    return SIZE_MAX;
+  }
+
+  buffer->payload_size = offset + size;
+  return offset;
+}
+
+static size_t ox_command_store(ox_command_buffer_t* buffer, const void* data,
+                               const size_t size)
+{
+  if (!data) {
+    return SIZE_MAX;
+  }
+
+  const size_t offset = ox_command_alloc_payload(buffer, size);
+  if (offset != SIZE_MAX && size != 0) {
+    memcpy(&buffer->payload[offset], data, size);
+  }
+  return offset;
+}
+
+void ox_command_queue_init(ox_command_queue_t* queue, ox_world_t* world)
+{
+  memset(queue, 0, sizeof(*queue));
+  queue->world = world;
+}
+
+void ox_command_queue_term(ox_command_queue_t* queue)
+{
+  for (size_t i = 0; i < OX_ARRAY_SIZE(queue->buffers); ++i) {
+    ox_mem_release(queue->buffers[i].commands);
+    ox_mem_release(queue->buffers[i].payload);
+  }
+  memset(queue->buffers, 0, sizeof(queue->buffers));
+}
+
+void ox_command_destroy(ox_command_queue_t* queue, const ox_entity_id entity)
+{
+  ox_command_buffer_t* buffer = ox_command_local(queue);
+  struct ox_command* command = buffer ? ox_command_push(buffer) : NULL;
+  if (command) {
+    command->type = OX_COMMAND_DESTROY;
+    command->entity = entity;
+  }
+}
+
+void ox_command_add(ox_command_queue_t* queue, const ox_entity_id entity,
+                    const ox_component_id component, const void* data)
+{
+  ox_command_buffer_t* buffer = ox_command_local(queue);
+  if (!buffer) {
+    return;
+  }
+
+  const size_t size =
+    queue->world->component_registry.components[component.value].size;
+  const size_t offset = ox_command_store(buffer, data, size);
+  if (data && offset == SIZE_MAX) {
+    return;
+  }
+
+  struct ox_command* command = ox_command_push(buffer);
+  if (command) {
+    command->type = OX_COMMAND_ADD;
+    command->entity = entity;
+    command->component = component;
+    command->data = offset;
+  }
+}
+
+void ox_command_remove(ox_command_queue_t* queue, const ox_entity_id entity,
+                       const ox_component_id component)
+{
+  ox_command_buffer_t* buffer = ox_command_local(queue);
+  struct ox_command* command = buffer ? ox_command_push(buffer) : NULL;
+  if (command) {
+    command->type = OX_COMMAND_REMOVE;
+    command->entity = entity;
+    command->component = component;
+  }
+}
+
+void ox_command_spawn(ox_command_queue_t* queue,
+                      const ox_component_id* components,
+                      const void* const* data, const size_t count)
+{
+  ox_command_buffer_t* buffer = ox_command_local(queue);
+  if (!buffer) {
+    return;
+  }
+
+  const size_t entries = ox_command_alloc_payload(
+    buffer, sizeof(ox_command_spawn_entry_t) * count);
+  if (entries == SIZE_MAX) {
+    return;
+  }
+
+  // Values are stored after the entry table, which may move the payload, so
+  // entries are written through offsets only
+  for (size_t i = 0; i < count; ++i) {
+    const size_t size =
+      queue->world->component_registry.components[components[i].value].size;
+    const size_t offset = ox_command_store(buffer, data ? data[i] : NULL, size);
+    ox_command_spawn_entry_t* entry =
+      (ox_command_spawn_entry_t*)&buffer->payload[entries] + i;
+    entry->component = components[i];
+    entry->data = offset;
+  }
+
+  struct ox_command* command = ox_command_push(buffer);
+  if (command) {
+    command->type = OX_COMMAND_SPAWN;
+    command->data = entries;
+    command->count = count;
+  }
+}
+
+// Userdata bits don't tell entities apart, two handles to the same live
+// entity may differ in them
+static bool ox_command_same_entity(const ox_entity_id a, const ox_entity_id b)
+{
+  return a.index == b.index && a.nonce == b.nonce;
+}
+
+static int ox_command_compare_entity(const void* a, const void* b)
+{
+  const ox_command_ref_t* lhs = a;
+  const ox_command_ref_t* rhs = b;
+  const size_t lhs_index = lhs->command->entity.index;
+  const size_t rhs_index = rhs->command->entity.index;
+  if (lhs_index != rhs_index) {
+    return (lhs_index > rhs_index) - (lhs_index < rhs_index);
+  }
+  return (lhs->order > rhs->order) - (lhs->order < rhs->order);
+}
+
+static int ox_command_compare_spawn(const void* a, const void* b)
+{
+  const ox_command_ref_t* lhs = a;
+  const ox_command_ref_t* rhs = b;
+  if (lhs->archetype.value != rhs->archetype.value) {
+    return (lhs->archetype.value > rhs->archetype.value) -
+           (lhs->archetype.value < rhs->archetype.value);
+  }
+  return (lhs->order > rhs->order) - (lhs->order < rhs->order);
+}
+
+static int ox_command_compare_plan(const void* a, const void* b)
+{
+  const ox_command_plan_t* lhs = a;
+  const ox_command_plan_t* rhs = b;
+  if (lhs->src.value != rhs->src.value) {
+    return (lhs->src.value > rhs->src.value) -
+           (lhs->src.value < rhs->src.value);
+  }
+  if (lhs->dst.value != rhs->dst.value) {
+    return (lhs->dst.value > rhs->dst.value) -
+           (lhs->dst.value < rhs->dst.value);
+  }
+  return (lhs->entity.index > rhs->entity.index) -
+         (lhs->entity.index < rhs->entity.index);
+}
+
+static void ox_command_write(ox_world_t* world, const ox_entity_id entity,
+                             const ox_component_id component,
+                             const unsigned char* payload, const size_t data)
+{
+  const size_t size =
+    world->component_registry.components[component.value].size;
+  void* dst = ox_world_get_component(world, entity, component);
+  if (!dst || size == 0) {
+    return;
+  }
+
+  if (data == SIZE_MAX) {
+    memset(dst, 0, size);
+  } else {
+    memcpy(dst, &payload[data], size);
+  }
+}
+
+// Folds the commands of one entity (refs sorted by order) into a plan. The
+// destination is found by walking the archetype transition edges, so
+// toggling a tag back and forth costs a few table lookups.
+static void ox_command_fold(ox_world_t* world, const ox_command_ref_t* refs,
+                            const size_t first, const size_t count,
+                            ox_command_plan_t* plan)
+{
+  const ox_entity_id entity = refs[first].command->entity;
+  const ox_archetype_id src = world->records[entity.index].archetype;
+  ox_archetype_id dst = src;
+
+  plan->entity = entity;
+  plan->src = src;
+  plan->first_ref = first;
+  plan->ref_count = count;
+  plan->destroy = false;
+
+  for (size_t i = first; i < first + count && !plan->destroy &&
+                         dst.value != OX_INVALID_ID;
+       ++i) {
+    const struct ox_command* command = refs[i].command;
+    if (!ox_command_same_entity(command->entity, entity)) {
+      continue;
+    }
+
+    const ox_component_mask_t* mask =
+      &world->archetypes[dst.value]->component_mask;
+    switch (command->type) {
+    case OX_COMMAND_DESTROY:
+      plan->destroy = true;
+      break;
+    case OX_COMMAND_ADD:
+      if (!ox_component_mask_has(mask, command->component)) {
+        dst = ox_world_get_transition(world, dst, command->component);
+      }
+      break;
+    case OX_COMMAND_REMOVE:
+      if (ox_component_mask_has(mask, command->component)) {
+        dst = ox_world_get_transition(world, dst, command->component);
+      }
+      break;
+    case OX_COMMAND_SPAWN:
+      break;
+    }
+  }
+
+  plan->dst = plan->destroy ? src : dst;
+}
+
+static long ox_command_apply_edits(ox_world_t* world, ox_command_ref_t* refs,
+                                   const size_t count)
+{
+  if (count == 0) {
+    return OX_SUCCESS;
+  }
+
+  long result = OX_SUCCESS;
+  qsort(refs, count, sizeof(ox_command_ref_t), ox_command_compare_entity);
+
+  ox_command_plan_t* plans =
+    ox_mem_acquire(sizeof(ox_command_plan_t) * count, OX_SOURCE_LOCATION);
+  ox_entity_id* entities =
+    ox_mem_acquire(sizeof(ox_entity_id) * count, OX_SOURCE_LOCATION);
+  if (!plans || !entities) {
+    ox_mem_release(plans);
+    ox_mem_release(entities);
+    return OX_FAILURE;
+  }
+
+  // One plan per live entity, stale handles are dropped here
+  size_t plan_count = 0;
+  for (size_t begin = 0; begin < count;) {
+    size_t end = begin + 1;
+    while (end < count && refs[end].command->entity.index ==
+                            refs[begin].command->entity.index) {
+      end++;
+    }
+
+    size_t live = begin;
+    while (live < end &&
+           !ox_world_is_alive(world, refs[live].command->entity)) {
+      live++;
+    }
+
+    if (live < end) {
+      ox_command_plan_t* plan = &plans[plan_count];
+      ox_command_fold(world, refs, live, end - live, plan);
+      if (plan->dst.value == OX_INVALID_ID) {
+        result = OX_FAILURE;
+      } else {
+        plan_count++;
+      }
+    }
+    begin = end;
+  }
+
+  size_t destroy_count = 0;
+  for (size_t i = 0; i < plan_count; ++i) {
+    if (plans[i].destroy) {
+      entities[destroy_count++] = plans[i].entity;
+    }
+  }
+  ox_world_destroy_entities(world, entities, destroy_count);
+
+  // Entities sharing a (source, destination) pair move as one batch
+  qsort(plans, plan_count, sizeof(ox_command_plan_t), ox_command_compare_plan);
+  for (size_t begin = 0; begin < plan_count;) {
+    size_t end = begin;
+    size_t moved = 0;
+    while (end < plan_count && plans[end].src.value == plans[begin].src.value &&
+           plans[end].dst.value == plans[begin].dst.value) {
+      if (!plans[end].destroy) {
+        entities[moved++] = plans[end].entity;
+      }
+      end++;
+    }
+
+    if (plans[begin].src.value != plans[begin].dst.value &&
+        ox_world_move_entities(world, entities, moved, plans[begin].dst) !=
+          OX_SUCCESS) {
+      result = OX_FAILURE;
+    }
+    begin = end;
+  }
+
+  // Values are written once every entity sits in its final archetype
+  for (size_t i = 0; i < plan_count; ++i) {
+    const ox_command_plan_t* plan = &plans[i];
+    if (plan->destroy) {
+      continue;
+    }
+
+    for (size_t r = plan->first_ref; r < plan->first_ref + plan->ref_count;
+         ++r) {
+      const struct ox_command* command = refs[r].command;
+      if (command->type == OX_COMMAND_ADD &&
+          ox_command_same_entity(command->entity, plan->entity)) {
+        ox_command_write(world, plan->entity, command->component,
+                         refs[r].payload, command->data);
+      }
+    }
+  }
+
+  ox_mem_release(plans);
+  ox_mem_release(entities);
+  return result;
+}
+
+static long ox_command_apply_spawns(ox_world_t* world, ox_command_ref_t* refs,
+                                    const size_t count)
+{
+  if (count == 0) {
+    return OX_SUCCESS;
+  }
+
+  long result = OX_SUCCESS;
+  for (size_t i = 0; i < count; ++i) {
+    const struct ox_command* command = refs[i].command;
+    const ox_command_spawn_entry_t* entries =
+      (const ox_command_spawn_entry_t*)&refs[i].payload[command->data];
+
+    ox_component_mask_t mask;
+    ox_component_mask_init(&mask);
+    for (size_t e = 0; e < command->count; ++e) {
+      ox_component_mask_set(&mask, entries[e].component);
+    }
+    refs[i].archetype = ox_world_get_archetype(world, &mask);
+  }
+
+  qsort(refs, count, sizeof(ox_command_ref_t), ox_command_compare_spawn);
+
+  ox_entity_id* entities =
+    ox_mem_acquire(sizeof(ox_entity_id) * count, OX_SOURCE_LOCATION);
+  if (!entities) {
+    return OX_FAILURE;
+  }
+
+  for (size_t begin = 0; begin < count;) {
+    const ox_archetype_id archetype_id = refs[begin].archetype;
+    size_t end = begin + 1;
+    while (end < count && refs[end].archetype.value == archetype_id.value) {
+      end++;
+    }
+
+    if (archetype_id.value == OX_INVALID_ID ||
+        ox_world_spawn_entities(world, archetype_id, entities, end - begin) ==
+          SIZE_MAX) {
+      result = OX_FAILURE;
+      begin = end;
+      continue;
+    }
+
+    // The archetype holds exactly the listed components, so every column of
+    // the new rows is written here
+    for (size_t i = begin; i < end; ++i) {
+      const struct ox_command* command = refs[i].command;
+      const ox_command_spawn_entry_t* entries =
+        (const ox_command_spawn_entry_t*)&refs[i].payload[command->data];
+      for (size_t e = 0; e < command->count; ++e) {
+        ox_command_write(world, entities[i - begin], entries[e].component,
+                         refs[i].payload, entries[e].data);
+      }
+    }
+    begin = end;
+  }
+
+  ox_mem_release(entities);
+  return result;
+}
+
+long ox_command_queue_flush(ox_command_queue_t* queue)
+{
+  size_t total = 0;
+  for (size_t i = 0; i < OX_ARRAY_SIZE(queue->buffers); ++i) {
+    total += queue->buffers[i].count;
+  }
+
+  if (total == 0) {
+    return OX_SUCCESS;
+  }
+
+  ox_command_ref_t* refs =
+    ox_mem_acquire(sizeof(ox_command_ref_t) * total, OX_SOURCE_LOCATION);
+  if (!refs) {
+    return OX_FAILURE;
+  }
+
+  // Edits fill the front of refs and spawns the back. Buffers are walked
+  // by job thread index, so 'order' is recording order within a thread only.
+  size_t edit_count = 0;
+  size_t spawn_count = 0;
+  size_t order = 0;
+  for (size_t i = 0; i < OX_ARRAY_SIZE(queue->buffers); ++i) {
+    const ox_command_buffer_t* buffer = &queue->buffers[i];
+    for (size_t c = 0; c < buffer->count; ++c) {
+      const struct ox_command* command = &buffer->commands[c];
+      const size_t slot = command->type == OX_COMMAND_SPAWN
+                            ? total - ++spawn_count
+                            : edit_count++;
+      refs[slot].command = command;
+      refs[slot].payload = buffer->payload;
+      refs[slot].order = order++;
+      refs[slot].archetype = (ox_archetype_id){ OX_INVALID_ID };
+    }
+  }
+
+  long result = OX_SUCCESS;
+  if (ox_command_apply_edits(queue->world, refs, edit_count) != OX_SUCCESS) {
+    result = OX_FAILURE;
+  }
+  if (ox_command_apply_spawns(queue->world, &refs[edit_count], spawn_count) !=
+      OX_SUCCESS) {
+    result = OX_FAILURE;
+  }
+
+  ox_mem_release(refs);
+  for (size_t i = 0; i < OX_ARRAY_SIZE(queue->buffers); ++i) {
+    queue->buffers[i].count = 0;
+    queue->buffers[i].payload_size = 0;
+  }
+
+  if (result != OX_SUCCESS) {
+    OX_LOG_ERR("Some deferred commands could not be applied");
+  }
+  return result;
+}
@@ -0,0 +1,99 @@
+/**
+ * @file ox_command.h
+ * @brief Deferred structural changes for the ECS
+ *
+ * Systems iterating archetype chunks must not spawn, destroy or change the
+ * component set of entities in place. They record those changes into the
+ * calling job thread's command buffer instead. At a sync point
+ * ox_command_queue_flush() folds the commands per entity, groups entities
+ * by source and destination archetype and applies each group as one batched
+ * move.
+ */
+
+#pragma once
+
+#include "ox_ecs.h"
+#include "ox_job.h"
+
+/**
+ * @brief Commands recorded by one job thread
+ */
+typedef struct {
+  struct ox_command* commands; /**< Recorded commands in order */
+  size_t count;                /**< Number of recorded commands */
+  size_t capacity;             /**< Allocated commands */
+  unsigned char* payload;      /**< Component data referenced by commands */
+  size_t payload_size;         /**< Used payload bytes */
+  size_t payload_capacity;     /**< Allocated payload bytes */
+} ox_command_buffer_t;
+
+/**
+ * @brief One command buffer per job thread, no locking while recording
+ */
+typedef struct {
+  ox_world_t* world;
+  ox_command_buffer_t buffers[OX_JOB_WORKERS_MAX + 1];
+} ox_command_queue_t;
+
+/**
+ * @brief Initialize an empty command queue
+ * @param queue Queue to initialize
+ * @param world World the commands target, its registry gives component sizes
+ */
+void ox_command_queue_init(ox_command_queue_t* queue, ox_world_t* world);
+
+/**
+ * @brief Release the memory of every command buffer
+ * @param queue Queue to terminate
+ */
+void ox_command_queue_term(ox_command_queue_t* queue);
+
+/**
+ * @brief Record the destruction of an entity
+ * @param queue Queue to record into, must be called from a job thread
+ * @param entity Entity to destroy
+ */
+void ox_command_destroy(ox_command_queue_t* queue, ox_entity_id entity);
+
+/**
+ * @brief Record adding or overwriting a component
+ * @param queue Queue to record into, must be called from a job thread
+ * @param entity Target entity
+ * @param component Component to add
+ * @param data Component value copied into the buffer, NULL zero-fills
+ */
+void ox_command_add(ox_command_queue_t* queue, ox_entity_id entity,
+                    ox_component_id component, const void* data);
+
+/**
+ * @brief Record removing a component
+ * @param queue Queue to record into, must be called from a job thread
+ * @param entity Target entity
+ * @param component Component to remove
+ */
+void ox_command_remove(ox_command_queue_t* queue, ox_entity_id entity,
+                       ox_component_id component);
+
+/**
+ * @brief Record spawning an entity with an initial set of components
+ * @param queue Queue to record into, must be called from a job thread
+ * @param components Components of the new entity
+ * @param data Value of each component, a NULL array or entry zero-fills
+ * @param count Number of components
+ */
+void ox_command_spawn(ox_command_queue_t* queue,
+                      const ox_component_id* components,
+                      const void* const* data, size_t count);
+
+/**
+ * @brief Apply and clear every recorded command
+ * @param queue Queue to flush, no thread may be recording
+ * @return OX_SUCCESS or OX_FAILURE if some commands could not be applied
+ *
+ * Commands are applied buffer by buffer in job thread index order, and in
+ * recording order within a buffer. Commands recorded on different threads
+ * for the same entity are therefore ordered by thread index, not by time.
+ * The last value added for a component wins. Commands targeting dead
+ * entities are dropped.
+ */
+long ox_command_queue_flush(ox_command_queue_t* queue);
@@ -1,6 +1,11 @@
 #pragma once
 
 #include <limits.h>
+#include <stdint.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 // Error codes
 #define OX_SUCCESS 0
@@ -15,3 +20,15 @@
   } name
 
 #define OX_SIZEOF_IN_BITS(x) (sizeof(x) * CHAR_BIT)
+
+// Index of the lowest set bit, 'value' must not be zero
+static inline int ox_ctz64(const uint64_t value)
+{
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward64(&index, value);
+  return (int)index;
+#else
+  return __builtin_ctzll(value);
+#endif
+}
@@ -0,0 +1,997 @@
+#include "ox_ecs.h"
+
+#include "ox_log.h"
+#include "ox_memory.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void ox_component_registry_init(ox_component_registry_t* registry)
+{
+  memset(registry->components, 0, sizeof(registry->components));
+  registry->component_count = 0;
+  ox_component_mask_init(&registry->all_components_mask);
+}
+
+void ox_component_registry_term(ox_component_registry_t* registry)
+{
+  ox_component_mask_init(&registry->all_components_mask);
+  registry->component_count = 0;
+}
+
+ox_component_id ox_component_register(ox_component_registry_t* registry,
+                                      const char* name, const size_t size)
+{
+  if (registry->component_count >= OX_COMPONENTS_MAX) {
+    OX_LOG_ERR("Too many components, can't register '%s'", name);
+    return (ox_component_id){ OX_INVALID_ID };
+  }
+
+  const ox_component_id id = { (int)registry->component_count++ };
+  registry->components[id.value].name = name;
+  registry->components[id.value].size = size;
+  ox_component_mask_set(&registry->all_components_mask, id);
+
+  OX_LOG_DBG("Registered component '%s' (id: %d, size: %u)", name, id.value,
+             (unsigned)size);
+  return id;
+}
+
+void ox_memory_pool_init(ox_memory_pool_t* pool, const size_t element_size,
+                         const size_t elements_per_chunk)
+{
+  memset(pool->chunks, 0, sizeof(pool->chunks));
+  pool->chunk_count = 0;
+  pool->element_size = element_size;
+  pool->elements_per_chunk = elements_per_chunk;
+}
+
+void ox_memory_pool_term(ox_memory_pool_t* pool)
+{
+  for (size_t i = 0; i < pool->chunk_count; ++i) {
+    ox_mem_release(pool->chunks[i].data);
+    pool->chunks[i].data = NULL;
+  }
+  pool->chunk_count = 0;
+}
+
+static long ox_memory_pool_grow(ox_memory_pool_t* pool)
+{
+  if (pool->chunk_count >= OX_ECS_POOL_MAX_CHUNKS) {
+    return OX_FAILURE;
+  }
+
+  ox_memory_chunk_t* chunk = &pool->chunks[pool->chunk_count];
+  chunk->data = NULL;
+  if (pool->element_size != 0) {
+    chunk->data = ox_mem_acquire_aligned(
+      pool->element_size * pool->elements_per_chunk, OX_ECS_COLUMN_ALIGNMENT,
+      OX_SOURCE_LOCATION);
+    if (!chunk->data) {
+      return OX_FAILURE;
+    }
+  }
+
+  chunk->capacity = pool->elements_per_chunk;
+  chunk->used = 0;
+  pool->chunk_count++;
+  return OX_SUCCESS;
+}
+
+static void ox_memory_pool_copy(const ox_memory_pool_t* dst,
+                                const size_t dst_index,
+                                const ox_memory_pool_t* src,
+                                const size_t src_index)
+{
+  if (dst->element_size != 0) {
+    memcpy(ox_memory_pool_at(dst, dst_index), ox_memory_pool_at(src, src_index),
+           dst->element_size);
+  }
+}
+
+// Copies 'count' consecutive elements, split wherever either side crosses a
+// chunk boundary
+static void ox_memory_pool_copy_run(const ox_memory_pool_t* dst,
+                                    size_t dst_index,
+                                    const ox_memory_pool_t* src,
+                                    size_t src_index, size_t count)
+{
+  if (dst->element_size == 0) {
+    return;
+  }
+
+  while (count != 0) {
+    const size_t dst_left =
+      dst->elements_per_chunk - dst_index % dst->elements_per_chunk;
+    const size_t src_left =
+      src->elements_per_chunk - src_index % src->elements_per_chunk;
+    size_t run = count < dst_left ? count : dst_left;
+    run = run < src_left ? run : src_left;
+
+    memcpy(ox_memory_pool_at(dst, dst_index), ox_memory_pool_at(src, src_index),
+           run * dst->element_size);
+    dst_index += run;
+    src_index += run;
+    count -= run;
+  }
+}
+
+int ox_archetype_find_column(const ox_archetype_t* archetype,
+                             const ox_component_id component)
+{
+  size_t lo = 0;
+  size_t hi = archetype->component_pool_count;
+  while (lo < hi) {
+    const size_t mid = lo + (hi - lo) / 2;
+    const int value = archetype->component_ids[mid].value;
+    if (value == component.value) {
+      return (int)mid;
+    }
+    if (value < component.value) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return OX_INVALID_ID;
+}
+
+static ox_archetype_t*
+ox_archetype_create(const ox_component_registry_t* registry,
+                    const ox_component_mask_t* mask)
+{
+  ox_archetype_t* archetype =
+    ox_mem_acquire(sizeof(ox_archetype_t), OX_SOURCE_LOCATION);
+  if (!archetype) {
+    return NULL;
+  }
+
+  memset(archetype, 0, sizeof(*archetype));
+  archetype->component_mask = *mask;
+  archetype->hash = ox_component_mask_hash(mask);
+
+  size_t count = 0;
+  for (size_t i = 0; i < registry->component_count; ++i) {
+    if (ox_component_mask_has(mask, (ox_component_id){ (int)i })) {
+      count++;
+    }
+  }
+
+  if (count != 0) {
+    archetype->component_ids =
+      ox_mem_acquire(sizeof(ox_component_id) * count, OX_SOURCE_LOCATION);
+    archetype->component_pools =
+      ox_mem_acquire(sizeof(ox_memory_pool_t) * count, OX_SOURCE_LOCATION);
+    if (!archetype->component_ids || !archetype->component_pools) {
+      ox_mem_release(archetype->component_ids);
+      ox_mem_release(archetype->component_pools);
+      ox_mem_release(archetype);
+      return NULL;
+    }
+  }
+
+  size_t column = 0;
+  for (size_t i = 0; i < registry->component_count; ++i) {
+    const ox_component_id id = { (int)i };
+    if (ox_component_mask_has(mask, id)) {
+      archetype->component_ids[column] = id;
+      ox_memory_pool_init(&archetype->component_pools[column],
+                          registry->components[i].size,
+                          OX_ECS_POOL_DEFAULT_CHUNK_SIZE);
+      column++;
+    }
+  }
+
+  archetype->component_pool_count = count;
+  ox_memory_pool_init(&archetype->entity_pool, sizeof(ox_entity_id),
+                      OX_ECS_POOL_DEFAULT_CHUNK_SIZE);
+  return archetype;
+}
+
+static void ox_archetype_destroy(ox_archetype_t* archetype)
+{
+  for (size_t i = 0; i < archetype->component_pool_count; ++i) {
+    ox_memory_pool_term(&archetype->component_pools[i]);
+  }
+  ox_memory_pool_term(&archetype->entity_pool);
+  ox_mem_release(archetype->edges);
+  ox_mem_release(archetype->component_ids);
+  ox_mem_release(archetype->component_pools);
+  ox_mem_release(archetype);
+}
+
+static long ox_archetype_reserve_chunk(ox_archetype_t* archetype)
+{
+  // Chunks are added to every column at once to keep boundaries in sync, so
+  // a partial failure leaves extra capacity in some columns which is unused.
+  if (ox_memory_pool_grow(&archetype->entity_pool) != OX_SUCCESS) {
+    return OX_FAILURE;
+  }
+
+  for (size_t i = 0; i < archetype->component_pool_count; ++i) {
+    ox_memory_pool_t* pool = &archetype->component_pools[i];
+    if (pool->chunk_count < archetype->entity_pool.chunk_count &&
+        ox_memory_pool_grow(pool) != OX_SUCCESS) {
+      archetype->entity_pool.chunk_count--;
+      ox_mem_release(
+        archetype->entity_pool.chunks[archetype->entity_pool.chunk_count].data);
+      return OX_FAILURE;
+    }
+  }
+
+  archetype->capacity += archetype->entity_pool.elements_per_chunk;
+  return OX_SUCCESS;
+}
+
+static long ox_archetype_reserve(ox_archetype_t* archetype,
+                                 const size_t rows)
+{
+  while (archetype->capacity < rows) {
+    if (ox_archetype_reserve_chunk(archetype) != OX_SUCCESS) {
+      return OX_FAILURE;
+    }
+  }
+  return OX_SUCCESS;
+}
+
+static void ox_archetype_adjust_used(ox_archetype_t* archetype,
+                                     const size_t row, const int delta)
+{
+  const size_t chunk = row / archetype->entity_pool.elements_per_chunk;
+  archetype->entity_pool.chunks[chunk].used += delta;
+  for (size_t i = 0; i < archetype->component_pool_count; ++i) {
+    archetype->component_pools[i].chunks[chunk].used += delta;
+  }
+}
+
+// Appends an uninitialized row and returns its index, or SIZE_MAX
+static size_t ox_archetype_push_row(ox_archetype_t* archetype,
+                                    const ox_entity_id entity)
+{
+  if (archetype->entity_count == archetype->capacity &&
+      ox_archetype_reserve_chunk(archetype) != OX_SUCCESS) {
+    OX_LOG_ERR("Archetype is full, capacity: %u",
+               (unsigned)archetype->capacity);
+    return SIZE_MAX;
+  }
+
+  const size_t row = archetype->entity_count++;
+  *(ox_entity_id*)ox_memory_pool_at(&archetype->entity_pool, row) = entity;
+  ox_archetype_adjust_used(archetype, row, 1);
+  return row;
+}
+
+// Swap-removes 'row' by moving the last row into it, patching its record
+static void ox_archetype_remove_row(ox_world_t* world,
+                                    ox_archetype_t* archetype,
+                                    const size_t row)
+{
+  const size_t last = archetype->entity_count - 1;
+  if (row != last) {
+    for (size_t i = 0; i < archetype->component_pool_count; ++i) {
+      const ox_memory_pool_t* pool = &archetype->component_pools[i];
+      ox_memory_pool_copy(pool, row, pool, last);
+    }
+
+    const ox_entity_id moved =
+      *(ox_entity_id*)ox_memory_pool_at(&archetype->entity_pool, last);
+    *(ox_entity_id*)ox_memory_pool_at(&archetype->entity_pool, row) = moved;
+    world->records[moved.index].row = row;
+  }
+
+  ox_archetype_adjust_used(archetype, last, -1);
+  archetype->entity_count--;
+}
+
+size_t ox_archetype_append_rows(ox_archetype_t* archetype, const size_t count)
+{
+  if (ox_archetype_reserve(archetype, archetype->entity_count + count) !=
+      OX_SUCCESS) {
+    return SIZE_MAX;
+  }
+
+  // One adjustment per chunk the rows touch
+  const size_t first = archetype->entity_count;
+  const size_t end = first + count;
+  const size_t per_chunk = archetype->entity_pool.elements_per_chunk;
+  for (size_t row = first; row < end;) {
+    const size_t left = per_chunk - row % per_chunk;
+    const size_t run = end - row < left ? end - row : left;
+    ox_archetype_adjust_used(archetype, row, (int)run);
+    row += run;
+  }
+
+  archetype->entity_count = end;
+  return first;
+}
+
+long ox_world_init(ox_world_t* world)
+{
+  ox_component_registry_init(&world->component_registry);
+  memset(world->archetypes, 0, sizeof(world->archetypes));
+  world->archetype_count = 0;
+  for (size_t i = 0; i < OX_ECS_ARCHETYPE_LOOKUP_SIZE; ++i) {
+    world->archetype_lookup[i] = OX_INVALID_ID;
+  }
+  memset(world->queries, 0, sizeof(world->queries));
+  world->query_count = 0;
+  world->entities_count = 0;
+  world->entities_capacity = 0;
+  world->alive_count = 0;
+  world->free_head = OX_ENTITY_FREE_LIST_END;
+  world->free_count = 0;
+  memset(&world->entity_region, 0, sizeof(world->entity_region));
+  memset(&world->record_region, 0, sizeof(world->record_region));
+
+  // Address space only, pages are committed as entities are created
+  if (ox_mem_region_reserve(&world->entity_region,
+                            sizeof(ox_entity_id) * OX_ENTITY_FREE_LIST_END,
+                            true) != OX_SUCCESS ||
+      ox_mem_region_reserve(&world->record_region,
+                            sizeof(ox_entity_record_t) *
+                              OX_ENTITY_FREE_LIST_END,
+                            true) != OX_SUCCESS) {
+    OX_LOG_ERR("Failed to reserve the entity tables");
+    ox_world_term(world);
+    return OX_FAILURE;
+  }
+  world->entities = (ox_entity_id*)world->entity_region.base;
+  world->records = (ox_entity_record_t*)world->record_region.base;
+
+  // Archetype 0 holds entities without components
+  ox_component_mask_t empty;
+  ox_component_mask_init(&empty);
+  const ox_archetype_id root = ox_world_get_archetype(world, &empty);
+
+  if (root.value != 0) {
+    ox_world_term(world);
+    return OX_FAILURE;
+  }
+
+  return OX_SUCCESS;
+}
+
+static void ox_query_destroy(ox_query_t* query);
+
+void ox_world_term(ox_world_t* world)
+{
+  for (size_t i = 0; i < world->query_count; ++i) {
+    ox_query_destroy(world->queries[i]);
+    world->queries[i] = NULL;
+  }
+  world->query_count = 0;
+
+  for (size_t i = 0; i < world->archetype_count; ++i) {
+    ox_archetype_destroy(world->archetypes[i]);
+    world->archetypes[i] = NULL;
+  }
+  world->archetype_count = 0;
+
+  ox_mem_region_release(&world->entity_region);
+  ox_mem_region_release(&world->record_region);
+  world->entities = NULL;
+  world->records = NULL;
+  world->entities_count = 0;
+  world->entities_capacity = 0;
+  world->alive_count = 0;
+  world->free_head = OX_ENTITY_FREE_LIST_END;
+  world->free_count = 0;
+
+  ox_component_registry_term(&world->component_registry);
+}
+
+bool ox_query_filter_matches(const ox_query_filter_t* filter,
+                             const ox_component_mask_t* mask)
+{
+  return ox_component_mask_includes(mask, &filter->include_mask) &&
+         ox_component_mask_excludes(mask, &filter->exclude_mask);
+}
+
+// Appends 'archetype' to the query's cache if it passes the filter
+static long ox_query_try_match(ox_query_t* query, const ox_world_t* world,
+                               const ox_archetype_id archetype_id)
+{
+  const ox_archetype_t* archetype = world->archetypes[archetype_id.value];
+  if (!ox_query_filter_matches(&query->filter, &archetype->component_mask)) {
+    return OX_SUCCESS;
+  }
+
+  if (query->match_count == query->match_capacity) {
+    const size_t capacity =
+      query->match_capacity ? query->match_capacity * 2 : 16;
+    ox_query_match_t* matches =
+      ox_mem_acquire(sizeof(ox_query_match_t) * capacity, OX_SOURCE_LOCATION);
+    if (!matches) {
+      return OX_FAILURE;
+    }
+    if (query->match_count != 0) {
+      memcpy(matches, query->matches,
+             sizeof(ox_query_match_t) * query->match_count);
+    }
+    ox_mem_release(query->matches);
+    query->matches = matches;
+    query->match_capacity = capacity;
+  }
+
+  ox_query_match_t* match = &query->matches[query->match_count++];
+  match->archetype = archetype_id;
+  for (size_t i = 0; i < query->term_count; ++i) {
+    match->columns[i] = ox_archetype_find_column(archetype, query->terms[i]);
+  }
+
+  return OX_SUCCESS;
+}
+
+static void ox_query_destroy(ox_query_t* query)
+{
+  ox_mem_release(query->matches);
+  ox_mem_release(query);
+}
+
+ox_query_id ox_world_register_query(ox_world_t* world,
+                                    const ox_query_desc_t* desc)
+{
+  if (world->query_count >= OX_ECS_QUERIES_MAX) {
+    OX_LOG_ERR("Too many queries");
+    return (ox_query_id){ OX_INVALID_ID };
+  }
+
+  if (desc->include_count > OX_ECS_QUERY_TERMS_MAX) {
+    OX_LOG_ERR("Too many query terms: %u", (unsigned)desc->include_count);
+    return (ox_query_id){ OX_INVALID_ID };
+  }
+
+  ox_query_t* query = ox_mem_acquire(sizeof(ox_query_t), OX_SOURCE_LOCATION);
+  if (!query) {
+    return (ox_query_id){ OX_INVALID_ID };
+  }
+
+  memset(query, 0, sizeof(*query));
+  ox_component_mask_init(&query->filter.include_mask);
+  ox_component_mask_init(&query->filter.exclude_mask);
+
+  for (size_t i = 0; i < desc->include_count; ++i) {
+    query->terms[i] = desc->include[i];
+    ox_component_mask_set(&query->filter.include_mask, desc->include[i]);
+  }
+  query->term_count = desc->include_count;
+
+  for (size_t i = 0; i < desc->exclude_count; ++i) {
+    ox_component_mask_set(&query->filter.exclude_mask, desc->exclude[i]);
+  }
+
+  // The only full scan a query ever does, later archetypes are matched on
+  // creation
+  for (size_t i = 0; i < world->archetype_count; ++i) {
+    if (ox_query_try_match(query, world, (ox_archetype_id){ (int)i }) !=
+        OX_SUCCESS) {
+      ox_query_destroy(query);
+      return (ox_query_id){ OX_INVALID_ID };
+    }
+  }
+
+  const ox_query_id id = { (int)world->query_count++ };
+  world->queries[id.value] = query;
+  return id;
+}
+
+void ox_query_iter_init(ox_query_iter_t* iter, const ox_world_t* world,
+                        const ox_query_id query)
+{
+  iter->world = world;
+  iter->query = world->queries[query.value];
+  iter->match = 0;
+  iter->chunk = 0;
+  iter->count = 0;
+  iter->entities = NULL;
+}
+
+bool ox_query_iter_next(ox_query_iter_t* iter)
+{
+  const ox_query_t* query = iter->query;
+
+  while (iter->match < query->match_count) {
+    const ox_query_match_t* match = &query->matches[iter->match];
+    const ox_archetype_t* archetype =
+      iter->world->archetypes[match->archetype.value];
+
+    if (iter->chunk >= ox_archetype_chunk_count(archetype)) {
+      iter->match++;
+      iter->chunk = 0;
+      continue;
+    }
+
+    const size_t chunk = iter->chunk++;
+    iter->count = ox_archetype_chunk_rows(archetype, chunk);
+    iter->entities = archetype->entity_pool.chunks[chunk].data;
+    for (size_t i = 0; i < query->term_count; ++i) {
+      iter->columns[i] =
+        ox_archetype_chunk_column(archetype, match->columns[i], chunk);
+    }
+    return true;
+  }
+
+  iter->count = 0;
+  return false;
+}
+
+size_t ox_query_count(const ox_world_t* world, const ox_query_id query)
+{
+  const ox_query_t* self = world->queries[query.value];
+  size_t count = 0;
+  for (size_t i = 0; i < self->match_count; ++i) {
+    count += world->archetypes[self->matches[i].archetype.value]->entity_count;
+  }
+  return count;
+}
+
+// Undoes the creation of the newest archetype when one of the queries could
+// not take it, so no query misses an archetype that entities can live in.
+// Queries before 'query_count' already matched it, it is the last one there.
+static void ox_world_drop_archetype(ox_world_t* world,
+                                    const ox_archetype_id id, const size_t slot,
+                                    const size_t query_count)
+{
+  for (size_t i = 0; i < query_count; ++i) {
+    ox_query_t* query = world->queries[i];
+    if (query->match_count != 0 &&
+        query->matches[query->match_count - 1].archetype.value == id.value) {
+      query->match_count--;
+    }
+  }
+
+  // The slot was free before, so no probe ever passed through it
+  world->archetype_lookup[slot] = OX_INVALID_ID;
+  ox_archetype_destroy(world->archetypes[id.value]);
+  world->archetypes[id.value] = NULL;
+  world->archetype_count--;
+}
+
+ox_archetype_id ox_world_get_archetype(ox_world_t* world,
+                                       const ox_component_mask_t* mask)
+{
+  // Open addressing with linear probing, the table is twice the archetype
+  // limit so a free slot always ends the probe
+  const uint64_t hash = ox_component_mask_hash(mask);
+  size_t slot = hash & (OX_ECS_ARCHETYPE_LOOKUP_SIZE - 1);
+  while (world->archetype_lookup[slot] != OX_INVALID_ID) {
+    const ox_archetype_t* archetype =
+      world->archetypes[world->archetype_lookup[slot]];
+    if (archetype->hash == hash &&
+        ox_component_mask_equals(&archetype->component_mask, mask)) {
+      return (ox_archetype_id){ world->archetype_lookup[slot] };
+    }
+    slot = (slot + 1) & (OX_ECS_ARCHETYPE_LOOKUP_SIZE - 1);
+  }
+
+  if (world->archetype_count >= OX_ECS_ARCHETYPES_MAX) {
+    OX_LOG_ERR("Too many archetypes");
+    return (ox_archetype_id){ OX_INVALID_ID };
+  }
+
+  ox_archetype_t* archetype =
+    ox_archetype_create(&world->component_registry, mask);
+  if (!archetype) {
+    OX_LOG_ERR("Failed to create archetype");
+    return (ox_archetype_id){ OX_INVALID_ID };
+  }
+
+  const ox_archetype_id id = { (int)world->archetype_count++ };
+  world->archetypes[id.value] = archetype;
+  world->archetype_lookup[slot] = id.value;
+
+  for (size_t i = 0; i < world->query_count; ++i) {
+    if (ox_query_try_match(world->queries[i], world, id) != OX_SUCCESS) {
+      OX_LOG_ERR("Failed to add archetype %d to query %u", id.value,
+                 (unsigned)i);
+      ox_world_drop_archetype(world, id, slot, i);
+      return (ox_archetype_id){ OX_INVALID_ID };
+    }
+  }
+
+  return id;
+}
+
+static long ox_archetype_reserve_edges(ox_archetype_t* archetype)
+{
+  if (archetype->edges) {
+    return OX_SUCCESS;
+  }
+
+  archetype->edges =
+    ox_mem_acquire(sizeof(int16_t) * OX_COMPONENTS_MAX, OX_SOURCE_LOCATION);
+  if (!archetype->edges) {
+    return OX_FAILURE;
+  }
+
+  for (size_t i = 0; i < OX_COMPONENTS_MAX; ++i) {
+    archetype->edges[i] = OX_INVALID_ID;
+  }
+  return OX_SUCCESS;
+}
+
+ox_archetype_id ox_world_get_transition(ox_world_t* world,
+                                        const ox_archetype_id archetype,
+                                        const ox_component_id component)
+{
+  ox_archetype_t* src = world->archetypes[archetype.value];
+  if (src->edges && src->edges[component.value] != OX_INVALID_ID) {
+    return (ox_archetype_id){ src->edges[component.value] };
+  }
+
+  ox_component_mask_t mask = src->component_mask;
+  if (ox_component_mask_has(&mask, component)) {
+    ox_component_mask_clear(&mask, component);
+  } else {
+    ox_component_mask_set(&mask, component);
+  }
+
+  const ox_archetype_id dst_id = ox_world_get_archetype(world, &mask);
+  if (dst_id.value == OX_INVALID_ID) {
+    return dst_id;
+  }
+
+  // An edge is its own inverse, so both ends learn it at once. Without the
+  // table memory the transition still works, it just is not cached.
+  ox_archetype_t* dst = world->archetypes[dst_id.value];
+  if (ox_archetype_reserve_edges(src) == OX_SUCCESS) {
+    src->edges[component.value] = (int16_t)dst_id.value;
+  }
+  if (ox_archetype_reserve_edges(dst) == OX_SUCCESS) {
+    dst->edges[component.value] = (int16_t)archetype.value;
+  }
+
+  return dst_id;
+}
+
+long ox_world_reserve_entities(ox_world_t* world, const size_t count)
+{
+  if (count <= world->entities_capacity) {
+    return OX_SUCCESS;
+  }
+
+  if (ox_mem_region_commit(&world->entity_region,
+                           sizeof(ox_entity_id) * count) != OX_SUCCESS ||
+      ox_mem_region_commit(&world->record_region,
+                           sizeof(ox_entity_record_t) * count) !=
+        OX_SUCCESS) {
+    return OX_FAILURE;
+  }
+
+  // The regions commit ahead, use all of it
+  const size_t entities =
+    world->entity_region.committed / sizeof(ox_entity_id);
+  const size_t records =
+    world->record_region.committed / sizeof(ox_entity_record_t);
+  world->entities_capacity = entities < records ? entities : records;
+  return OX_SUCCESS;
+}
+
+// Pops a recycled slot or appends a new one, the table must have room
+static ox_entity_id ox_world_alloc_entity(ox_world_t* world)
+{
+  ox_entity_id entity = { .value = 0 };
+
+  if (world->free_head != OX_ENTITY_FREE_LIST_END) {
+    entity.index = world->free_head;
+    entity.nonce = world->entities[entity.index].nonce;
+    world->free_head = world->entities[entity.index].index;
+    world->free_count--;
+  } else {
+    // Nonce 0 is reserved so a zeroed handle never refers to a live entity
+    entity.index = world->entities_count++;
+    entity.nonce = 1;
+  }
+
+  world->entities[entity.index] = entity;
+  return entity;
+}
+
+// Bumps the nonce so outstanding handles go stale and pushes the slot
+static void ox_world_free_entity(ox_world_t* world, const size_t index)
+{
+  ox_entity_id* slot = &world->entities[index];
+  slot->nonce++;
+  if (slot->nonce == 0) {
+    slot->nonce = 1;
+  }
+
+  slot->index = world->free_head;
+  world->free_head = index;
+  world->free_count++;
+
+  world->records[index].archetype = (ox_archetype_id){ OX_INVALID_ID };
+  world->records[index].row = 0;
+}
+
+size_t ox_world_spawn_entities(ox_world_t* world,
+                               const ox_archetype_id archetype_id,
+                               ox_entity_id* entities, const size_t count)
+{
+  const size_t fresh =
+    count > world->free_count ? count - world->free_count : 0;
+
+  if (world->entities_count + fresh > OX_ENTITY_FREE_LIST_END) {
+    OX_LOG_ERR("Too many entities");
+    return SIZE_MAX;
+  }
+
+  if (ox_world_reserve_entities(world, world->entities_count + fresh) !=
+      OX_SUCCESS) {
+    OX_LOG_ERR("Failed to grow entity table");
+    return SIZE_MAX;
+  }
+
+  ox_archetype_t* archetype = world->archetypes[archetype_id.value];
+  if (ox_archetype_reserve(archetype, archetype->entity_count + count) !=
+      OX_SUCCESS) {
+    OX_LOG_ERR("Failed to reserve %u rows", (unsigned)count);
+    return SIZE_MAX;
+  }
+
+  const size_t first_row = archetype->entity_count;
+  for (size_t i = 0; i < count; ++i) {
+    const ox_entity_id entity = ox_world_alloc_entity(world);
+    world->records[entity.index].archetype = archetype_id;
+    world->records[entity.index].row = ox_archetype_push_row(archetype, entity);
+    entities[i] = entity;
+  }
+
+  world->alive_count += count;
+  return first_row;
+}
+
+size_t ox_world_create_entities(ox_world_t* world, ox_entity_id* entities,
+                                const size_t count)
+{
+  const size_t row =
+    ox_world_spawn_entities(world, (ox_archetype_id){ 0 }, entities, count);
+  return row == SIZE_MAX ? 0 : count;
+}
+
+ox_entity_id ox_world_create_entity(ox_world_t* world)
+{
+  ox_entity_id entity = { .value = 0 };
+  ox_world_create_entities(world, &entity, 1);
+  return entity;
+}
+
+bool ox_world_is_alive(const ox_world_t* world, const ox_entity_id entity)
+{
+  // Dead slots carry a bumped nonce, so this single compare rejects stale
+  // handles as well as never allocated ones
+  return entity.index < world->entities_count && entity.nonce != 0 &&
+         world->entities[entity.index].nonce == entity.nonce;
+}
+
+void ox_world_destroy_entities(ox_world_t* world, const ox_entity_id* entities,
+                               const size_t count)
+{
+  for (size_t i = 0; i < count; ++i) {
+    const ox_entity_id entity = entities[i];
+    if (!ox_world_is_alive(world, entity)) {
+      OX_LOG_WRN("Destroying a dead entity (index: %u)",
+                 (unsigned)entity.index);
+      continue;
+    }
+
+    const ox_entity_record_t* record = &world->records[entity.index];
+    ox_archetype_remove_row(world, world->archetypes[record->archetype.value],
+                            record->row);
+    ox_world_free_entity(world, entity.index);
+    world->alive_count--;
+  }
+}
+
+void ox_world_destroy_entity(ox_world_t* world, const ox_entity_id entity)
+{
+  ox_world_destroy_entities(world, &entity, 1);
+}
+
+// Moves an entity's row to 'dst', copying the components both archetypes have
+static long ox_world_move_entity(ox_world_t* world, const ox_entity_id entity,
+                                 const ox_archetype_id dst_id)
+{
+  ox_entity_record_t* record = &world->records[entity.index];
+  ox_archetype_t* src = world->archetypes[record->archetype.value];
+  ox_archetype_t* dst = world->archetypes[dst_id.value];
+
+  const size_t dst_row = ox_archetype_push_row(dst, entity);
+  if (dst_row == SIZE_MAX) {
+    return OX_FAILURE;
+  }
+
+  // Both id lists are sorted, so shared columns are found with a merge walk
+  size_t i = 0;
+  size_t j = 0;
+  while (i < src->component_pool_count && j < dst->component_pool_count) {
+    const int src_value = src->component_ids[i].value;
+    const int dst_value = dst->component_ids[j].value;
+    if (src_value == dst_value) {
+      ox_memory_pool_copy(&dst->component_pools[j], dst_row,
+                          &src->component_pools[i], record->row);
+      i++;
+      j++;
+    } else if (src_value < dst_value) {
+      i++;
+    } else {
+      j++;
+    }
+  }
+
+  ox_archetype_remove_row(world, src, record->row);
+  record->archetype = dst_id;
+  record->row = dst_row;
+  return OX_SUCCESS;
+}
+
+static int ox_compare_rows(const void* a, const void* b)
+{
+  const size_t lhs = *(const size_t*)a;
+  const size_t rhs = *(const size_t*)b;
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+long ox_world_move_entities(ox_world_t* world, const ox_entity_id* entities,
+                            const size_t count, const ox_archetype_id dst_id)
+{
+  if (count == 0) {
+    return OX_SUCCESS;
+  }
+
+  const ox_archetype_id src_id = world->records[entities[0].index].archetype;
+  for (size_t i = 0; i < count; ++i) {
+    if (!ox_world_is_alive(world, entities[i]) ||
+        world->records[entities[i].index].archetype.value != src_id.value) {
+      OX_LOG_ERR("Batched move needs live entities of one archetype");
+      return OX_FAILURE;
+    }
+  }
+
+  if (src_id.value == dst_id.value) {
+    return OX_SUCCESS;
+  }
+
+  ox_archetype_t* src = world->archetypes[src_id.value];
+  ox_archetype_t* dst = world->archetypes[dst_id.value];
+
+  size_t* rows = ox_mem_acquire(sizeof(size_t) * count, OX_SOURCE_LOCATION);
+  if (!rows) {
+    return OX_FAILURE;
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    rows[i] = world->records[entities[i].index].row;
+  }
+
+  // Ascending source rows turn neighbouring entities into copyable runs
+  qsort(rows, count, sizeof(size_t), ox_compare_rows);
+
+  if (ox_archetype_reserve(dst, dst->entity_count + count) != OX_SUCCESS) {
+    OX_LOG_ERR("Failed to reserve %u rows", (unsigned)count);
+    ox_mem_release(rows);
+    return OX_FAILURE;
+  }
+
+  const size_t dst_start = dst->entity_count;
+  for (size_t i = 0; i < count; ++i) {
+    const ox_entity_id entity =
+      *(ox_entity_id*)ox_memory_pool_at(&src->entity_pool, rows[i]);
+    ox_archetype_push_row(dst, entity);
+    world->records[entity.index].archetype = dst_id;
+    world->records[entity.index].row = dst_start + i;
+  }
+
+  size_t i = 0;
+  size_t j = 0;
+  while (i < src->component_pool_count && j < dst->component_pool_count) {
+    const int src_value = src->component_ids[i].value;
+    const int dst_value = dst->component_ids[j].value;
+    if (src_value == dst_value) {
+      size_t begin = 0;
+      while (begin < count) {
+        size_t end = begin + 1;
+        while (end < count && rows[end] == rows[end - 1] + 1) {
+          end++;
+        }
+        ox_memory_pool_copy_run(&dst->component_pools[j], dst_start + begin,
+                                &src->component_pools[i], rows[begin],
+                                end - begin);
+        begin = end;
+      }
+      i++;
+      j++;
+    } else if (src_value < dst_value) {
+      i++;
+    } else {
+      j++;
+    }
+  }
+
+  // Highest rows first, so every swap-remove fills the hole with an entity
+  // that stays in the source archetype
+  for (size_t k = count; k-- > 0;) {
+    ox_archetype_remove_row(world, src, rows[k]);
+  }
+
+  ox_mem_release(rows);
+  return OX_SUCCESS;
+}
+
+long ox_world_add_component(ox_world_t* world, const ox_entity_id entity,
+                            const ox_component_id component, const void* data)
+{
+  if (!ox_world_is_alive(world, entity)) {
+    OX_LOG_ERR("Adding component %d to a dead entity", component.value);
+    return OX_FAILURE;
+  }
+
+  const ox_entity_record_t* record = &world->records[entity.index];
+  const ox_archetype_t* src = world->archetypes[record->archetype.value];
+
+  if (!ox_component_mask_has(&src->component_mask, component)) {
+    const ox_archetype_id dst_id =
+      ox_world_get_transition(world, record->archetype, component);
+
+    if (dst_id.value == OX_INVALID_ID ||
+        ox_world_move_entity(world, entity, dst_id) != OX_SUCCESS) {
+      return OX_FAILURE;
+    }
+  }
+
+  const size_t size =
+    world->component_registry.components[component.value].size;
+  if (size != 0) {
+    void* dst = ox_world_get_component(world, entity, component);
+    if (data) {
+      memcpy(dst, data, size);
+    } else {
+      memset(dst, 0, size);
+    }
+  }
+
+  return OX_SUCCESS;
+}
+
+long ox_world_remove_component(ox_world_t* world, const ox_entity_id entity,
+                               const ox_component_id component)
+{
+  if (!ox_world_is_alive(world, entity)) {
+    OX_LOG_ERR("Removing component %d from a dead entity", component.value);
+    return OX_FAILURE;
+  }
+
+  const ox_entity_record_t* record = &world->records[entity.index];
+  const ox_archetype_t* src = world->archetypes[record->archetype.value];
+
+  if (!ox_component_mask_has(&src->component_mask, component)) {
+    return OX_SUCCESS;
+  }
+
+  const ox_archetype_id dst_id =
+    ox_world_get_transition(world, record->archetype, component);
+  if (dst_id.value == OX_INVALID_ID) {
+    return OX_FAILURE;
+  }
+
+  return ox_world_move_entity(world, entity, dst_id);
+}
+
+void* ox_world_get_component(const ox_world_t* world, const ox_entity_id entity,
+                             const ox_component_id component)
+{
+  if (!ox_world_is_alive(world, entity)) {
+    return NULL;
+  }
+
+  const ox_entity_record_t* record = &world->records[entity.index];
+  const ox_archetype_t* archetype = world->archetypes[record->archetype.value];
+  const int column = ox_archetype_find_column(archetype, component);
+  if (column == OX_INVALID_ID ||
+      archetype->component_pools[column].element_size == 0) {
+    return NULL;
+  }
+
+  return ox_memory_pool_at(&archetype->component_pools[column], record->row);
+}
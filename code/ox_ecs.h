@@ -1,9 +1,18 @@
 #pragma once
 
 #include "ox_core.h"
+#include "ox_memory.h"
 
-#include <bitset.h>
+#include <assert.h>
+#include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 
 // Configuration constants
 #define OX_COMPONENTS_MAX              448
@@ -13,10 +22,18 @@
 #define OX_ENTITY_INDEX_BITS           24
 #define OX_ECS_POOL_DEFAULT_CHUNK_SIZE 512
 #define OX_ECS_POOL_MAX_CHUNKS         128
+#define OX_ECS_QUERY_TERMS_MAX         16
+#define OX_ECS_ARCHETYPE_LOOKUP_SIZE   (OX_ECS_ARCHETYPES_MAX * 2)
+#define OX_ECS_COLUMN_ALIGNMENT        64
 
 #define OX_ENTITY_USER_DATA_BITS                                               \
   (OX_SIZEOF_IN_BITS(uint64_t) - OX_ENTITY_NONCE_BITS - OX_ENTITY_INDEX_BITS)
 
+#define OX_INVALID_ID -1
+
+// Terminates the intrusive free list of entity slots, also the index limit
+#define OX_ENTITY_FREE_LIST_END (((size_t)1 << OX_ENTITY_INDEX_BITS) - 1)
+
 OX_DECLARE_ID(ox_component_id);
 OX_DECLARE_ID(ox_query_id);
 OX_DECLARE_ID(ox_system_id);
@@ -39,18 +56,142 @@ typedef struct {
   const char* name;
 } ox_component_info_t;
 
+#define OX_COMPONENT_MASK_WORDS (OX_COMPONENTS_MAX / 64)
+
+static_assert(OX_ECS_ARCHETYPES_MAX <= INT16_MAX,
+              "Archetype ids must fit the 16-bit transition edges");
+
+static_assert(OX_COMPONENTS_MAX % 64 == 0,
+              "OX_COMPONENTS_MAX must be a multiple of 64");
+
+// Inline 448-bit component set, stored by value inside archetypes and queries
 typedef struct {
-  bitset_t* bitset;
+  uint64_t words[OX_COMPONENT_MASK_WORDS];
 } ox_component_mask_t;
 
-static void ox_component_mask_init(ox_component_mask_t* self)
+static inline void ox_component_mask_init(ox_component_mask_t* self)
+{
+  memset(self->words, 0, sizeof(self->words));
+}
+
+static inline void ox_component_mask_set(ox_component_mask_t* self,
+                                         const ox_component_id id)
+{
+  self->words[id.value / 64] |= (uint64_t)1 << (id.value % 64);
+}
+
+static inline void ox_component_mask_clear(ox_component_mask_t* self,
+                                           const ox_component_id id)
+{
+  self->words[id.value / 64] &= ~((uint64_t)1 << (id.value % 64));
+}
+
+static inline bool ox_component_mask_has(const ox_component_mask_t* self,
+                                         const ox_component_id id)
+{
+  return (self->words[id.value / 64] >> (id.value % 64)) & 1;
+}
+
+// The three set tests below fold every word into one accumulator and test it
+// once at the end, so they never branch on the mask contents.
+// OX_COMPONENT_MASK_WORDS is 7: AVX2 covers words 0-3 with one 256-bit lane,
+// SSE2 covers 128-bit pairs and the odd last word is always scalar.
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+static_assert(OX_COMPONENT_MASK_WORDS == 7,
+              "The SIMD mask tests are unrolled for 7 words, update them "
+              "along with OX_COMPONENTS_MAX");
+#endif
+
+#if defined(__AVX2__)
+
+static inline bool ox_component_mask_is_zero(const __m256i wide,
+                                             const __m128i narrow,
+                                             const uint64_t tail)
+{
+  return _mm256_testz_si256(wide, wide) &
+         (_mm_movemask_epi8(_mm_cmpeq_epi8(narrow, _mm_setzero_si128())) ==
+          0xFFFF) &
+         (tail == 0);
+}
+
+#define OX_COMPONENT_MASK_FOLD(self, other, op256, op128, op64)                \
+  const __m256i a0 = _mm256_loadu_si256((const __m256i*)&(self)->words[0]);    \
+  const __m256i b0 = _mm256_loadu_si256((const __m256i*)&(other)->words[0]);   \
+  const __m128i a1 = _mm_loadu_si128((const __m128i*)&(self)->words[4]);       \
+  const __m128i b1 = _mm_loadu_si128((const __m128i*)&(other)->words[4]);      \
+  return ox_component_mask_is_zero(op256(a0, b0), op128(a1, b1),               \
+                                   op64((self)->words[6], (other)->words[6]))
+
+#elif defined(__SSE2__) || defined(_M_X64)
+
+static inline bool ox_component_mask_is_zero(const __m128i acc,
+                                             const uint64_t tail)
+{
+  return (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) ==
+          0xFFFF) &
+         (tail == 0);
+}
+
+#define OX_COMPONENT_MASK_FOLD(self, other, op256, op128, op64)                \
+  __m128i acc = _mm_setzero_si128();                                           \
+  for (int i = 0; i < 6; i += 2) {                                             \
+    const __m128i a = _mm_loadu_si128((const __m128i*)&(self)->words[i]);      \
+    const __m128i b = _mm_loadu_si128((const __m128i*)&(other)->words[i]);     \
+    acc = _mm_or_si128(acc, op128(a, b));                                      \
+  }                                                                            \
+  return ox_component_mask_is_zero(acc,                                        \
+                                   op64((self)->words[6], (other)->words[6]))
+
+#else
+
+#define OX_COMPONENT_MASK_FOLD(self, other, op256, op128, op64)                \
+  uint64_t acc = 0;                                                            \
+  for (int i = 0; i < OX_COMPONENT_MASK_WORDS; ++i) {                          \
+    acc |= op64((self)->words[i], (other)->words[i]);                          \
+  }                                                                            \
+  return acc == 0
+
+#endif
+
+#define OX_MASK_XOR64(a, b)    ((a) ^ (b))
+#define OX_MASK_ANDNOT64(a, b) (~(a) & (b))
+#define OX_MASK_AND64(a, b)    ((a) & (b))
+
+static inline bool ox_component_mask_equals(const ox_component_mask_t* self,
+                                            const ox_component_mask_t* other)
+{
+  OX_COMPONENT_MASK_FOLD(self, other, _mm256_xor_si256, _mm_xor_si128,
+                         OX_MASK_XOR64);
+}
+
+// True if every bit of 'other' is also set in 'self'
+static inline bool
+ox_component_mask_includes(const ox_component_mask_t* self,
+                           const ox_component_mask_t* other)
 {
-  self->bitset = bitset_create_with_capacity(OX_COMPONENTS_MAX);
+  OX_COMPONENT_MASK_FOLD(self, other, _mm256_andnot_si256, _mm_andnot_si128,
+                         OX_MASK_ANDNOT64);
 }
 
-static void ox_component_mask_term(const ox_component_mask_t* self)
+// True if 'self' and 'other' have no bits in common
+static inline bool
+ox_component_mask_excludes(const ox_component_mask_t* self,
+                           const ox_component_mask_t* other)
 {
-  bitset_free(self->bitset);
+  OX_COMPONENT_MASK_FOLD(self, other, _mm256_and_si256, _mm_and_si128,
+                         OX_MASK_AND64);
+}
+
+// 64-bit hash for archetype lookup, a multiply-xorshift fold of the words
+static inline uint64_t ox_component_mask_hash(const ox_component_mask_t* self)
+{
+  uint64_t hash = 0x9E3779B97F4A7C15ull;
+  for (int i = 0; i < OX_COMPONENT_MASK_WORDS; ++i) {
+    hash = (hash ^ self->words[i]) * 0xBF58476D1CE4E5B9ull;
+    hash ^= hash >> 31;
+  }
+  return hash;
 }
 
 typedef struct {
@@ -60,6 +201,14 @@ typedef struct {
 } ox_component_registry_t;
 
 void ox_component_registry_init(ox_component_registry_t* registry);
+void ox_component_registry_term(ox_component_registry_t* registry);
+
+// Returns an id with value OX_INVALID_ID when the registry is full
+ox_component_id ox_component_register(ox_component_registry_t* registry,
+                                      const char* name, size_t size);
+
+#define OX_COMPONENT_REGISTER(registry, type)                                  \
+  ox_component_register(registry, #type, sizeof(type))
 
 typedef struct {
   void* data;
@@ -74,26 +223,206 @@ typedef struct {
   size_t elements_per_chunk;
 } ox_memory_pool_t;
 
+void ox_memory_pool_init(ox_memory_pool_t* pool, size_t element_size,
+                         size_t elements_per_chunk);
+void ox_memory_pool_term(ox_memory_pool_t* pool);
+
+static inline void* ox_memory_pool_at(const ox_memory_pool_t* pool,
+                                      const size_t index)
+{
+  const ox_memory_chunk_t* chunk =
+    &pool->chunks[index / pool->elements_per_chunk];
+  return (char*)chunk->data +
+         (index % pool->elements_per_chunk) * pool->element_size;
+}
+
+// Rows of an archetype are split into chunks of elements_per_chunk rows.
+// Every column (and the entity column) shares the same chunk boundaries, so
+// chunk N of every column covers the same set of entities.
 typedef struct {
   ox_component_mask_t component_mask;
-  ox_component_mask_t all_components_mask;
+  uint64_t hash;
+
+  // Sorted component ids, parallel to component_pools
+  ox_component_id* component_ids;
 
   // Component pools (one per component type)
   ox_memory_pool_t* component_pools;
   size_t component_pool_count;
 
+  // Entity handle stored in each row, used to patch records on swap-remove
+  ox_memory_pool_t entity_pool;
+
   size_t entity_count;
   size_t capacity;
+
+  // Transition edges indexed by component id: the archetype reached by
+  // adding the component (if absent here) or removing it (if present).
+  // Allocated on the first transition, OX_INVALID_ID until an edge is known.
+  int16_t* edges;
 } ox_archetype_t;
 
+// Index of the column storing 'component', or OX_INVALID_ID
+int ox_archetype_find_column(const ox_archetype_t* archetype,
+                             ox_component_id component);
+
+// Appends 'count' rows with uninitialized components and entity handles,
+// for loaders that fill the rows and the entity records themselves.
+// Returns the first row or SIZE_MAX.
+size_t ox_archetype_append_rows(ox_archetype_t* archetype, size_t count);
+
+static inline size_t ox_archetype_chunk_count(const ox_archetype_t* archetype)
+{
+  return (archetype->entity_count + archetype->entity_pool.elements_per_chunk -
+          1) /
+         archetype->entity_pool.elements_per_chunk;
+}
+
+static inline void* ox_archetype_chunk_column(const ox_archetype_t* archetype,
+                                              const int column,
+                                              const size_t chunk)
+{
+  return archetype->component_pools[column].chunks[chunk].data;
+}
+
+static inline size_t ox_archetype_chunk_rows(const ox_archetype_t* archetype,
+                                             const size_t chunk)
+{
+  return archetype->entity_pool.chunks[chunk].used;
+}
+
 typedef struct {
   ox_component_mask_t include_mask;
   ox_component_mask_t exclude_mask;
 } ox_query_filter_t;
 
+bool ox_query_filter_matches(const ox_query_filter_t* filter,
+                             const ox_component_mask_t* mask);
+
+typedef struct {
+  // Components that must be present, iteration yields their columns in order
+  const ox_component_id* include;
+  size_t include_count;
+  // Components that must be absent
+  const ox_component_id* exclude;
+  size_t exclude_count;
+} ox_query_desc_t;
+
+// Archetype matched by a query with the column index of each include term
+typedef struct {
+  ox_archetype_id archetype;
+  int columns[OX_ECS_QUERY_TERMS_MAX];
+} ox_query_match_t;
+
+// Matches are appended when archetypes are created, never rescanned
+typedef struct {
+  ox_query_filter_t filter;
+  ox_component_id terms[OX_ECS_QUERY_TERMS_MAX];
+  size_t term_count;
+
+  ox_query_match_t* matches;
+  size_t match_count;
+  size_t match_capacity;
+} ox_query_t;
+
+// Where an entity's components live
+typedef struct {
+  ox_archetype_id archetype;
+  size_t row;
+} ox_entity_record_t;
+
 typedef struct {
   ox_component_registry_t component_registry;
+
+  ox_archetype_t* archetypes[OX_ECS_ARCHETYPES_MAX];
+  size_t archetype_count;
+  // Mask hash -> archetype index, OX_INVALID_ID marks a free slot
+  int archetype_lookup[OX_ECS_ARCHETYPE_LOOKUP_SIZE];
+
+  ox_query_t* queries[OX_ECS_QUERIES_MAX];
+  size_t query_count;
+
+  // Indexed by entity index, entities[i] holds the live handle of slot i.
+  // A dead slot keeps its bumped nonce and reuses 'index' as the next link
+  // of the free list starting at free_head. Both tables live in regions
+  // reserved for every possible index, so they grow in place.
   ox_entity_id* entities;
+  ox_entity_record_t* records;
+  ox_mem_region_t entity_region;
+  ox_mem_region_t record_region;
   size_t entities_count;
   size_t entities_capacity;
-} ox_world_t;
\ No newline at end of file
+  size_t alive_count;
+  size_t free_head;
+  size_t free_count;
+} ox_world_t;
+
+long ox_world_init(ox_world_t* world);
+void ox_world_term(ox_world_t* world);
+
+// Returns the archetype with exactly 'mask', creating it if needed
+ox_archetype_id ox_world_get_archetype(ox_world_t* world,
+                                       const ox_component_mask_t* mask);
+
+// Returns the archetype reached from 'archetype' by adding 'component' (if
+// absent) or removing it (if present). Cached on both archetypes, so
+// repeated transitions are a single table lookup.
+ox_archetype_id ox_world_get_transition(ox_world_t* world,
+                                        ox_archetype_id archetype,
+                                        ox_component_id component);
+
+// Commits the entity tables for at least 'count' slots
+long ox_world_reserve_entities(ox_world_t* world, size_t count);
+
+ox_entity_id ox_world_create_entity(ox_world_t* world);
+void ox_world_destroy_entity(ox_world_t* world, ox_entity_id entity);
+
+// Creates 'count' component-less entities into 'entities', returns the number
+// created (either 'count' or 0)
+size_t ox_world_create_entities(ox_world_t* world, ox_entity_id* entities,
+                                size_t count);
+// Creates 'count' entities directly in 'archetype' with uninitialized
+// components. Rows are contiguous, returns the first one or SIZE_MAX.
+size_t ox_world_spawn_entities(ox_world_t* world, ox_archetype_id archetype,
+                               ox_entity_id* entities, size_t count);
+// Moves live entities that share one archetype to 'dst', copying each shared
+// column one run of neighbouring rows at a time
+long ox_world_move_entities(ox_world_t* world, const ox_entity_id* entities,
+                            size_t count, ox_archetype_id dst);
+// Dead or stale handles in 'entities' are skipped
+void ox_world_destroy_entities(ox_world_t* world, const ox_entity_id* entities,
+                               size_t count);
+bool ox_world_is_alive(const ox_world_t* world, ox_entity_id entity);
+
+// 'data' may be NULL, in which case the component is zero-initialized
+long ox_world_add_component(ox_world_t* world, ox_entity_id entity,
+                            ox_component_id component, const void* data);
+long ox_world_remove_component(ox_world_t* world, ox_entity_id entity,
+                               ox_component_id component);
+void* ox_world_get_component(const ox_world_t* world, ox_entity_id entity,
+                             ox_component_id component);
+
+// Returns an id with value OX_INVALID_ID on failure
+ox_query_id ox_world_register_query(ox_world_t* world,
+                                    const ox_query_desc_t* desc);
+
+// Chunk-level cursor over the archetypes matched by a query. After each
+// successful ox_query_iter_next() 'columns[i]' points at 'count' contiguous
+// values of include term i (NULL for zero-sized tags).
+typedef struct {
+  const ox_world_t* world;
+  const ox_query_t* query;
+  size_t match;
+  size_t chunk;
+
+  size_t count;
+  const ox_entity_id* entities;
+  void* columns[OX_ECS_QUERY_TERMS_MAX];
+} ox_query_iter_t;
+
+void ox_query_iter_init(ox_query_iter_t* iter, const ox_world_t* world,
+                        ox_query_id query);
+bool ox_query_iter_next(ox_query_iter_t* iter);
+
+// Number of entities currently matched by a query
+size_t ox_query_count(const ox_world_t* world, ox_query_id query);
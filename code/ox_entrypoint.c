@@ -1,58 +1,360 @@
 #include "ox_core.h"
+#include "ox_job.h"
 #include "ox_log.h"
 #include "ox_memory.h"
+#include "ox_profile.h"
 #include "ox_render.h"
+#include "ox_time.h"
 
 #include <math.h>
 #include <raylib-nuklear.h>
 #include <raylib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <time.h>
 
-#define GRID_SIZE          50
-#define MAX_BALLS_PER_CELL 10
-#define NUMBER_OF_BALLS    500
-#define BALL_RADIUS        10.f
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define NARROW_PHASE_WIDTH 8
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define NARROW_PHASE_WIDTH 4
+#else
+#define NARROW_PHASE_WIDTH 1
+#endif
+
+#define GRID_SIZE       50
+#define GRID_GRAIN      4096
+#define COLLIDE_GRAIN   8
+#define NUMBER_OF_BALLS 500
+#define BALL_RADIUS     10.f
+#define INTEGRATE_GRAIN 1024
+#define BALL_ALIGNMENT  64
+
+// Defaults of the headless mode, the window size of ox_render_init
+#define HEADLESS_WIDTH      1920
+#define HEADLESS_HEIGHT     1080
+#define HEADLESS_FRAMES     1000
+#define HEADLESS_DELTA_TIME (1.f / 60.f)
+
+// Gathered lanes are padded past the last ball with positions far enough
+// away to never overlap, so full-width loads need no bounds check
+#define NARROW_PHASE_PADDING 8
+#define NARROW_PHASE_FAR     1e30f
+
+// Profiler window: zones of the last frame, per-zone stats over the last
+// PROFILE_HISTORY frames and flame graph lanes of PROFILE_LANE_HEIGHT
+#define PROFILE_ZONES       4096
+#define PROFILE_STATS       32
+#define PROFILE_HISTORY     120
+#define PROFILE_LANE_HEIGHT 18
+
+enum {
+  SYSTEM_LOG,
+  SYSTEM_MEMORY,
+  SYSTEM_PROFILE,
+  SYSTEM_JOB,
+  SYSTEM_RENDER_QUEUE,
+  SYSTEM_RENDER,
+  SYSTEM_COUNT,
+};
+
+#define SYSTEM_BIT(system) (1u << (system))
 
 typedef struct {
   long (*init)(void);
   void (*free)(void);
   const char* name;
+  unsigned depends;  // SYSTEM_BIT of every subsystem initialized first
+  bool main_thread;  // Keeps thread local state or owns the window
+  bool needs_window; // Skipped in headless mode
 } ox_subsystem_t;
 
 typedef struct {
-  int* ball_indices;
-  int count;
-  int capacity;
-} grid_cell_t;
-
-static ox_subsystem_t subsystems[] = {
-  { ox_memory_init, ox_memory_exit, "Memory" },
-  { ox_render_init, ox_render_exit, "Render" },
+  long result;
+  uint64_t init_ns;
+  uint64_t exit_ns;
+  bool started;
+  bool on_worker;
+} system_state_t;
+
+typedef struct {
+  bool headless;
+  bool seeded;
+  int ball_count;
+  int frames;
+  float delta_time;
+  uint64_t seed;
+  const char* report_path; // NULL for stdout
+  const char* trace_path;  // Chrome trace written on exit, NULL for none
+  bool startup_report;     // Subsystem timings printed on exit
+} options_t;
+
+// Balls sorted by cell in CSR form, rebuilt every frame by counting sort.
+// Cell c holds the sorted slots [cell_start[c], cell_start[c + 1]).
+typedef struct {
+  int width;
+  int height;
+  int ball_count;
+  void* memory;      // Single block every array below is carved from
+  int* cell_start;   // One entry per cell plus the end of the last one
+  int block_count;   // Runs of GRID_GRAIN balls, sorted as one job each
+  int* block_starts; // Per block and cell, the next slot of the block
+  int* ball_cells;   // Cell of every ball
+  int* ball_indices; // Ball of every sorted slot
+  float* xs;         // Positions of the sorted slots, SoA for the narrow
+  float* ys;         // phase and padded for full-width loads
+} grid_t;
+
+typedef struct {
+  grid_t* grid;
+  const Vector2* positions;
+} assign_ctx_t;
+
+// Fills the SoA lanes and, when 'sorted_positions' is set, moves the ball
+// data into cell order as well
+typedef struct {
+  grid_t* grid;
+  const Vector2* positions;
+  const Vector2* directions;
+  const Color* colors;
+  Vector2* sorted_positions;
+  Vector2* sorted_directions;
+  Color* sorted_colors;
+} gather_ctx_t;
+
+typedef struct {
+  int ball1;
+  int ball2;
+} collision_pair_t;
+
+// A cell is resolved against itself and its right, down-left, down and
+// down-right neighbours, so it writes to balls of a 3x2 block of cells.
+// Cells of the same color are at least 3 columns or 2 rows apart, their
+// blocks never overlap and one color can be processed in parallel.
+#define COLLIDE_COLORS_X 3
+#define COLLIDE_COLORS_Y 2
+
+typedef struct {
+  const grid_t* grid;
+  Vector2* positions;
+  Vector2* directions;
+  float radius;
+  int first_x; // First cell of the color
+  int first_y;
+  int columns; // Cells of the color per row
+} collide_ctx_t;
+
+typedef struct {
+  Vector2* positions;
+  const Vector2* directions;
+  float delta_time;
+  float width;
+  float height;
+} integrate_ctx_t;
+
+// Everything one step of the ball simulation works on, shared by the
+// windowed and the headless mode
+typedef struct {
+  int ball_count;
+  float ball_radius;
+  float width;
+  float height;
+
+  // Keeping the ball data in cell order makes the narrow phase walk
+  // contiguous memory, at the cost of one extra copy per frame
+  bool reorder_balls;
+
+  Vector2* positions;
+  Vector2* directions;
+  Color* colors;
+
+  // Targets of the reordering, swapped with the arrays above every frame
+  Vector2* sorted_positions;
+  Vector2* sorted_directions;
+  Color* sorted_colors;
+
+  grid_t grid;
+} simulation_t;
+
+enum {
+  STAGE_INTEGRATE,
+  STAGE_GRID,
+  STAGE_COLLIDE,
+  STAGE_RENDER,
+  STAGE_FRAME,
+  STAGE_COUNT,
+};
+
+static const char* stage_names[STAGE_COUNT] = {
+  "integrate",
+  "grid",
+  "collide",
+  "render",
+  "frame",
+};
+
+static ox_subsystem_t subsystems[SYSTEM_COUNT] = {
+  [SYSTEM_LOG] = { ox_log_init, ox_log_exit, "Log", 0, false, false },
+  [SYSTEM_MEMORY] = { ox_memory_init, ox_memory_exit, "Memory",
+                      SYSTEM_BIT(SYSTEM_LOG), false, false },
+  [SYSTEM_PROFILE] = { ox_profile_init, ox_profile_exit, "Profile",
+                       SYSTEM_BIT(SYSTEM_MEMORY), false, false },
+  // The initializing thread becomes job thread 0
+  [SYSTEM_JOB] = { ox_job_init, ox_job_exit, "Job",
+                   SYSTEM_BIT(SYSTEM_MEMORY) | SYSTEM_BIT(SYSTEM_PROFILE),
+                   true, false },
+  [SYSTEM_RENDER_QUEUE] = { ox_render_queue_init, ox_render_queue_exit,
+                            "Render queue", SYSTEM_BIT(SYSTEM_MEMORY), false,
+                            false },
+  [SYSTEM_RENDER] = { ox_render_init, ox_render_exit, "Render",
+                      SYSTEM_BIT(SYSTEM_MEMORY) | SYSTEM_BIT(SYSTEM_PROFILE) |
+                        SYSTEM_BIT(SYSTEM_RENDER_QUEUE),
+                      true, true },
 };
 
-static void systems_exit_starting_from(const int index)
+static system_state_t system_states[SYSTEM_COUNT];
+static int system_order[SYSTEM_COUNT]; // Initialized ones, in init order
+static int system_started_count;
+static uint64_t systems_startup_ns;
+
+static void system_run_init(const int index)
 {
-  for (int i = index; i >= 0; --i) {
-    OX_LOG_DBG("Exit system '%s'", subsystems[i].name);
-    subsystems[i].free();
+  OX_LOG_DBG("Init system '%s'", subsystems[index].name);
+  const uint64_t start = ox_time_ns();
+  system_states[index].result = subsystems[index].init();
+  system_states[index].init_ns = ox_time_ns() - start;
+}
+
+static int system_thread(void* data)
+{
+  system_run_init((int)(intptr_t)data);
+  return 0;
+}
+
+// Exits in reverse init order, so dependents always go first
+static void systems_exit(void)
+{
+  for (int i = system_started_count - 1; i >= 0; --i) {
+    const int index = system_order[i];
+    OX_LOG_DBG("Exit system '%s'", subsystems[index].name);
+    const uint64_t start = ox_time_ns();
+    subsystems[index].free();
+    system_states[index].exit_ns = ox_time_ns() - start;
   }
+  system_started_count = 0;
 }
 
-static long systems_init(void)
+// Initializes in waves of every subsystem whose dependencies are up. The
+// main thread takes the pinned ones of a wave, or the last one when none
+// is pinned, the others get a thread each. A failure rolls back whatever
+// was initialized.
+static long systems_init(const bool headless)
 {
-  for (int i = 0; i < OX_ARRAY_SIZE(subsystems); ++i) {
-    OX_LOG_DBG("Init system '%s'", subsystems[i].name);
-    if (subsystems[i].init() != OX_SUCCESS) {
-      systems_exit_starting_from(i - 1);
-      return 1;
+  memset(system_states, 0, sizeof(system_states));
+  system_started_count = 0;
+  const uint64_t start = ox_time_ns();
+
+  // Skipped subsystems count as initialized for their dependents
+  unsigned done = 0;
+  for (int i = 0; i < SYSTEM_COUNT; ++i) {
+    if (headless && subsystems[i].needs_window) {
+      done |= SYSTEM_BIT(i);
     }
   }
 
-  return 0;
+  while (done != SYSTEM_BIT(SYSTEM_COUNT) - 1) {
+    int wave[SYSTEM_COUNT];
+    int wave_size = 0;
+    bool pinned = false;
+    for (int i = 0; i < SYSTEM_COUNT; ++i) {
+      if (!(done & SYSTEM_BIT(i)) && (subsystems[i].depends & ~done) == 0) {
+        wave[wave_size++] = i;
+        pinned = pinned || subsystems[i].main_thread;
+      }
+    }
+
+    if (wave_size == 0) {
+      OX_LOG_ERR("Subsystem dependencies form a cycle");
+      systems_exit();
+      return OX_FAILURE;
+    }
+
+    thrd_t threads[SYSTEM_COUNT];
+    const int main_index = pinned ? -1 : wave[wave_size - 1];
+    for (int k = 0; k < wave_size; ++k) {
+      const int index = wave[k];
+      if (subsystems[index].main_thread || index == main_index) {
+        continue;
+      }
+
+      // Without a thread it runs on the main one right away
+      system_states[index].on_worker =
+        thrd_create(&threads[index], system_thread, (void*)(intptr_t)index) ==
+        thrd_success;
+      if (!system_states[index].on_worker) {
+        system_run_init(index);
+      }
+    }
+
+    for (int k = 0; k < wave_size; ++k) {
+      const int index = wave[k];
+      if (subsystems[index].main_thread || index == main_index) {
+        system_run_init(index);
+      }
+    }
+
+    bool failed = false;
+    for (int k = 0; k < wave_size; ++k) {
+      const int index = wave[k];
+      if (system_states[index].on_worker) {
+        thrd_join(threads[index], NULL);
+      }
+
+      done |= SYSTEM_BIT(index);
+      if (system_states[index].result != OX_SUCCESS) {
+        OX_LOG_ERR("Failed to init system '%s'", subsystems[index].name);
+        failed = true;
+        continue;
+      }
+
+      system_states[index].started = true;
+      system_order[system_started_count++] = index;
+    }
+
+    if (failed) {
+      systems_exit();
+      return OX_FAILURE;
+    }
+  }
+
+  systems_startup_ns = ox_time_ns() - start;
+  return OX_SUCCESS;
 }
 
-static void systems_exit(void)
+// Init and exit time of every subsystem that was initialized
+static void systems_report(FILE* output)
 {
-  systems_exit_starting_from(OX_ARRAY_SIZE(subsystems) - 1);
+  uint64_t init_total = 0;
+  (void)fprintf(output, "%-14s %-6s %10s %10s\n", "Subsystem", "Thread",
+                "Init ms", "Exit ms");
+  for (int i = 0; i < SYSTEM_COUNT; ++i) {
+    const system_state_t* state = &system_states[i];
+    if (!state->started) {
+      continue;
+    }
+
+    init_total += state->init_ns;
+    (void)fprintf(output, "%-14s %-6s %10.3f %10.3f\n", subsystems[i].name,
+                  state->on_worker ? "worker" : "main",
+                  (double)state->init_ns * 1e-6,
+                  (double)state->exit_ns * 1e-6);
+  }
+
+  (void)fprintf(output, "Startup took %.3f ms for %.3f ms of init work\n",
+                (double)systems_startup_ns * 1e-6, (double)init_total * 1e-6);
 }
 
 void wrap_position(Vector2* position, const float width, const float height)
@@ -66,16 +368,6 @@ void wrap_position(Vector2* position, const float width, const float height)
     position->y += height;
 }
 
-bool check_circle_collision(const Vector2 pos1, const Vector2 pos2,
-                            const float radius1, const float radius2)
-{
-  const float dx = pos1.x - pos2.x;
-  const float dy = pos1.y - pos2.y;
-  const float distance_squared = dx * dx + dy * dy;
-  const float min_distance = radius1 + radius2;
-  return distance_squared < min_distance * min_distance;
-}
-
 void resolve_collision(Vector2* pos1, Vector2* pos2, Vector2* vel1,
                        Vector2* vel2, const float radius1, const float radius2)
 {
@@ -117,88 +409,898 @@ void resolve_collision(Vector2* pos1, Vector2* pos2, Vector2* vel1,
   }
 }
 
-void add_ball_to_cell(grid_cell_t* cell, const int ball_index)
+static void integrate_balls(void* data, const size_t begin, const size_t end)
 {
-  if (cell->count < cell->capacity) {
-    cell->ball_indices[cell->count++] = ball_index;
+  const integrate_ctx_t* ctx = data;
+  OX_PROFILE_BEGIN("integrate balls");
+  for (size_t i = begin; i < end; ++i) {
+    ctx->positions[i].x += ctx->directions[i].x * ctx->delta_time;
+    ctx->positions[i].y += ctx->directions[i].y * ctx->delta_time;
+    wrap_position(&ctx->positions[i], ctx->width, ctx->height);
   }
+  OX_PROFILE_END();
+}
+
+static size_t grid_align(const size_t size)
+{
+  return (size + BALL_ALIGNMENT - 1) & ~(size_t)(BALL_ALIGNMENT - 1);
+}
+
+long grid_init(grid_t* grid, const int width, const int height,
+               const int ball_count)
+{
+  const size_t cells = (size_t)width * height;
+  const size_t balls = (size_t)ball_count;
+  const size_t blocks = (balls + GRID_GRAIN - 1) / GRID_GRAIN;
+  const size_t lanes = balls + NARROW_PHASE_PADDING;
+
+  const size_t cell_start_size = grid_align(sizeof(int) * (cells + 1));
+  const size_t block_starts_size = grid_align(sizeof(int) * cells * blocks);
+  const size_t ball_cells_size = grid_align(sizeof(int) * balls);
+  const size_t ball_indices_size = grid_align(sizeof(int) * balls);
+  const size_t lanes_size = grid_align(sizeof(float) * lanes);
+
+  char* memory = ox_mem_acquire_aligned(
+    cell_start_size + block_starts_size + ball_cells_size + ball_indices_size +
+      2 * lanes_size,
+    BALL_ALIGNMENT, OX_SOURCE_LOCATION);
+  if (!memory) {
+    return OX_FAILURE;
+  }
+
+  grid->width = width;
+  grid->height = height;
+  grid->ball_count = ball_count;
+  grid->block_count = (int)blocks;
+  grid->memory = memory;
+  grid->cell_start = (int*)memory;
+  grid->block_starts = (int*)((char*)grid->cell_start + cell_start_size);
+  grid->ball_cells = (int*)((char*)grid->block_starts + block_starts_size);
+  grid->ball_indices = (int*)((char*)grid->ball_cells + ball_cells_size);
+  grid->xs = (float*)((char*)grid->ball_indices + ball_indices_size);
+  grid->ys = (float*)((char*)grid->xs + lanes_size);
+
+  for (size_t i = balls; i < lanes; ++i) {
+    grid->xs[i] = NARROW_PHASE_FAR;
+    grid->ys[i] = NARROW_PHASE_FAR;
+  }
+
+  return OX_SUCCESS;
+}
+
+static inline int grid_cell_count(const grid_t* grid, const int cell)
+{
+  return grid->cell_start[cell + 1] - grid->cell_start[cell];
+}
+
+void grid_free(grid_t* grid)
+{
+  ox_mem_release(grid->memory);
+  grid->memory = NULL;
 }
 
-void check_collisions_in_cells(const grid_cell_t* cell1,
-                               const grid_cell_t* cell2,
-                               Vector2* ball_positions,
+static void assign_cells(void* data, const size_t begin, const size_t end)
+{
+  const assign_ctx_t* ctx = data;
+  grid_t* grid = ctx->grid;
+
+  OX_PROFILE_BEGIN("assign cells");
+  for (size_t i = begin; i < end; ++i) {
+    int grid_x = (int)(ctx->positions[i].x / GRID_SIZE);
+    int grid_y = (int)(ctx->positions[i].y / GRID_SIZE);
+
+    // Clamp to grid bounds
+    grid_x =
+      grid_x < 0 ? 0 : (grid_x >= grid->width ? grid->width - 1 : grid_x);
+    grid_y =
+      grid_y < 0 ? 0 : (grid_y >= grid->height ? grid->height - 1 : grid_y);
+
+    grid->ball_cells[i] = grid_y * grid->width + grid_x;
+  }
+  OX_PROFILE_END();
+}
+
+// Counts the balls of every block per cell
+static void count_cells(void* data, const size_t begin, const size_t end)
+{
+  grid_t* grid = data;
+  const size_t cells = (size_t)grid->width * grid->height;
+
+  OX_PROFILE_BEGIN("count cells");
+  for (size_t block = begin; block < end; ++block) {
+    int* counts = &grid->block_starts[block * cells];
+    memset(counts, 0, sizeof(int) * cells);
+
+    const size_t first = block * GRID_GRAIN;
+    const size_t last = first + GRID_GRAIN < (size_t)grid->ball_count
+                          ? first + GRID_GRAIN
+                          : (size_t)grid->ball_count;
+    for (size_t i = first; i < last; ++i) {
+      counts[grid->ball_cells[i]]++;
+    }
+  }
+  OX_PROFILE_END();
+}
+
+// Moves every ball of a block to the next slot the block owns in its cell
+static void scatter_cells(void* data, const size_t begin, const size_t end)
+{
+  grid_t* grid = data;
+  const size_t cells = (size_t)grid->width * grid->height;
+
+  OX_PROFILE_BEGIN("scatter cells");
+  for (size_t block = begin; block < end; ++block) {
+    int* starts = &grid->block_starts[block * cells];
+
+    const size_t first = block * GRID_GRAIN;
+    const size_t last = first + GRID_GRAIN < (size_t)grid->ball_count
+                          ? first + GRID_GRAIN
+                          : (size_t)grid->ball_count;
+    for (size_t i = first; i < last; ++i) {
+      grid->ball_indices[starts[grid->ball_cells[i]]++] = (int)i;
+    }
+  }
+  OX_PROFILE_END();
+}
+
+static void gather_slots(void* data, const size_t begin, const size_t end)
+{
+  const gather_ctx_t* ctx = data;
+  grid_t* grid = ctx->grid;
+
+  OX_PROFILE_BEGIN("gather slots");
+  for (size_t slot = begin; slot < end; ++slot) {
+    const int ball = grid->ball_indices[slot];
+    grid->xs[slot] = ctx->positions[ball].x;
+    grid->ys[slot] = ctx->positions[ball].y;
+
+    if (ctx->sorted_positions) {
+      ctx->sorted_positions[slot] = ctx->positions[ball];
+      ctx->sorted_directions[slot] = ctx->directions[ball];
+      ctx->sorted_colors[slot] = ctx->colors[ball];
+      grid->ball_indices[slot] = (int)slot;
+    }
+  }
+  OX_PROFILE_END();
+}
+
+// Counting sort of the balls by cell: count, prefix sum, scatter. Every
+// per-ball pass runs on the job system, counting and scattering one block
+// of balls per job into a histogram of its own. Only the O(cells * blocks)
+// prefix sum is serial. Blocks take their slots of a cell in ball order,
+// so slots keep ball order within a cell.
+void grid_rebuild(grid_t* grid, gather_ctx_t* gather)
+{
+  const int cell_count = grid->width * grid->height;
+  const size_t block_count = (size_t)grid->block_count;
+
+  assign_ctx_t assign = { .grid = grid, .positions = gather->positions };
+  ox_job_parallel_for((size_t)grid->ball_count, GRID_GRAIN, assign_cells,
+                      &assign);
+  ox_job_parallel_for(block_count, 1, count_cells, grid);
+
+  // Exclusive sum over the cells and, within a cell, over the blocks: a
+  // block's count turns into the first slot of its balls in that cell
+  OX_PROFILE_BEGIN("sort cells");
+  int slot = 0;
+  for (int cell = 0; cell < cell_count; ++cell) {
+    grid->cell_start[cell] = slot;
+    for (size_t block = 0; block < block_count; ++block) {
+      int* start = &grid->block_starts[block * cell_count + cell];
+      const int count = *start;
+      *start = slot;
+      slot += count;
+    }
+  }
+  grid->cell_start[cell_count] = slot;
+  OX_PROFILE_END();
+
+  ox_job_parallel_for(block_count, 1, scatter_cells, grid);
+
+  gather->grid = grid;
+  ox_job_parallel_for((size_t)grid->ball_count, GRID_GRAIN, gather_slots,
+                      gather);
+}
+
+// Bit i is set when the ball at (x, y) overlaps lane i
+static inline unsigned overlap_mask(const float x, const float y,
+                                    const float* xs, const float* ys,
+                                    const float min_distance2)
+{
+#if defined(__AVX2__)
+  const __m256 dx = _mm256_sub_ps(_mm256_set1_ps(x), _mm256_loadu_ps(xs));
+  const __m256 dy = _mm256_sub_ps(_mm256_set1_ps(y), _mm256_loadu_ps(ys));
+  const __m256 d2 =
+    _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+  return (unsigned)_mm256_movemask_ps(
+    _mm256_cmp_ps(d2, _mm256_set1_ps(min_distance2), _CMP_LT_OQ));
+#elif defined(__SSE2__) || defined(_M_X64)
+  const __m128 dx = _mm_sub_ps(_mm_set1_ps(x), _mm_loadu_ps(xs));
+  const __m128 dy = _mm_sub_ps(_mm_set1_ps(y), _mm_loadu_ps(ys));
+  const __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+  return (unsigned)_mm_movemask_ps(
+    _mm_cmplt_ps(d2, _mm_set1_ps(min_distance2)));
+#else
+  const float dx = x - xs[0];
+  const float dy = y - ys[0];
+  return dx * dx + dy * dy < min_distance2;
+#endif
+}
+
+// Appends the pairs of 'ball' with every overlapping lane in [begin, end)
+static int collect_overlaps(const int ball, const float x, const float y,
+                            const grid_t* grid, const int begin, const int end,
+                            const float min_distance2, collision_pair_t* pairs,
+                            int pair_count)
+{
+  for (int j = begin; j < end; j += NARROW_PHASE_WIDTH) {
+    unsigned mask =
+      overlap_mask(x, y, &grid->xs[j], &grid->ys[j], min_distance2);
+    if (end - j < NARROW_PHASE_WIDTH) {
+      mask &= (1u << (end - j)) - 1;
+    }
+
+    while (mask) {
+      const int lane = ox_ctz64(mask);
+      pairs[pair_count++] =
+        (collision_pair_t){ ball, grid->ball_indices[j + lane] };
+      mask &= mask - 1;
+    }
+  }
+
+  return pair_count;
+}
+
+void check_collisions_in_cells(const grid_t* grid, const int cell1,
+                               const int cell2, Vector2* ball_positions,
                                Vector2* ball_directions,
                                const float ball_radius, const bool same_cell)
 {
-  for (int i = 0; i < cell1->count; ++i) {
-    const int ball1 = cell1->ball_indices[i];
-    const int j_start = same_cell ? i + 1 : 0;
-    const int j_end = same_cell ? cell1->count : cell2->count;
-    const grid_cell_t* target_cell = same_cell ? cell1 : cell2;
-
-    for (int j = j_start; j < j_end; ++j) {
-      const int ball2 = target_cell->ball_indices[j];
-      if (check_circle_collision(ball_positions[ball1], ball_positions[ball2],
-                                 ball_radius, ball_radius)) {
-        resolve_collision(&ball_positions[ball1], &ball_positions[ball2],
-                          &ball_directions[ball1], &ball_directions[ball2],
-                          ball_radius, ball_radius);
-      }
+  const int begin1 = grid->cell_start[cell1];
+  const int end1 = grid->cell_start[cell1 + 1];
+  const int begin2 = grid->cell_start[cell2];
+  const int end2 = grid->cell_start[cell2 + 1];
+  const float min_distance = ball_radius + ball_radius;
+
+  // Pairs are found against the positions gathered by grid_rebuild and
+  // resolved one row at a time. resolve_collision checks the distance again,
+  // so a pair pushed apart by an earlier one is skipped.
+  const ox_scratch_t scratch = ox_scratch_begin();
+  collision_pair_t* pairs =
+    ox_frame_acquire(sizeof(collision_pair_t) * (size_t)(end2 - begin2));
+  if (!pairs) {
+    ox_scratch_end(scratch);
+    return;
+  }
+
+  for (int i = begin1; i < end1; ++i) {
+    const int ball1 = grid->ball_indices[i];
+    const int pair_count = collect_overlaps(
+      ball1, grid->xs[i], grid->ys[i], grid, same_cell ? i + 1 : begin2, end2,
+      min_distance * min_distance, pairs, 0);
+
+    for (int p = 0; p < pair_count; ++p) {
+      const int ball2 = pairs[p].ball2;
+      resolve_collision(&ball_positions[ball1], &ball_positions[ball2],
+                        &ball_directions[ball1], &ball_directions[ball2],
+                        ball_radius, ball_radius);
     }
   }
+
+  ox_scratch_end(scratch);
 }
 
-int main(void)
+static void collide_cell(const collide_ctx_t* ctx, const int cell_x,
+                         const int cell_y)
 {
-  const long ret_code = systems_init();
-  if (ret_code != OX_SUCCESS) {
-    return (int)ret_code;
+  const grid_t* grid = ctx->grid;
+  const int current_cell = cell_y * grid->width + cell_x;
+  if (grid_cell_count(grid, current_cell) == 0) {
+    return;
   }
 
-  struct nk_context* ctx = InitNuklearEx(ox_render_get_current_font(),
-                                         (float)ox_render_get_font_size());
+  // Check collisions within current cell
+  if (grid_cell_count(grid, current_cell) > 1) {
+    check_collisions_in_cells(grid, current_cell, current_cell,
+                              ctx->positions, ctx->directions, ctx->radius,
+                              true);
+  }
 
-  static const int number_of_balls = NUMBER_OF_BALLS;
-  static const float ball_radius = BALL_RADIUS;
+  // Check the neighbours after this cell in row-major order, every pair of
+  // adjacent cells is visited once
+  const int neighbours[][2] = { { 1, 0 }, { -1, 1 }, { 0, 1 }, { 1, 1 } };
+  for (size_t i = 0; i < OX_ARRAY_SIZE(neighbours); ++i) {
+    const int x = cell_x + neighbours[i][0];
+    const int y = cell_y + neighbours[i][1];
+    if (x < 0 || x >= grid->width || y >= grid->height) {
+      continue;
+    }
 
-  Vector2* ball_positions =
-    ox_mem_acquire(sizeof(Vector2) * number_of_balls, OX_SOURCE_LOCATION);
-  Vector2* ball_directions =
-    ox_mem_acquire(sizeof(Vector2) * number_of_balls, OX_SOURCE_LOCATION);
-  Color* ball_colors =
-    ox_mem_acquire(sizeof(Color) * number_of_balls, OX_SOURCE_LOCATION);
+    const int cell = y * grid->width + x;
+    if (grid_cell_count(grid, cell) > 0) {
+      check_collisions_in_cells(grid, current_cell, cell, ctx->positions,
+                                ctx->directions, ctx->radius, false);
+    }
+  }
+}
 
-  // Initialize grid for spatial partitioning
-  const int grid_width = (GetScreenWidth() + GRID_SIZE - 1) / GRID_SIZE;
-  const int grid_height = (GetScreenHeight() + GRID_SIZE - 1) / GRID_SIZE;
-  const int total_cells = grid_width * grid_height;
+static void collide_cells(void* data, const size_t begin, const size_t end)
+{
+  const collide_ctx_t* ctx = data;
+  OX_PROFILE_BEGIN("collide cells");
+  for (size_t i = begin; i < end; ++i) {
+    const int column = (int)(i % (size_t)ctx->columns);
+    const int row = (int)(i / (size_t)ctx->columns);
+    collide_cell(ctx, ctx->first_x + column * COLLIDE_COLORS_X,
+                 ctx->first_y + row * COLLIDE_COLORS_Y);
+  }
+  OX_PROFILE_END();
+}
+
+// Colors run one after another, the cells of a color run on the job system.
+// Within a color no two cells touch the same ball, so the result does not
+// depend on the number of threads or on how cells are scheduled.
+void collide_grid(const grid_t* grid, Vector2* ball_positions,
+                  Vector2* ball_directions, const float ball_radius)
+{
+  for (int first_y = 0; first_y < COLLIDE_COLORS_Y; ++first_y) {
+    for (int first_x = 0; first_x < COLLIDE_COLORS_X; ++first_x) {
+      const int columns =
+        (grid->width - first_x + COLLIDE_COLORS_X - 1) / COLLIDE_COLORS_X;
+      const int rows =
+        (grid->height - first_y + COLLIDE_COLORS_Y - 1) / COLLIDE_COLORS_Y;
+      if (columns <= 0 || rows <= 0) {
+        continue;
+      }
+
+      collide_ctx_t ctx = {
+        .grid = grid,
+        .positions = ball_positions,
+        .directions = ball_directions,
+        .radius = ball_radius,
+        .first_x = first_x,
+        .first_y = first_y,
+        .columns = columns,
+      };
+      ox_job_parallel_for((size_t)columns * rows, COLLIDE_GRAIN,
+                          collide_cells, &ctx);
+    }
+  }
+}
+
+// xorshift64*, a fixed seed gives the same balls on every platform
+static uint32_t random_next(uint64_t* state)
+{
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return (uint32_t)((*state * 0x2545F4914F6CDD1Dull) >> 32);
+}
 
-  grid_cell_t* grid =
-    ox_mem_acquire(sizeof(grid_cell_t) * total_cells, OX_SOURCE_LOCATION);
+// Inclusive range like GetRandomValue
+static int random_range(uint64_t* state, const int min, const int max)
+{
+  return min + (int)(random_next(state) % (uint32_t)(max - min + 1));
+}
 
-  // Initialize grid cells
-  for (int i = 0; i < total_cells; ++i) {
-    grid[i].ball_indices =
-      ox_mem_acquire(sizeof(int) * MAX_BALLS_PER_CELL, OX_SOURCE_LOCATION);
-    grid[i].count = 0;
-    grid[i].capacity = MAX_BALLS_PER_CELL;
+static void simulation_free(simulation_t* sim)
+{
+  grid_free(&sim->grid);
+  ox_mem_release(sim->positions);
+  ox_mem_release(sim->directions);
+  ox_mem_release(sim->colors);
+  ox_mem_release(sim->sorted_positions);
+  ox_mem_release(sim->sorted_directions);
+  ox_mem_release(sim->sorted_colors);
+}
+
+static long simulation_init(simulation_t* sim, const int ball_count,
+                            const float width, const float height,
+                            uint64_t seed)
+{
+  memset(sim, 0, sizeof(*sim));
+  sim->ball_count = ball_count;
+  sim->ball_radius = BALL_RADIUS;
+  sim->width = width;
+  sim->height = height;
+  sim->reorder_balls = true;
+
+  // Cache-line aligned so vectorized loops start on a full line
+  const size_t count = (size_t)ball_count;
+  sim->positions = ox_mem_acquire_aligned(sizeof(Vector2) * count,
+                                          BALL_ALIGNMENT, OX_SOURCE_LOCATION);
+  sim->directions = ox_mem_acquire_aligned(sizeof(Vector2) * count,
+                                           BALL_ALIGNMENT, OX_SOURCE_LOCATION);
+  sim->colors = ox_mem_acquire_aligned(sizeof(Color) * count, BALL_ALIGNMENT,
+                                       OX_SOURCE_LOCATION);
+  sim->sorted_positions = ox_mem_acquire_aligned(
+    sizeof(Vector2) * count, BALL_ALIGNMENT, OX_SOURCE_LOCATION);
+  sim->sorted_directions = ox_mem_acquire_aligned(
+    sizeof(Vector2) * count, BALL_ALIGNMENT, OX_SOURCE_LOCATION);
+  sim->sorted_colors = ox_mem_acquire_aligned(
+    sizeof(Color) * count, BALL_ALIGNMENT, OX_SOURCE_LOCATION);
+
+  // Initialize grid for spatial partitioning
+  const int grid_width = ((int)width + GRID_SIZE - 1) / GRID_SIZE;
+  const int grid_height = ((int)height + GRID_SIZE - 1) / GRID_SIZE;
+
+  if (!sim->positions || !sim->directions || !sim->colors ||
+      !sim->sorted_positions || !sim->sorted_directions ||
+      !sim->sorted_colors ||
+      grid_init(&sim->grid, grid_width, grid_height, ball_count) !=
+        OX_SUCCESS) {
+    simulation_free(sim);
+    return OX_FAILURE;
   }
 
+  // xorshift gets stuck on zero
+  seed = seed ? seed : 0x9E3779B97F4A7C15ull;
+
   // Initialize balls
-  for (int i = 0; i < number_of_balls; ++i) {
-    ball_positions[i].x = (float)GetRandomValue(
-      (int)ball_radius, GetScreenWidth() - (int)ball_radius);
-    ball_positions[i].y = (float)GetRandomValue(
-      (int)ball_radius, GetScreenHeight() - (int)ball_radius);
-    ball_directions[i].x = (float)GetRandomValue(-150, 150);
-    ball_directions[i].y = (float)GetRandomValue(-150, 150);
-    ball_colors[i].a = 255;
-    ball_colors[i].r = GetRandomValue(100, 255);
-    ball_colors[i].g = GetRandomValue(100, 255);
-    ball_colors[i].b = GetRandomValue(100, 255);
+  const int radius = (int)sim->ball_radius;
+  for (int i = 0; i < ball_count; ++i) {
+    sim->positions[i].x =
+      (float)random_range(&seed, radius, (int)width - radius);
+    sim->positions[i].y =
+      (float)random_range(&seed, radius, (int)height - radius);
+    sim->directions[i].x = (float)random_range(&seed, -150, 150);
+    sim->directions[i].y = (float)random_range(&seed, -150, 150);
+    sim->colors[i].a = 255;
+    sim->colors[i].r = (unsigned char)random_range(&seed, 100, 255);
+    sim->colors[i].g = (unsigned char)random_range(&seed, 100, 255);
+    sim->colors[i].b = (unsigned char)random_range(&seed, 100, 255);
   }
 
+  return OX_SUCCESS;
+}
+
+static void simulation_integrate(simulation_t* sim, const float delta_time)
+{
+  integrate_ctx_t integrate_ctx = {
+    .positions = sim->positions,
+    .directions = sim->directions,
+    .delta_time = delta_time,
+    .width = sim->width,
+    .height = sim->height,
+  };
+  OX_PROFILE_BEGIN("integrate");
+  ox_job_parallel_for((size_t)sim->ball_count, INTEGRATE_GRAIN,
+                      integrate_balls, &integrate_ctx);
+  OX_PROFILE_END();
+}
+
+static void simulation_build_grid(simulation_t* sim)
+{
+  OX_PROFILE_BEGIN("grid");
+  gather_ctx_t gather_ctx = {
+    .positions = sim->positions,
+    .directions = sim->directions,
+    .colors = sim->colors,
+  };
+  if (sim->reorder_balls) {
+    gather_ctx.sorted_positions = sim->sorted_positions;
+    gather_ctx.sorted_directions = sim->sorted_directions;
+    gather_ctx.sorted_colors = sim->sorted_colors;
+  }
+  grid_rebuild(&sim->grid, &gather_ctx);
+
+  if (sim->reorder_balls) {
+    Vector2* positions = sim->positions;
+    sim->positions = sim->sorted_positions;
+    sim->sorted_positions = positions;
+
+    Vector2* directions = sim->directions;
+    sim->directions = sim->sorted_directions;
+    sim->sorted_directions = directions;
+
+    Color* colors = sim->colors;
+    sim->colors = sim->sorted_colors;
+    sim->sorted_colors = colors;
+  }
+  OX_PROFILE_END();
+}
+
+static void simulation_collide(simulation_t* sim)
+{
+  OX_PROFILE_BEGIN("collide");
+  collide_grid(&sim->grid, sim->positions, sim->directions, sim->ball_radius);
+  OX_PROFILE_END();
+}
+
+// Queues the balls and, on a layer above them, the grid lines
+static void simulation_draw(const simulation_t* sim)
+{
+  ox_render_set_layer(0);
+  for (int i = 0; i < sim->ball_count; ++i) {
+    ox_render_push_circle(sim->positions[i], sim->ball_radius, sim->colors[i]);
+  }
+
+  ox_render_set_layer(1);
+  for (int x = 0; x <= (int)sim->width; x += GRID_SIZE) {
+    ox_render_push_line((Vector2){ (float)x, 0.f },
+                        (Vector2){ (float)x, sim->height }, DARKGRAY);
+  }
+
+  for (int y = 0; y <= (int)sim->height; y += GRID_SIZE) {
+    ox_render_push_line((Vector2){ 0.f, (float)y },
+                        (Vector2){ sim->width, (float)y }, DARKGRAY);
+  }
+
+  ox_render_set_layer(0);
+}
+
+static int compare_samples(const void* a, const void* b)
+{
+  const uint64_t lhs = *(const uint64_t*)a;
+  const uint64_t rhs = *(const uint64_t*)b;
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+// Nearest-rank percentile of sorted samples
+static uint64_t percentile(const uint64_t* sorted, const size_t count,
+                           const double fraction)
+{
+  size_t rank = (size_t)ceil(fraction * (double)count);
+  rank = rank < 1 ? 1 : (rank > count ? count : rank);
+  return sorted[rank - 1];
+}
+
+// FNV-1a over the final positions, equal runs give equal checksums
+static uint64_t simulation_checksum(const simulation_t* sim)
+{
+  const unsigned char* bytes = (const unsigned char*)sim->positions;
+  uint64_t hash = 0xCBF29CE484222325ull;
+  for (size_t i = 0; i < sizeof(Vector2) * (size_t)sim->ball_count; ++i) {
+    hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+  }
+  return hash;
+}
+
+static void write_report(FILE* output, const options_t* options,
+                         const simulation_t* sim, uint64_t* samples)
+{
+  const size_t frames = (size_t)options->frames;
+
+  ox_render_stats_t render;
+  ox_render_get_stats(&render);
+
+  (void)fprintf(output, "{\n");
+  (void)fprintf(output, "  \"balls\": %d,\n", options->ball_count);
+  (void)fprintf(output, "  \"frames\": %d,\n", options->frames);
+  (void)fprintf(output, "  \"delta_time\": %.9g,\n", options->delta_time);
+  (void)fprintf(output, "  \"seed\": %llu,\n",
+                (unsigned long long)options->seed);
+  (void)fprintf(output, "  \"threads\": %zu,\n", ox_job_thread_count());
+  (void)fprintf(output, "  \"checksum\": \"%016llx\",\n",
+                (unsigned long long)simulation_checksum(sim));
+  (void)fprintf(output,
+                "  \"render\": { \"commands\": %zu, \"batches\": %zu, "
+                "\"vertices\": %zu },\n",
+                render.commands, render.batches, render.vertices);
+
+  // Exit times aren't known yet, --startup-report prints them
+  (void)fprintf(output, "  \"startup\": { \"total_ns\": %llu, \"systems\": {",
+                (unsigned long long)systems_startup_ns);
+  const char* separator = "";
+  for (int i = 0; i < SYSTEM_COUNT; ++i) {
+    if (system_states[i].started) {
+      (void)fprintf(output, "%s\n    \"%s\": { \"init_ns\": %llu, "
+                    "\"thread\": \"%s\" }",
+                    separator, subsystems[i].name,
+                    (unsigned long long)system_states[i].init_ns,
+                    system_states[i].on_worker ? "worker" : "main");
+      separator = ",";
+    }
+  }
+  (void)fprintf(output, "\n  } },\n");
+  (void)fprintf(output, "  \"stages\": {\n");
+
+  for (int stage = 0; stage < STAGE_COUNT; ++stage) {
+    uint64_t* sorted = &samples[(size_t)stage * frames];
+    qsort(sorted, frames, sizeof(uint64_t), compare_samples);
+    (void)fprintf(output,
+                  "    \"%s\": { \"min_ns\": %llu, \"median_ns\": %llu, "
+                  "\"p99_ns\": %llu }%s\n",
+                  stage_names[stage], (unsigned long long)sorted[0],
+                  (unsigned long long)percentile(sorted, frames, 0.5),
+                  (unsigned long long)percentile(sorted, frames, 0.99),
+                  stage + 1 < STAGE_COUNT ? "," : "");
+  }
+
+  (void)fprintf(output, "  }\n}\n");
+}
+
+// Steps a fixed delta time for the requested number of frames and reports
+// min, median and p99 of every stage as JSON. Frames are drawn into the
+// render queue, which stays on the null backend without a window.
+static long run_headless(simulation_t* sim, const options_t* options)
+{
+  const size_t frames = (size_t)options->frames;
+  uint64_t* samples = ox_mem_acquire(sizeof(uint64_t) * frames * STAGE_COUNT,
+                                     OX_SOURCE_LOCATION);
+  if (!samples) {
+    return OX_FAILURE;
+  }
+
+  for (size_t frame = 0; frame < frames; ++frame) {
+    const uint64_t start = ox_time_ns();
+    simulation_integrate(sim, options->delta_time);
+    const uint64_t integrated = ox_time_ns();
+    simulation_build_grid(sim);
+    const uint64_t built = ox_time_ns();
+    simulation_collide(sim);
+    const uint64_t collided = ox_time_ns();
+    simulation_draw(sim);
+    ox_render_flush();
+    const uint64_t rendered = ox_time_ns();
+
+    samples[STAGE_INTEGRATE * frames + frame] = integrated - start;
+    samples[STAGE_GRID * frames + frame] = built - integrated;
+    samples[STAGE_COLLIDE * frames + frame] = collided - built;
+    samples[STAGE_RENDER * frames + frame] = rendered - collided;
+    samples[STAGE_FRAME * frames + frame] = rendered - start;
+
+    ox_frame_end();
+    OX_PROFILE_FRAME();
+  }
+
+  FILE* output = stdout;
+  if (options->report_path) {
+    output = fopen(options->report_path, "w");
+    if (!output) {
+      OX_LOG_ERR("Failed to create '%s'", options->report_path);
+      ox_mem_release(samples);
+      return OX_FAILURE;
+    }
+  }
+
+  write_report(output, options, sim, samples);
+
+  if (output != stdout) {
+    fclose(output);
+  } else {
+    fflush(stdout);
+  }
+
+  ox_mem_release(samples);
+  return OX_SUCCESS;
+}
+
+#ifdef OX_PROFILE_ENABLED
+
+// Time spent in zones of one name during each of the last frames, summed
+// over all threads
+typedef struct {
+  const char* name;
+  uint64_t totals[PROFILE_HISTORY];
+} profile_stat_t;
+
+typedef struct {
+  ox_profile_zone_t* zones; // Zones of 'frame', sorted by ox_profile_collect
+  size_t zone_count;
+  ox_profile_frame_t frame;
+  bool has_frame;
+  size_t history; // Frames folded into the stats so far
+  profile_stat_t stats[PROFILE_STATS];
+  size_t stat_count;
+} profile_view_t;
+
+static profile_stat_t* profile_find_stat(profile_view_t* view,
+                                         const char* name)
+{
+  for (size_t i = 0; i < view->stat_count; ++i) {
+    if (strcmp(view->stats[i].name, name) == 0) {
+      return &view->stats[i];
+    }
+  }
+
+  if (view->stat_count == PROFILE_STATS) {
+    return NULL;
+  }
+
+  profile_stat_t* stat = &view->stats[view->stat_count++];
+  memset(stat, 0, sizeof(*stat));
+  stat->name = name;
+  return stat;
+}
+
+// Takes over the last closed frame and folds its zones into the stats
+static void profile_view_update(profile_view_t* view)
+{
+  ox_profile_frame_t frame;
+  if (!ox_profile_get_frame(0, &frame) ||
+      (view->has_frame && frame.index == view->frame.index)) {
+    return;
+  }
+
+  view->frame = frame;
+  view->has_frame = true;
+  view->zone_count =
+    ox_profile_collect(frame.start, frame.end, view->zones, PROFILE_ZONES);
+
+  const size_t slot = frame.index % PROFILE_HISTORY;
+  for (size_t i = 0; i < view->stat_count; ++i) {
+    view->stats[i].totals[slot] = 0;
+  }
+
+  for (size_t i = 0; i < view->zone_count; ++i) {
+    const ox_profile_zone_t* zone = &view->zones[i];
+    profile_stat_t* stat = profile_find_stat(view, zone->name);
+    if (stat) {
+      stat->totals[slot] += zone->end - zone->start;
+    }
+  }
+
+  if (view->history < PROFILE_HISTORY) {
+    ++view->history;
+  }
+}
+
+// FNV-1a of the name, a zone keeps its color from frame to frame
+static struct nk_color profile_zone_color(const char* name)
+{
+  uint32_t hash = 0x811C9DC5u;
+  for (const char* c = name; *c; ++c) {
+    hash = (hash ^ (unsigned char)*c) * 0x01000193u;
+  }
+  return nk_rgb(96 + (int)(hash & 0x7F), 96 + (int)((hash >> 8) & 0x7F),
+                96 + (int)((hash >> 16) & 0x7F));
+}
+
+// One lane per thread and depth, time runs left to right over the frame
+static void profile_draw_flame_graph(struct nk_context* ctx,
+                                     const profile_view_t* view)
+{
+  int lane_base[OX_PROFILE_THREADS_MAX] = { 0 };
+  int lanes = 0;
+  for (size_t i = 0; i < view->zone_count;) {
+    const uint16_t thread = view->zones[i].thread;
+    int depth = 0;
+    for (; i < view->zone_count && view->zones[i].thread == thread; ++i) {
+      depth = view->zones[i].depth > depth ? view->zones[i].depth : depth;
+    }
+    lane_base[thread] = lanes;
+    lanes += depth + 1;
+  }
+
+  nk_layout_row_dynamic(ctx, (float)(lanes * PROFILE_LANE_HEIGHT), 1);
+  struct nk_rect bounds;
+  if (lanes == 0 || nk_widget(&bounds, ctx) == NK_WIDGET_INVALID) {
+    return;
+  }
+
+  struct nk_command_buffer* canvas = nk_window_get_canvas(ctx);
+  const uint64_t duration = view->frame.end - view->frame.start;
+  const double scale = duration ? bounds.w / (double)duration : 0.0;
+
+  for (size_t i = 0; i < view->zone_count; ++i) {
+    const ox_profile_zone_t* zone = &view->zones[i];
+    const uint64_t end = zone->end < view->frame.end ? zone->end
+                                                     : view->frame.end;
+    const int lane = lane_base[zone->thread] + zone->depth;
+    struct nk_rect rect = nk_rect(
+      bounds.x + (float)((double)(zone->start - view->frame.start) * scale),
+      bounds.y + (float)(lane * PROFILE_LANE_HEIGHT),
+      (float)((double)(end - zone->start) * scale),
+      (float)(PROFILE_LANE_HEIGHT - 1));
+    rect.w = rect.w < 1.f ? 1.f : rect.w;
+
+    const struct nk_color color = profile_zone_color(zone->name);
+    nk_fill_rect(canvas, rect, 0.f, color);
+    if (rect.w > 40.f) {
+      nk_draw_text(canvas, rect, zone->name, (int)strlen(zone->name),
+                   ctx->style.font, color, nk_rgb(0, 0, 0));
+    }
+  }
+}
+
+static void profile_draw_tree(struct nk_context* ctx,
+                              const profile_view_t* view)
+{
+  nk_layout_row_dynamic(ctx, 240, 1);
+  if (!nk_group_begin(ctx, "Zones", NK_WINDOW_BORDER)) {
+    return;
+  }
+
+  nk_layout_row_dynamic(ctx, 16, 1);
+  int thread = -1;
+  for (size_t i = 0; i < view->zone_count; ++i) {
+    const ox_profile_zone_t* zone = &view->zones[i];
+    if (zone->thread != thread) {
+      thread = zone->thread;
+      nk_label(ctx, TextFormat("Thread %d", thread), NK_TEXT_LEFT);
+    }
+    nk_label(ctx,
+             TextFormat("%*s%s  %.3f ms", (zone->depth + 1) * 2, "",
+                        zone->name, (double)(zone->end - zone->start) * 1e-6),
+             NK_TEXT_LEFT);
+  }
+
+  nk_group_end(ctx);
+}
+
+static void profile_draw_stats(struct nk_context* ctx,
+                               const profile_view_t* view)
+{
+  nk_layout_row_dynamic(ctx, 16, 4);
+  nk_label(ctx, "Zone", NK_TEXT_LEFT);
+  nk_label(ctx, "Avg ms", NK_TEXT_RIGHT);
+  nk_label(ctx, "Min ms", NK_TEXT_RIGHT);
+  nk_label(ctx, "Max ms", NK_TEXT_RIGHT);
+
+  for (size_t i = 0; i < view->stat_count; ++i) {
+    const profile_stat_t* stat = &view->stats[i];
+    uint64_t sum = 0;
+    uint64_t min = UINT64_MAX;
+    uint64_t max = 0;
+    for (size_t age = 0; age < view->history; ++age) {
+      const uint64_t total =
+        stat->totals[(view->frame.index - age) % PROFILE_HISTORY];
+      sum += total;
+      min = total < min ? total : min;
+      max = total > max ? total : max;
+    }
+
+    nk_label(ctx, stat->name, NK_TEXT_LEFT);
+    nk_label(ctx, TextFormat("%.3f", (double)sum * 1e-6 / view->history),
+             NK_TEXT_RIGHT);
+    nk_label(ctx, TextFormat("%.3f", (double)min * 1e-6), NK_TEXT_RIGHT);
+    nk_label(ctx, TextFormat("%.3f", (double)max * 1e-6), NK_TEXT_RIGHT);
+  }
+}
+
+static void profile_draw_window(struct nk_context* ctx, profile_view_t* view)
+{
+  profile_view_update(view);
+
+  if (nk_begin(ctx, "Profiler", nk_rect(1280, 40, 600, 720),
+               NK_WINDOW_BORDER | NK_WINDOW_MOVABLE | NK_WINDOW_SCALABLE |
+                 NK_WINDOW_MINIMIZABLE | NK_WINDOW_TITLE) &&
+      view->has_frame) {
+    nk_layout_row_dynamic(ctx, 16, 1);
+    nk_label(ctx,
+             TextFormat("Frame %llu: %.3f ms, %zu zones",
+                        (unsigned long long)view->frame.index,
+                        (double)(view->frame.end - view->frame.start) * 1e-6,
+                        view->zone_count),
+             NK_TEXT_LEFT);
+
+    if (nk_tree_push(ctx, NK_TREE_TAB, "Flame graph", NK_MAXIMIZED)) {
+      profile_draw_flame_graph(ctx, view);
+      nk_tree_pop(ctx);
+    }
+
+    if (nk_tree_push(ctx, NK_TREE_TAB, "Zones", NK_MAXIMIZED)) {
+      profile_draw_tree(ctx, view);
+      nk_tree_pop(ctx);
+    }
+
+    if (nk_tree_push(ctx, NK_TREE_TAB, "Stats", NK_MAXIMIZED)) {
+      profile_draw_stats(ctx, view);
+      nk_tree_pop(ctx);
+    }
+  }
+  nk_end(ctx);
+}
+
+#endif
+
+static void run_window(simulation_t* sim)
+{
+  struct nk_context* ctx = InitNuklearEx(ox_render_get_current_font(),
+                                         (float)ox_render_get_font_size());
+
+#ifdef OX_PROFILE_ENABLED
+  static profile_view_t profile_view;
+  profile_view.zones = ox_mem_acquire(
+    sizeof(ox_profile_zone_t) * PROFILE_ZONES, OX_SOURCE_LOCATION);
+#endif
+
+  int fps = -1;
+  char fps_text[32];
+
   while (!WindowShouldClose()) {
+    ox_render_update();
     UpdateNuklear(ctx);
 
     if (nk_begin(ctx, "Nuklear 1", nk_rect(100, 100, 220, 220),
@@ -219,116 +1321,173 @@ int main(void)
     }
     nk_end(ctx);
 
-    const float delta_time = GetFrameTime();
-
-    // Update ball positions
-    for (int i = 0; i < number_of_balls; ++i) {
-      ball_positions[i].x += ball_directions[i].x * delta_time;
-      ball_positions[i].y += ball_directions[i].y * delta_time;
-      wrap_position(&ball_positions[i], (float)GetScreenWidth(),
-                    (float)GetScreenHeight());
-    }
-
-    // Clear grid
-    for (int i = 0; i < total_cells; ++i) {
-      grid[i].count = 0;
+#ifdef OX_PROFILE_ENABLED
+    if (profile_view.zones) {
+      OX_PROFILE_BEGIN("profiler");
+      profile_draw_window(ctx, &profile_view);
+      OX_PROFILE_END();
     }
+#endif
 
-    // Populate grid with balls
-    for (int i = 0; i < number_of_balls; ++i) {
-      int grid_x = (int)(ball_positions[i].x / GRID_SIZE);
-      int grid_y = (int)(ball_positions[i].y / GRID_SIZE);
-
-      // Clamp to grid bounds
-      grid_x =
-        grid_x < 0 ? 0 : (grid_x >= grid_width ? grid_width - 1 : grid_x);
-      grid_y =
-        grid_y < 0 ? 0 : (grid_y >= grid_height ? grid_height - 1 : grid_y);
+    // Update ball positions
+    simulation_integrate(sim, GetFrameTime());
 
-      const int cell_index = grid_y * grid_width + grid_x;
-      add_ball_to_cell(&grid[cell_index], i);
-    }
+    // Sort the balls into the grid
+    simulation_build_grid(sim);
 
     // Check collisions using spatial partitioning
-    for (int cell_y = 0; cell_y < grid_height; ++cell_y) {
-      for (int cell_x = 0; cell_x < grid_width; ++cell_x) {
-        const int current_cell = cell_y * grid_width + cell_x;
-
-        // Check collisions within current cell
-        if (grid[current_cell].count > 1) {
-          check_collisions_in_cells(&grid[current_cell], &grid[current_cell],
-                                    ball_positions, ball_directions,
-                                    ball_radius, true);
-        }
-
-        // Check collisions with adjacent cells (right and down to avoid duplicates)
-        // Check right cell
-        if (cell_x + 1 < grid_width) {
-          const int right_cell = cell_y * grid_width + (cell_x + 1);
-          if (grid[current_cell].count > 0 && grid[right_cell].count > 0) {
-            check_collisions_in_cells(&grid[current_cell], &grid[right_cell],
-                                      ball_positions, ball_directions,
-                                      ball_radius, false);
-          }
-        }
-
-        // Check down cell
-        if (cell_y + 1 < grid_height) {
-          const int down_cell = (cell_y + 1) * grid_width + cell_x;
-          if (grid[current_cell].count > 0 && grid[down_cell].count > 0) {
-            check_collisions_in_cells(&grid[current_cell], &grid[down_cell],
-                                      ball_positions, ball_directions,
-                                      ball_radius, false);
-          }
-        }
-
-        // Check down-right cell (diagonal)
-        if (cell_x + 1 < grid_width && cell_y + 1 < grid_height) {
-          const int down_right_cell = (cell_y + 1) * grid_width + (cell_x + 1);
-          if (grid[current_cell].count > 0 && grid[down_right_cell].count > 0) {
-            check_collisions_in_cells(&grid[current_cell],
-                                      &grid[down_right_cell], ball_positions,
-                                      ball_directions, ball_radius, false);
-          }
-        }
-      }
-    }
+    simulation_collide(sim);
 
     // Render
+    OX_PROFILE_BEGIN("draw");
     BeginDrawing();
     ClearBackground(BLACK);
 
-    for (int i = 0; i < number_of_balls; ++i) {
-      DrawCircleV(ball_positions[i], ball_radius, ball_colors[i]);
+    simulation_draw(sim);
+    ox_render_flush();
+
+    // Formatted again only when the value changes, the layout cache redoes
+    // just the digits that differ
+    if (GetFPS() != fps) {
+      fps = GetFPS();
+      (void)snprintf(fps_text, sizeof(fps_text), "FPS: %d", fps);
     }
+    ox_render_draw_text(fps_text, 10, 10, 20, WHITE);
+
+    DrawNuklear(ctx);
+    EndDrawing();
+    OX_PROFILE_END();
+
+    ox_frame_end();
+    OX_PROFILE_FRAME();
+  }
 
-    // Optional: Draw grid for debugging
-    for (int x = 0; x <= GetScreenWidth(); x += GRID_SIZE) {
-      DrawLine(x, 0, x, GetScreenHeight(), DARKGRAY);
+  DrawNuklear(ctx);
+
+#ifdef OX_PROFILE_ENABLED
+  ox_mem_release(profile_view.zones);
+#endif
+}
+
+static void print_usage(const char* program)
+{
+  (void)fprintf(stderr,
+                "Usage: %s [--headless] [--balls N] [--frames N] [--dt S]\n"
+                "          [--seed N] [--report PATH] [--trace PATH]\n"
+                "          [--startup-report]\n",
+                program);
+}
+
+static long parse_options(const int argc, char* argv[], options_t* options)
+{
+  *options = (options_t){
+    .ball_count = NUMBER_OF_BALLS,
+    .frames = HEADLESS_FRAMES,
+    .delta_time = HEADLESS_DELTA_TIME,
+  };
+
+  for (int i = 1; i < argc; ++i) {
+    const char* arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+
+    if (strcmp(arg, "--headless") == 0) {
+      options->headless = true;
+      continue;
     }
 
-    for (int y = 0; y <= GetScreenHeight(); y += GRID_SIZE) {
-      DrawLine(0, y, GetScreenWidth(), y, DARKGRAY);
+    if (strcmp(arg, "--startup-report") == 0) {
+      options->startup_report = true;
+      continue;
     }
 
-    ox_render_draw_text(TextFormat("FPS: %d", GetFPS()), 10, 10, 20, WHITE);
+    if (!value) {
+      print_usage(argv[0]);
+      return OX_FAILURE;
+    }
 
-    DrawNuklear(ctx);
-    EndDrawing();
+    if (strcmp(arg, "--balls") == 0) {
+      options->ball_count = atoi(value);
+    } else if (strcmp(arg, "--frames") == 0) {
+      options->frames = atoi(value);
+    } else if (strcmp(arg, "--dt") == 0) {
+      options->delta_time = strtof(value, NULL);
+    } else if (strcmp(arg, "--seed") == 0) {
+      options->seed = strtoull(value, NULL, 10);
+      options->seeded = true;
+    } else if (strcmp(arg, "--report") == 0) {
+      options->report_path = value;
+    } else if (strcmp(arg, "--trace") == 0) {
+#ifdef OX_PROFILE_ENABLED
+      options->trace_path = value;
+#else
+      (void)fprintf(stderr, "--trace needs a build with the profiler\n");
+      return OX_FAILURE;
+#endif
+    } else {
+      print_usage(argv[0]);
+      return OX_FAILURE;
+    }
+    ++i;
   }
 
-  DrawNuklear(ctx);
+  if (options->ball_count <= 0 || options->frames <= 0 ||
+      !(options->delta_time > 0.f)) {
+    print_usage(argv[0]);
+    return OX_FAILURE;
+  }
 
-  // Cleanup
-  for (int i = 0; i < total_cells; ++i) {
-    ox_mem_release(grid[i].ball_indices);
+  // A benchmark must be reproducible, an interactive run may differ
+  if (!options->seeded) {
+    options->seed = options->headless ? 1 : (uint64_t)time(NULL);
+  }
+
+  return OX_SUCCESS;
+}
+
+int main(const int argc, char* argv[])
+{
+  options_t options;
+  if (parse_options(argc, argv, &options) != OX_SUCCESS) {
+    return OX_FAILURE;
+  }
+
+  const long ret_code = systems_init(options.headless);
+  if (ret_code != OX_SUCCESS) {
+    return (int)ret_code;
   }
 
-  ox_mem_release(grid);
-  ox_mem_release(ball_positions);
-  ox_mem_release(ball_directions);
-  ox_mem_release(ball_colors);
+  const float width =
+    options.headless ? HEADLESS_WIDTH : (float)GetScreenWidth();
+  const float height =
+    options.headless ? HEADLESS_HEIGHT : (float)GetScreenHeight();
+
+  simulation_t sim;
+  if (simulation_init(&sim, options.ball_count, width, height,
+                      options.seed) != OX_SUCCESS) {
+    OX_LOG_ERR("Failed to allocate %d balls", options.ball_count);
+    systems_exit();
+    return OX_FAILURE;
+  }
+
+  long result = OX_SUCCESS;
+  if (options.headless) {
+    result = run_headless(&sim, &options);
+  } else {
+    run_window(&sim);
+  }
+
+  // The rings only keep the most recent zones of every thread
+  if (options.trace_path &&
+      ox_profile_write_chrome_trace(options.trace_path) != OX_SUCCESS) {
+    result = OX_FAILURE;
+  }
+
+  // Cleanup
+  simulation_free(&sim);
 
   systems_exit();
-  return 0;
-}
\ No newline at end of file
+  if (options.startup_report) {
+    systems_report(stderr);
+  }
+  return (int)result;
+}
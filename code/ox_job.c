@@ -0,0 +1,334 @@
+#include "ox_job.h"
+
+#include "ox_core.h"
+#include "ox_log.h"
+#include "ox_memory.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+typedef struct {
+  ox_job_fn fn;
+  void* data;
+  size_t begin;
+  size_t end;
+  ox_job_counter_t* counter;
+} ox_job_t;
+
+#define OX_JOB_CACHE_LINE 64
+
+// Chase-Lev deque, only the owning thread writes 'bottom' and 'jobs'.
+// Jobs are stored by value at their queue position: a position is only
+// rewritten once the queue has wrapped past it, by then its job was taken.
+// Padding keeps top and bottom on separate cache lines whatever the base
+// alignment of the allocation is.
+typedef struct {
+  atomic_size_t top;
+  char top_padding[OX_JOB_CACHE_LINE];
+  atomic_size_t bottom;
+  char bottom_padding[OX_JOB_CACHE_LINE];
+  ox_job_t jobs[OX_JOB_QUEUE_SIZE];
+} ox_job_deque_t;
+
+static ox_job_deque_t* job_deques;
+static size_t job_thread_count;
+static thrd_t job_workers[OX_JOB_WORKERS_MAX];
+static size_t job_worker_count;
+static atomic_bool job_stop;
+
+// Jobs sitting in some deque, idle workers sleep while this is zero
+static atomic_size_t job_queued;
+static atomic_size_t job_sleepers;
+static mtx_t job_mtx;
+static cnd_t job_cnd;
+
+static thread_local int job_thread_index = -1;
+
+static size_t ox_job_hardware_threads(void)
+{
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors;
+#else
+  const long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (size_t)count : 1;
+#endif
+}
+
+static bool ox_job_deque_push(ox_job_deque_t* deque, const ox_job_t* job)
+{
+  const size_t bottom =
+    atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+  const size_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+  if (bottom - top >= OX_JOB_QUEUE_SIZE) {
+    return false;
+  }
+
+  deque->jobs[bottom % OX_JOB_QUEUE_SIZE] = *job;
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+  return true;
+}
+
+static bool ox_job_deque_pop(ox_job_deque_t* deque, ox_job_t* job)
+{
+  const size_t bottom =
+    atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+  atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  size_t top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+  // Indices only grow, compare through the signed distance
+  if ((ptrdiff_t)(bottom - top) < 0) {
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    return false;
+  }
+
+  *job = deque->jobs[bottom % OX_JOB_QUEUE_SIZE];
+
+  if (bottom != top) {
+    return true;
+  }
+
+  // Last job, race the thieves for it
+  const bool won = atomic_compare_exchange_strong_explicit(
+    &deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed);
+  atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+  return won;
+}
+
+static bool ox_job_deque_steal(ox_job_deque_t* deque, ox_job_t* job)
+{
+  size_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  const size_t bottom =
+    atomic_load_explicit(&deque->bottom, memory_order_acquire);
+
+  if ((ptrdiff_t)(bottom - top) <= 0) {
+    return false;
+  }
+
+  // The copy may race with the owner refilling this position, in which case
+  // top has moved on and the exchange below discards it
+  const ox_job_t copy = deque->jobs[top % OX_JOB_QUEUE_SIZE];
+
+  if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                               memory_order_seq_cst,
+                                               memory_order_relaxed)) {
+    return false;
+  }
+
+  *job = copy;
+  return true;
+}
+
+static void ox_job_execute(const ox_job_t* job)
+{
+  job->fn(job->data, job->begin, job->end);
+  atomic_fetch_sub_explicit(&job->counter->pending, 1, memory_order_release);
+}
+
+// Pops from the own deque first, then tries every other deque once
+static bool ox_job_take(const int index, ox_job_t* job)
+{
+  if (ox_job_deque_pop(&job_deques[index], job)) {
+    atomic_fetch_sub(&job_queued, 1);
+    return true;
+  }
+
+  for (size_t i = 1; i < job_thread_count; ++i) {
+    const size_t victim = ((size_t)index + i) % job_thread_count;
+    if (ox_job_deque_steal(&job_deques[victim], job)) {
+      atomic_fetch_sub(&job_queued, 1);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static int ox_job_worker(void* arg)
+{
+  job_thread_index = (int)(size_t)arg;
+
+  while (!atomic_load(&job_stop)) {
+    ox_job_t job;
+    if (ox_job_take(job_thread_index, &job)) {
+      ox_job_execute(&job);
+      continue;
+    }
+
+    mtx_lock(&job_mtx);
+    atomic_fetch_add(&job_sleepers, 1);
+    while (atomic_load(&job_queued) == 0 && !atomic_load(&job_stop)) {
+      cnd_wait(&job_cnd, &job_mtx);
+    }
+    atomic_fetch_sub(&job_sleepers, 1);
+    mtx_unlock(&job_mtx);
+  }
+
+  return 0;
+}
+
+long ox_job_init(void)
+{
+  size_t count = ox_job_hardware_threads();
+
+  // OX_JOB_THREADS overrides the detected count, mostly for benchmarks
+  const char* threads = getenv("OX_JOB_THREADS");
+  if (threads && atoi(threads) > 0) {
+    count = (size_t)atoi(threads);
+  }
+
+  if (count > OX_JOB_WORKERS_MAX + 1) {
+    count = OX_JOB_WORKERS_MAX + 1;
+  }
+
+  job_deques = ox_mem_acquire(sizeof(ox_job_deque_t) * count,
+                              OX_SOURCE_LOCATION);
+  if (!job_deques) {
+    return OX_FAILURE;
+  }
+  memset(job_deques, 0, sizeof(ox_job_deque_t) * count);
+
+  if (mtx_init(&job_mtx, mtx_plain) != thrd_success) {
+    ox_mem_release(job_deques);
+    return OX_FAILURE;
+  }
+
+  if (cnd_init(&job_cnd) != thrd_success) {
+    mtx_destroy(&job_mtx);
+    ox_mem_release(job_deques);
+    return OX_FAILURE;
+  }
+
+  atomic_store(&job_stop, false);
+  atomic_store(&job_queued, 0);
+  atomic_store(&job_sleepers, 0);
+  job_thread_index = 0;
+  job_thread_count = count;
+  job_worker_count = 0;
+
+  // A worker that fails to start leaves an empty deque behind, which thieves
+  // skip over, so the thread count is fixed before any worker runs
+  for (size_t i = 1; i < count; ++i) {
+    thrd_t* worker = &job_workers[job_worker_count];
+    if (thrd_create(worker, ox_job_worker, (void*)i) != thrd_success) {
+      OX_LOG_ERR("Failed to start job worker %u", (unsigned)i);
+      continue;
+    }
+    job_worker_count++;
+  }
+
+  OX_LOG_DBG("Job system started with %u workers",
+             (unsigned)job_worker_count);
+  return OX_SUCCESS;
+}
+
+void ox_job_exit(void)
+{
+  mtx_lock(&job_mtx);
+  atomic_store(&job_stop, true);
+  cnd_broadcast(&job_cnd);
+  mtx_unlock(&job_mtx);
+
+  for (size_t i = 0; i < job_worker_count; ++i) {
+    thrd_join(job_workers[i], NULL);
+  }
+  job_worker_count = 0;
+
+  cnd_destroy(&job_cnd);
+  mtx_destroy(&job_mtx);
+  ox_mem_release(job_deques);
+  job_deques = NULL;
+  job_thread_count = 0;
+  job_thread_index = -1;
+}
+
+size_t ox_job_thread_count(void)
+{
+  return job_thread_count;
+}
+
+int ox_job_thread_index(void)
+{
+  return job_thread_index;
+}
+
+void ox_job_counter_init(ox_job_counter_t* counter)
+{
+  atomic_init(&counter->pending, 0);
+}
+
+void ox_job_submit(const ox_job_fn fn, void* data, const size_t begin,
+                   const size_t end, ox_job_counter_t* counter)
+{
+  const ox_job_t job = {
+    .fn = fn, .data = data, .begin = begin, .end = end, .counter = counter
+  };
+  atomic_fetch_add_explicit(&counter->pending, 1, memory_order_relaxed);
+
+  // Counted before the push so a thief never takes an uncounted job
+  atomic_fetch_add(&job_queued, 1);
+  if (job_thread_index < 0 ||
+      !ox_job_deque_push(&job_deques[job_thread_index], &job)) {
+    atomic_fetch_sub(&job_queued, 1);
+    ox_job_execute(&job);
+    return;
+  }
+
+  if (atomic_load(&job_sleepers) != 0) {
+    mtx_lock(&job_mtx);
+    cnd_signal(&job_cnd);
+    mtx_unlock(&job_mtx);
+  }
+}
+
+void ox_job_wait(ox_job_counter_t* counter)
+{
+  while (atomic_load_explicit(&counter->pending, memory_order_acquire) != 0) {
+    ox_job_t job;
+    if (job_thread_index >= 0 && ox_job_take(job_thread_index, &job)) {
+      ox_job_execute(&job);
+    } else {
+      thrd_yield();
+    }
+  }
+}
+
+void ox_job_parallel_for(const size_t count, size_t grain, const ox_job_fn fn,
+                         void* data)
+{
+  if (grain == 0) {
+    grain = 1;
+  }
+
+  if (count <= grain || job_worker_count == 0) {
+    if (count != 0) {
+      fn(data, 0, count);
+    }
+    return;
+  }
+
+  ox_job_counter_t counter;
+  ox_job_counter_init(&counter);
+
+  // The caller keeps the first range for itself instead of queueing it
+  for (size_t begin = grain; begin < count; begin += grain) {
+    const size_t end = begin + grain < count ? begin + grain : count;
+    ox_job_submit(fn, data, begin, end, &counter);
+  }
+  fn(data, 0, grain);
+
+  ox_job_wait(&counter);
+}
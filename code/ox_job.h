@@ -0,0 +1,95 @@
+/**
+ * @file ox_job.h
+ * @brief Work-stealing job system
+ *
+ * Every job thread (the main thread and the workers) owns a Chase-Lev deque.
+ * Owners push and pop at the bottom, idle threads steal from the top of the
+ * others. Completion is tracked with counters: a thread waiting on a counter
+ * keeps executing jobs until it drops to zero.
+ */
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+#define OX_JOB_WORKERS_MAX 63
+#define OX_JOB_QUEUE_SIZE  4096
+
+/**
+ * @brief Job entry point, plain jobs receive begin == end == 0
+ */
+typedef void (*ox_job_fn)(void* data, size_t begin, size_t end);
+
+/**
+ * @brief Number of submitted jobs that have not finished yet
+ */
+typedef struct {
+  atomic_size_t pending;
+} ox_job_counter_t;
+
+/**
+ * @brief Start the worker threads
+ *
+ * The calling thread becomes job thread 0. One worker is started per
+ * additional hardware thread, the OX_JOB_THREADS environment variable
+ * overrides the total thread count.
+ *
+ * @return OX_SUCCESS or OX_FAILURE
+ */
+long ox_job_init(void);
+
+/**
+ * @brief Stop and join the worker threads
+ */
+void ox_job_exit(void);
+
+/**
+ * @brief Number of job threads including the main thread
+ */
+size_t ox_job_thread_count(void);
+
+/**
+ * @brief Index of the calling job thread, 0 for the main thread
+ * @return Thread index, or -1 if the caller is not a job thread
+ */
+int ox_job_thread_index(void);
+
+/**
+ * @brief Initialize a counter to zero
+ * @param counter Counter to initialize
+ */
+void ox_job_counter_init(ox_job_counter_t* counter);
+
+/**
+ * @brief Queue a job on the calling thread's deque
+ * @param fn Job entry point
+ * @param data Passed to fn
+ * @param begin Passed to fn
+ * @param end Passed to fn
+ * @param counter Incremented now and decremented when the job is done
+ *
+ * Callers outside the job system, and callers whose deque is full, run the
+ * job inline before returning.
+ */
+void ox_job_submit(ox_job_fn fn, void* data, size_t begin, size_t end,
+                   ox_job_counter_t* counter);
+
+/**
+ * @brief Execute queued jobs until the counter drops to zero
+ * @param counter Counter to wait for
+ */
+void ox_job_wait(ox_job_counter_t* counter);
+
+/**
+ * @brief Split [0, count) into ranges of at most 'grain' and run them
+ * @param count Number of indices
+ * @param grain Maximum range size per job
+ * @param fn Called with each [begin, end) range
+ * @param data Passed to fn
+ *
+ * Returns after every range has been processed. The calling thread takes
+ * part in the work.
+ */
+void ox_job_parallel_for(size_t count, size_t grain, ox_job_fn fn,
+                         void* data);
@@ -1,8 +1,78 @@
 #include "ox_log.h"
 
+#include "ox_core.h"
+#include "ox_time.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <threads.h>
 #include <time.h>
 
+#define OX_LOG_STRINGS_SIZE 192
+#define OX_LOG_LINE_SIZE    1024
+#define OX_LOG_BATCH_SIZE   (64 * 1024)
+#define OX_LOG_IDLE_MS      50
+#define OX_LOG_CALLSITES    4096
+
+static_assert((OX_LOG_QUEUE_SIZE & (OX_LOG_QUEUE_SIZE - 1)) == 0,
+              "OX_LOG_QUEUE_SIZE must be a power of two");
+
+// One queued log call. String arguments point into 'strings', everything
+// else is referenced by pointer to static storage (literals, __FILE__).
+typedef struct {
+  atomic_size_t sequence;
+  const char* level;
+  const char* file;
+  const char* func;
+  const char* format;
+  uint64_t time;
+  unsigned line;
+  unsigned arg_count;
+  ox_log_arg_t args[OX_LOG_ARGS_MAX];
+  char strings[OX_LOG_STRINGS_SIZE];
+} ox_log_record_t;
+
+// Bounded MPSC queue: a slot is free for the producer at position p when
+// its sequence equals p, and ready for the consumer when it equals p + 1
+static ox_log_record_t log_queue[OX_LOG_QUEUE_SIZE];
+static atomic_size_t log_enqueue;
+static size_t log_dequeue;
+
+static thrd_t log_thread;
+static mtx_t log_mtx;
+static cnd_t log_cnd;
+static atomic_bool log_running;
+static atomic_bool log_stop;
+static atomic_bool log_sleeping;
+
+static atomic_size_t log_written;
+static atomic_size_t log_dropped;
+static atomic_size_t log_blocked;
+static atomic_size_t log_truncated;
+
+// Maps the monotonic record time back to the wall clock
+static time_t log_wall_base;
+static uint64_t log_time_base;
+
+static char log_batch[OX_LOG_BATCH_SIZE];
+static size_t log_batch_used;
+
+// Binary sink, owned by the log thread once it runs
+typedef struct {
+  const char* file;
+  const char* format;
+  unsigned line;
+  uint32_t id;
+} ox_log_callsite_t;
+
+static FILE* log_binary;
+static ox_log_callsite_t log_callsites[OX_LOG_CALLSITES];
+static uint32_t log_next_callsite;
+
 void ox_timestamp(char* stamp, const size_t stamp_size)
 {
   const time_t now = time(NULL);
@@ -29,4 +99,622 @@ const char* ox_filename(const char* filename)
 #endif
 
   return filename;
-}
\ No newline at end of file
+}
+
+static long long ox_log_as_signed(const ox_log_arg_t* arg)
+{
+  switch (arg->type) {
+  case OX_LOG_ARG_INT:
+    return arg->i;
+  case OX_LOG_ARG_UINT:
+    return (long long)arg->u;
+  case OX_LOG_ARG_DOUBLE:
+    return (long long)arg->d;
+  case OX_LOG_ARG_PTR:
+    return (long long)(intptr_t)arg->p;
+  case OX_LOG_ARG_STR:
+    break;
+  }
+  return 0;
+}
+
+static double ox_log_as_double(const ox_log_arg_t* arg)
+{
+  switch (arg->type) {
+  case OX_LOG_ARG_INT:
+    return (double)arg->i;
+  case OX_LOG_ARG_UINT:
+    return (double)arg->u;
+  case OX_LOG_ARG_DOUBLE:
+    return arg->d;
+  case OX_LOG_ARG_PTR:
+  case OX_LOG_ARG_STR:
+    break;
+  }
+  return 0.0;
+}
+
+static const void* ox_log_as_pointer(const ox_log_arg_t* arg)
+{
+  switch (arg->type) {
+  case OX_LOG_ARG_PTR:
+    return arg->p;
+  case OX_LOG_ARG_STR:
+    return arg->s;
+  case OX_LOG_ARG_INT:
+  case OX_LOG_ARG_UINT:
+    return (const void*)(uintptr_t)arg->u;
+  case OX_LOG_ARG_DOUBLE:
+    break;
+  }
+  return NULL;
+}
+
+static void ox_log_append(const size_t size, size_t* used, const int written)
+{
+  if (written > 0) {
+    *used += (size_t)written;
+    if (*used >= size) {
+      *used = size - 1;
+    }
+  }
+}
+
+// Each conversion is handed to snprintf on its own, with the length
+// modifier rewritten to match the widened value that was stored
+size_t ox_log_format_message(char* out, const size_t size, const char* format,
+                             const ox_log_arg_t* args, const size_t arg_count)
+{
+  static const ox_log_arg_t missing = { .type = OX_LOG_ARG_STR,
+                                        .s = "<missing>" };
+  size_t used = 0;
+  size_t next = 0;
+  out[0] = '\0';
+
+  for (const char* c = format; *c && used + 1 < size;) {
+    if (*c != '%' || c[1] == '%') {
+      out[used++] = *c;
+      c += *c == '%' ? 2 : 1;
+      out[used] = '\0';
+      continue;
+    }
+
+    char spec[48];
+    size_t length = 0;
+    spec[length++] = *c++;
+
+    while (*c && strchr("-+ #0", *c) && length < 8) {
+      spec[length++] = *c++;
+    }
+
+    for (int part = 0; part < 2; ++part) {
+      if (part == 1) {
+        if (*c != '.') {
+          break;
+        }
+        spec[length++] = *c++;
+      }
+
+      if (*c == '*') {
+        const ox_log_arg_t* arg = next < arg_count ? &args[next++] : &missing;
+        length += (size_t)snprintf(&spec[length], 12, "%d",
+                                   (int)ox_log_as_signed(arg));
+        c++;
+      } else {
+        while (*c >= '0' && *c <= '9' && length < 32) {
+          spec[length++] = *c++;
+        }
+      }
+    }
+
+    while (*c && strchr("hlLqjzt", *c)) {
+      c++;
+    }
+
+    const char conversion = *c;
+    if (!conversion) {
+      break;
+    }
+    c++;
+
+    const ox_log_arg_t* arg = next < arg_count ? &args[next++] : &missing;
+    char* cursor = &out[used];
+    const size_t left = size - used;
+    int written = 0;
+
+    switch (arg == &missing ? 's' : conversion) {
+    case 'd':
+    case 'i':
+      memcpy(&spec[length], "lld", 4);
+      written = snprintf(cursor, left, spec, ox_log_as_signed(arg));
+      break;
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X':
+      memcpy(&spec[length], "ll", 2);
+      spec[length + 2] = conversion;
+      spec[length + 3] = '\0';
+      written = snprintf(cursor, left, spec,
+                         (unsigned long long)ox_log_as_signed(arg));
+      break;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+      spec[length] = conversion;
+      spec[length + 1] = '\0';
+      written = snprintf(cursor, left, spec, ox_log_as_double(arg));
+      break;
+    case 'c':
+      spec[length] = 'c';
+      spec[length + 1] = '\0';
+      written = snprintf(cursor, left, spec, (int)ox_log_as_signed(arg));
+      break;
+    case 's':
+      spec[length] = 's';
+      spec[length + 1] = '\0';
+      written = snprintf(cursor, left, arg == &missing ? "%s" : spec,
+                         arg->type == OX_LOG_ARG_STR ? arg->s : "<?>");
+      break;
+    case 'p':
+      spec[length] = 'p';
+      spec[length + 1] = '\0';
+      written = snprintf(cursor, left, spec, ox_log_as_pointer(arg));
+      break;
+    default:
+      // Unknown conversion, keep it visible instead of guessing the type
+      spec[length] = conversion;
+      spec[length + 1] = '\0';
+      written = snprintf(cursor, left, "%s", spec);
+      break;
+    }
+
+    ox_log_append(size, &used, written);
+  }
+
+  return used;
+}
+
+static size_t ox_log_format_record(char* out, const size_t size,
+                                   const ox_log_record_t* record,
+                                   const char* timestamp)
+{
+  size_t used = 0;
+  // Leaves room for the message terminator and the newline
+  ox_log_append(size - 1, &used,
+                snprintf(out, size - 1, OX_LOG_FORMAT, record->level,
+                         timestamp, record->file, record->line, record->func));
+  used += ox_log_format_message(&out[used], size - used - 1, record->format,
+                                record->args, record->arg_count);
+  out[used++] = '\n';
+  out[used] = '\0';
+  return used;
+}
+
+// Copies string arguments into the record so the caller's buffers may die
+static void ox_log_capture(ox_log_record_t* record, const char* level,
+                           const char* file, const unsigned line,
+                           const char* func, const char* format,
+                           const ox_log_arg_t* args, size_t arg_count)
+{
+  bool truncated = false;
+  if (arg_count > OX_LOG_ARGS_MAX) {
+    arg_count = OX_LOG_ARGS_MAX;
+    truncated = true;
+  }
+
+  record->level = level;
+  record->file = file;
+  record->line = line;
+  record->func = func;
+  record->format = format;
+  record->time = ox_time_ns();
+  record->arg_count = (unsigned)arg_count;
+
+  size_t used = 0;
+  for (size_t i = 0; i < arg_count; ++i) {
+    record->args[i] = args[i];
+    if (args[i].type != OX_LOG_ARG_STR) {
+      continue;
+    }
+
+    const char* text = args[i].s ? args[i].s : "(null)";
+    size_t length = strlen(text);
+    if (length + 1 > OX_LOG_STRINGS_SIZE - used) {
+      length = used < OX_LOG_STRINGS_SIZE ? OX_LOG_STRINGS_SIZE - used - 1 : 0;
+      truncated = true;
+    }
+
+    if (used >= OX_LOG_STRINGS_SIZE) {
+      record->args[i].s = "";
+      continue;
+    }
+
+    memcpy(&record->strings[used], text, length);
+    record->strings[used + length] = '\0';
+    record->args[i].s = &record->strings[used];
+    used += length + 1;
+  }
+
+  if (truncated) {
+    atomic_fetch_add_explicit(&log_truncated, 1, memory_order_relaxed);
+  }
+}
+
+static void ox_log_wall_timestamp(const uint64_t time_ns, char* stamp,
+                                  const size_t stamp_size)
+{
+  const time_t wall =
+    log_wall_base + (time_t)((time_ns - log_time_base) / 1000000000ull);
+  const struct tm* tm_info = localtime(&wall);
+  strftime(stamp, stamp_size, "%H:%M:%S", tm_info);
+}
+
+static void ox_log_flush(void)
+{
+  if (log_batch_used != 0) {
+    FILE* output = log_binary ? log_binary : stderr;
+    fwrite(log_batch, 1, log_batch_used, output);
+    fflush(output);
+    log_batch_used = 0;
+  }
+}
+
+static void ox_log_emit(const void* data, const size_t size)
+{
+  if (log_batch_used + size > sizeof(log_batch)) {
+    ox_log_flush();
+  }
+
+  if (size > sizeof(log_batch)) {
+    fwrite(data, 1, size, log_binary ? log_binary : stderr);
+    return;
+  }
+
+  memcpy(&log_batch[log_batch_used], data, size);
+  log_batch_used += size;
+}
+
+static void ox_log_emit_u8(const uint8_t value)
+{
+  ox_log_emit(&value, sizeof(value));
+}
+
+static void ox_log_emit_u32(const uint32_t value)
+{
+  ox_log_emit(&value, sizeof(value));
+}
+
+static void ox_log_emit_string(const char* text)
+{
+  size_t length = strlen(text);
+  if (length > UINT16_MAX) {
+    length = UINT16_MAX;
+  }
+  const uint16_t prefix = (uint16_t)length;
+  ox_log_emit(&prefix, sizeof(prefix));
+  ox_log_emit(text, length);
+}
+
+// Callsites are keyed by their static strings, the first record of each one
+// writes its strings to the file and later ones only refer to its id
+static uint32_t ox_log_callsite_of(const ox_log_record_t* record)
+{
+  const uint64_t key = (uint64_t)(uintptr_t)record->format ^
+                       ((uint64_t)record->line * 0x9E3779B97F4A7C15ull);
+  size_t slot = (size_t)((key ^ (key >> 29)) & (OX_LOG_CALLSITES - 1));
+
+  ox_log_callsite_t* callsite = NULL;
+  for (size_t probe = 0; probe < OX_LOG_CALLSITES; ++probe) {
+    ox_log_callsite_t* entry = &log_callsites[slot];
+    if (!entry->format) {
+      callsite = entry;
+      break;
+    }
+
+    if (entry->format == record->format && entry->file == record->file &&
+        entry->line == record->line) {
+      return entry->id;
+    }
+    slot = (slot + 1) & (OX_LOG_CALLSITES - 1);
+  }
+
+  // A full table still works, the callsite is just written out every time
+  const uint32_t id = log_next_callsite++;
+  if (callsite) {
+    callsite->file = record->file;
+    callsite->format = record->format;
+    callsite->line = record->line;
+    callsite->id = id;
+  }
+
+  ox_log_emit_u8(OX_LOG_TAG_CALLSITE);
+  ox_log_emit_u32(id);
+  ox_log_emit_u32(record->line);
+  ox_log_emit_string(record->level);
+  ox_log_emit_string(record->file);
+  ox_log_emit_string(record->func);
+  ox_log_emit_string(record->format);
+  return id;
+}
+
+static void ox_log_encode_record(const ox_log_record_t* record)
+{
+  const uint32_t id = ox_log_callsite_of(record);
+
+  ox_log_emit_u8(OX_LOG_TAG_RECORD);
+  ox_log_emit_u32(id);
+  ox_log_emit(&record->time, sizeof(record->time));
+  ox_log_emit_u8((uint8_t)record->arg_count);
+
+  for (unsigned i = 0; i < record->arg_count; ++i) {
+    const ox_log_arg_t* arg = &record->args[i];
+    ox_log_emit_u8((uint8_t)arg->type);
+    if (arg->type == OX_LOG_ARG_STR) {
+      ox_log_emit_string(arg->s);
+    } else {
+      ox_log_emit(&arg->u, sizeof(arg->u));
+    }
+  }
+}
+
+static long ox_log_open_binary(const char* path)
+{
+  log_binary = fopen(path, "wb");
+  if (!log_binary) {
+    return OX_FAILURE;
+  }
+
+  memset(log_callsites, 0, sizeof(log_callsites));
+  log_next_callsite = 0;
+
+  const ox_log_binary_header_t header = {
+    .magic = OX_LOG_BINARY_MAGIC,
+    .version = OX_LOG_BINARY_VERSION,
+    .wall_base = (int64_t)log_wall_base,
+    .time_base = log_time_base,
+  };
+  fwrite(&header, sizeof(header), 1, log_binary);
+  return OX_SUCCESS;
+}
+
+static void ox_log_close_binary(void)
+{
+  if (log_binary) {
+    fclose(log_binary);
+    log_binary = NULL;
+  }
+}
+
+// Writes every ready record as one batch, consumer side only
+static size_t ox_log_drain(void)
+{
+  size_t count = 0;
+
+  for (;;) {
+    ox_log_record_t* record = &log_queue[log_dequeue & (OX_LOG_QUEUE_SIZE - 1)];
+    const size_t sequence =
+      atomic_load_explicit(&record->sequence, memory_order_acquire);
+    if (sequence != log_dequeue + 1) {
+      break;
+    }
+
+    if (log_binary) {
+      ox_log_encode_record(record);
+    } else {
+      char timestamp[16];
+      char line[OX_LOG_LINE_SIZE];
+      ox_log_wall_timestamp(record->time, timestamp, sizeof(timestamp));
+      ox_log_emit(line,
+                  ox_log_format_record(line, sizeof(line), record, timestamp));
+    }
+
+    atomic_store_explicit(&record->sequence, log_dequeue + OX_LOG_QUEUE_SIZE,
+                          memory_order_release);
+    log_dequeue++;
+    count++;
+  }
+
+  ox_log_flush();
+  atomic_fetch_add_explicit(&log_written, count, memory_order_relaxed);
+  return count;
+}
+
+static int ox_log_thread(void* arg)
+{
+  (void)arg;
+  size_t reported_drops = 0;
+
+  for (;;) {
+    const bool stopping = atomic_load(&log_stop);
+    const size_t drained = ox_log_drain();
+
+    const size_t dropped = atomic_load(&log_dropped);
+    if (dropped != reported_drops) {
+      char timestamp[16];
+      ox_timestamp(timestamp, sizeof(timestamp));
+      (void)fprintf(stderr, OX_LOG_FORMAT "Dropped %u log records\n", "WRN",
+                    timestamp, ox_filename(__FILE__), (unsigned)__LINE__,
+                    __FUNCTION__, (unsigned)(dropped - reported_drops));
+      fflush(stderr);
+      reported_drops = dropped;
+    }
+
+    if (stopping) {
+      break;
+    }
+
+    if (drained == 0) {
+      mtx_lock(&log_mtx);
+      atomic_store(&log_sleeping, true);
+      const ox_log_record_t* next =
+        &log_queue[log_dequeue & (OX_LOG_QUEUE_SIZE - 1)];
+      if (atomic_load(&next->sequence) != log_dequeue + 1 &&
+          !atomic_load(&log_stop)) {
+        struct timespec until;
+        timespec_get(&until, TIME_UTC);
+        until.tv_nsec += OX_LOG_IDLE_MS * 1000000L;
+        if (until.tv_nsec >= 1000000000L) {
+          until.tv_sec++;
+          until.tv_nsec -= 1000000000L;
+        }
+        cnd_timedwait(&log_cnd, &log_mtx, &until);
+      }
+      atomic_store(&log_sleeping, false);
+      mtx_unlock(&log_mtx);
+    }
+  }
+
+  return 0;
+}
+
+long ox_log_init(void)
+{
+  for (size_t i = 0; i < OX_LOG_QUEUE_SIZE; ++i) {
+    atomic_init(&log_queue[i].sequence, i);
+  }
+  atomic_store(&log_enqueue, 0);
+  log_dequeue = 0;
+
+  atomic_store(&log_written, 0);
+  atomic_store(&log_dropped, 0);
+  atomic_store(&log_blocked, 0);
+  atomic_store(&log_truncated, 0);
+  atomic_store(&log_stop, false);
+  atomic_store(&log_sleeping, false);
+
+  log_wall_base = time(NULL);
+  log_time_base = ox_time_ns();
+  log_batch_used = 0;
+
+  const char* binary_path = getenv("OX_LOG_BINARY");
+  if (binary_path && *binary_path &&
+      ox_log_open_binary(binary_path) != OX_SUCCESS) {
+    return OX_FAILURE;
+  }
+
+  if (mtx_init(&log_mtx, mtx_plain) != thrd_success) {
+    ox_log_close_binary();
+    return OX_FAILURE;
+  }
+
+  if (cnd_init(&log_cnd) != thrd_success) {
+    mtx_destroy(&log_mtx);
+    ox_log_close_binary();
+    return OX_FAILURE;
+  }
+
+  if (thrd_create(&log_thread, ox_log_thread, NULL) != thrd_success) {
+    cnd_destroy(&log_cnd);
+    mtx_destroy(&log_mtx);
+    ox_log_close_binary();
+    return OX_FAILURE;
+  }
+
+  atomic_store(&log_running, true);
+  return OX_SUCCESS;
+}
+
+void ox_log_exit(void)
+{
+  if (!atomic_load(&log_running)) {
+    return;
+  }
+
+  // New records go the synchronous way from here on
+  atomic_store(&log_running, false);
+
+  mtx_lock(&log_mtx);
+  atomic_store(&log_stop, true);
+  cnd_signal(&log_cnd);
+  mtx_unlock(&log_mtx);
+  thrd_join(log_thread, NULL);
+
+  // Records published while the thread was finishing
+  ox_log_drain();
+  ox_log_close_binary();
+
+  cnd_destroy(&log_cnd);
+  mtx_destroy(&log_mtx);
+}
+
+void ox_log_get_stats(ox_log_stats_t* stats)
+{
+  stats->written = atomic_load(&log_written);
+  stats->dropped = atomic_load(&log_dropped);
+  stats->blocked = atomic_load(&log_blocked);
+  stats->truncated = atomic_load(&log_truncated);
+}
+
+// Claims the slot for the next position, NULL when the queue is full
+static ox_log_record_t* ox_log_claim(size_t* position)
+{
+  size_t pos = atomic_load_explicit(&log_enqueue, memory_order_relaxed);
+  for (;;) {
+    ox_log_record_t* record = &log_queue[pos & (OX_LOG_QUEUE_SIZE - 1)];
+    const size_t sequence =
+      atomic_load_explicit(&record->sequence, memory_order_acquire);
+    const ptrdiff_t distance = (ptrdiff_t)(sequence - pos);
+
+    if (distance == 0) {
+      if (atomic_compare_exchange_weak_explicit(&log_enqueue, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        *position = pos;
+        return record;
+      }
+    } else if (distance < 0) {
+      return NULL;
+    } else {
+      pos = atomic_load_explicit(&log_enqueue, memory_order_relaxed);
+    }
+  }
+}
+
+void ox_log_write(const char* level, const char* file, const unsigned line,
+                  const char* func, const char* format,
+                  const ox_log_arg_t* args, const size_t arg_count)
+{
+  if (!atomic_load_explicit(&log_running, memory_order_acquire)) {
+    ox_log_record_t record;
+    char timestamp[16];
+    char text[OX_LOG_LINE_SIZE];
+    ox_log_capture(&record, level, file, line, func, format, args, arg_count);
+    ox_timestamp(timestamp, sizeof(timestamp));
+    const size_t length =
+      ox_log_format_record(text, sizeof(text), &record, timestamp);
+    fwrite(text, 1, length, stderr);
+    return;
+  }
+
+  // Errors are never dropped, they wait for the log thread instead
+  const bool must_deliver = strcmp(level, "ERR") == 0;
+
+  size_t position;
+  ox_log_record_t* record = ox_log_claim(&position);
+  if (!record) {
+    if (!must_deliver) {
+      atomic_fetch_add_explicit(&log_dropped, 1, memory_order_relaxed);
+      return;
+    }
+
+    atomic_fetch_add_explicit(&log_blocked, 1, memory_order_relaxed);
+    while (!(record = ox_log_claim(&position))) {
+      thrd_yield();
+    }
+  }
+
+  ox_log_capture(record, level, file, line, func, format, args, arg_count);
+  atomic_store_explicit(&record->sequence, position + 1, memory_order_release);
+
+  if (atomic_load(&log_sleeping)) {
+    mtx_lock(&log_mtx);
+    cnd_signal(&log_cnd);
+    mtx_unlock(&log_mtx);
+  }
+}
@@ -1,23 +1,180 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 
-#ifdef OX_DEBUG_BUILD
 #include <stdio.h>
-#endif
+
+#define OX_LOG_ARGS_MAX   12
+#define OX_LOG_QUEUE_SIZE 2048
+
+// Arguments are captured by value and formatted later on the log thread.
+// Strings are copied, so temporaries may be passed.
+typedef enum {
+  OX_LOG_ARG_INT,
+  OX_LOG_ARG_UINT,
+  OX_LOG_ARG_DOUBLE,
+  OX_LOG_ARG_PTR,
+  OX_LOG_ARG_STR,
+} ox_log_arg_type_t;
+
+typedef struct {
+  ox_log_arg_type_t type;
+  union {
+    long long i;
+    unsigned long long u;
+    double d;
+    const void* p;
+    const char* s;
+  };
+} ox_log_arg_t;
+
+typedef struct {
+  size_t written;   // Records formatted and written
+  size_t dropped;   // Records discarded because the queue was full
+  size_t blocked;   // Error records that had to wait for queue space
+  size_t truncated; // Records whose strings or arguments were cut
+} ox_log_stats_t;
+
+// Binary sink, enabled by setting OX_LOG_BINARY to a file path before
+// ox_log_init. The file starts with an ox_log_binary_header_t followed by
+// tagged entries in host byte order:
+//   OX_LOG_TAG_CALLSITE  u32 id, u32 line, then level, file, function and
+//                        format, each as u16 length and bytes
+//   OX_LOG_TAG_RECORD    u32 callsite id, u64 time, u8 argument count, then
+//                        per argument u8 type and 8 value bytes, strings as
+//                        u16 length and bytes instead
+// Every callsite is written once, before its first record.
+#define OX_LOG_BINARY_MAGIC   0x474C584Fu // "OXLG"
+#define OX_LOG_BINARY_VERSION 1
+
+enum {
+  OX_LOG_TAG_CALLSITE = 1,
+  OX_LOG_TAG_RECORD = 2,
+};
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  int64_t wall_base; // time_t of the monotonic time_base
+  uint64_t time_base;
+} ox_log_binary_header_t;
 
 void ox_timestamp(char* stamp, size_t stamp_size);
 const char* ox_filename(const char* filename);
 
+// Text records go to stderr, stdout is left to program output such as the
+// headless report and the benchmark JSON.
+// Starts the log thread, until then (and after ox_log_exit) records are
+// written synchronously by the calling thread
+long ox_log_init(void);
+// Writes every queued record and stops the log thread
+void ox_log_exit(void);
+void ox_log_get_stats(ox_log_stats_t* stats);
+
+// Queues one record. Errors wait for room when the queue is full, other
+// levels are dropped and counted.
+void ox_log_write(const char* level, const char* file, unsigned line,
+                  const char* func, const char* format,
+                  const ox_log_arg_t* args, size_t arg_count);
+
+// printf on captured arguments, used for text output and by the decoder
+size_t ox_log_format_message(char* out, size_t size, const char* format,
+                             const ox_log_arg_t* args, size_t arg_count);
+
+static inline ox_log_arg_t ox_log_arg_int(const long long value)
+{
+  return (ox_log_arg_t){ .type = OX_LOG_ARG_INT, .i = value };
+}
+
+static inline ox_log_arg_t ox_log_arg_uint(const unsigned long long value)
+{
+  return (ox_log_arg_t){ .type = OX_LOG_ARG_UINT, .u = value };
+}
+
+static inline ox_log_arg_t ox_log_arg_double(const double value)
+{
+  return (ox_log_arg_t){ .type = OX_LOG_ARG_DOUBLE, .d = value };
+}
+
+static inline ox_log_arg_t ox_log_arg_ptr(const void* value)
+{
+  return (ox_log_arg_t){ .type = OX_LOG_ARG_PTR, .p = value };
+}
+
+static inline ox_log_arg_t ox_log_arg_str(const char* value)
+{
+  return (ox_log_arg_t){ .type = OX_LOG_ARG_STR, .s = value };
+}
+
+#define OX_LOG_ARG(x)                                                          \
+  _Generic((x),                                                                \
+    char*: ox_log_arg_str,                                                     \
+    const char*: ox_log_arg_str,                                               \
+    _Bool: ox_log_arg_int,                                                     \
+    char: ox_log_arg_int,                                                      \
+    signed char: ox_log_arg_int,                                               \
+    short: ox_log_arg_int,                                                     \
+    int: ox_log_arg_int,                                                       \
+    long: ox_log_arg_int,                                                      \
+    long long: ox_log_arg_int,                                                 \
+    unsigned char: ox_log_arg_uint,                                            \
+    unsigned short: ox_log_arg_uint,                                           \
+    unsigned int: ox_log_arg_uint,                                             \
+    unsigned long: ox_log_arg_uint,                                            \
+    unsigned long long: ox_log_arg_uint,                                       \
+    float: ox_log_arg_double,                                                  \
+    double: ox_log_arg_double,                                                 \
+    long double: ox_log_arg_double,                                            \
+    default: ox_log_arg_ptr)(x)
+
+#define OX_LOG_CAT_(a, b) a##b
+#define OX_LOG_CAT(a, b)  OX_LOG_CAT_(a, b)
+
+#define OX_LOG_NARGS(...)                                                      \
+  OX_LOG_NARGS_(_, ##__VA_ARGS__, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define OX_LOG_NARGS_(_, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, n, \
+                      ...)                                                     \
+  n
+
+// Each argument becomes ", OX_LOG_ARG(x)"
+#define OX_LOG_MAP_0()
+#define OX_LOG_MAP_1(a)       , OX_LOG_ARG(a)
+#define OX_LOG_MAP_2(a, ...)  , OX_LOG_ARG(a) OX_LOG_MAP_1(__VA_ARGS__)
+#define OX_LOG_MAP_3(a, ...)  , OX_LOG_ARG(a) OX_LOG_MAP_2(__VA_ARGS__)
+#define OX_LOG_MAP_4(a, ...)  , OX_LOG_ARG(a) OX_LOG_MAP_3(__VA_ARGS__)
+#define OX_LOG_MAP_5(a, ...)  , OX_LOG_ARG(a) OX_LOG_MAP_4(__VA_ARGS__)
+#define OX_LOG_MAP_6(a, ...)  , OX_LOG_ARG(a) OX_LOG_MAP_5(__VA_ARGS__)
+#define OX_LOG_MAP_7(a, ...)  , OX_LOG_ARG(a) OX_LOG_MAP_6(__VA_ARGS__)
+#define OX_LOG_MAP_8(a, ...)  , OX_LOG_ARG(a) OX_LOG_MAP_7(__VA_ARGS__)
+#define OX_LOG_MAP_9(a, ...)  , OX_LOG_ARG(a) OX_LOG_MAP_8(__VA_ARGS__)
+#define OX_LOG_MAP_10(a, ...) , OX_LOG_ARG(a) OX_LOG_MAP_9(__VA_ARGS__)
+#define OX_LOG_MAP_11(a, ...) , OX_LOG_ARG(a) OX_LOG_MAP_10(__VA_ARGS__)
+#define OX_LOG_MAP_12(a, ...) , OX_LOG_ARG(a) OX_LOG_MAP_11(__VA_ARGS__)
+#define OX_LOG_MAP(...)                                                        \
+  OX_LOG_CAT(OX_LOG_MAP_, OX_LOG_NARGS(__VA_ARGS__))(__VA_ARGS__)
+
+// The leading placeholder keeps the array non-empty without arguments
+#define OX_LOG_ARGS(...)                                                       \
+  ((const ox_log_arg_t[]){ { 0 } OX_LOG_MAP(__VA_ARGS__) } + 1),               \
+    OX_LOG_NARGS(__VA_ARGS__)
+
 #define OX_FILENAME   ox_filename(__FILE__)
 #define OX_LOG_FORMAT "[%-s|%-s] [%-16s:%5u] (%s) "
 
+// The dead printf keeps -Wformat checking the arguments against the format,
+// it is never evaluated
+#define OX_LOG_CHECK_FORMAT(...)                                               \
+  do {                                                                         \
+    if (0) {                                                                   \
+      (void)printf(__VA_ARGS__);                                               \
+    }                                                                          \
+  } while (0)
+
 #define OX_LOG(lvl, file, line, func, fmt, ...)                                \
   do {                                                                         \
-    char timestamp[16];                                                        \
-    ox_timestamp(timestamp, sizeof(timestamp));                                \
-    (void)fprintf(stdout, OX_LOG_FORMAT fmt "\n", lvl, timestamp, file, line,  \
-                  func, ##__VA_ARGS__);                                        \
+    OX_LOG_CHECK_FORMAT(fmt, ##__VA_ARGS__);                                   \
+    ox_log_write(lvl, file, line, func, fmt, OX_LOG_ARGS(__VA_ARGS__));        \
   } while (0)
 
 #define OX_LOG_ERR(_fmt, ...)                                                  \
@@ -27,16 +184,12 @@ const char* ox_filename(const char* filename);
 #define OX_LOG_WRN(_fmt, ...)                                                  \
   OX_LOG("WRN", OX_FILENAME, __LINE__, __FUNCTION__, _fmt, ##__VA_ARGS__)
 #else
-#define OX_LOG_WRN(...)                                                        \
-  do {                                                                         \
-  } while (0)
+#define OX_LOG_WRN(...) OX_LOG_CHECK_FORMAT(__VA_ARGS__)
 #endif
 
 #ifdef OX_DEBUG_BUILD
 #define OX_LOG_DBG(_fmt, ...)                                                  \
   OX_LOG("DBG", OX_FILENAME, __LINE__, __FUNCTION__, _fmt, ##__VA_ARGS__)
 #else
-#define OX_LOG_DBG(...)                                                        \
-  do {                                                                         \
-  } while (0)
+#define OX_LOG_DBG(...) OX_LOG_CHECK_FORMAT(__VA_ARGS__)
 #endif
@@ -2,48 +2,87 @@
 
 #include "ox_core.h"
 #include "ox_log.h"
+#include "ox_memtrack.h"
+#include "ox_slab.h"
 
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-
-#ifdef OX_DEBUG_BUILD
+#include <string.h>
 #include <threads.h>
-#endif
 
-#ifdef OX_DEBUG_BUILD
-static mtx_t mem_mtx;
-static ox_list_head_t mem_allocs;
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 
+// What ox_mem_acquire guarantees, and what malloc gives on 64-bit targets
+#define OX_MEM_DEFAULT_ALIGN 16
+
+// Huge page size assumed for region alignment (x86-64 and AArch64 THP)
+#define OX_MEM_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+#define OX_FRAME_BUFFERS     2
+#define OX_FRAME_BUFFER_SIZE (4 * 1024 * 1024)
+#define OX_FRAME_ALIGN       16
+
+// Per-thread frame arena, one allocation split into OX_FRAME_BUFFERS parts.
+// The buffer in use is picked by the frame index, and is reset the first
+// time the thread allocates in a new frame.
+typedef struct {
+  char* base;
+  size_t offset;
+  size_t frame;
+} ox_frame_arena_t;
+
+static atomic_size_t frame_index;
+static tss_t frame_arena_key;
+static thread_local ox_frame_arena_t frame_arena;
+
+static void ox_frame_arena_free(void* data)
+{
+  ox_frame_arena_t* arena = data;
+  free(arena->base);
+  arena->base = NULL;
+}
+
 long ox_memory_init(void)
 {
+  if (tss_create(&frame_arena_key, ox_frame_arena_free) != thrd_success) {
+    return OX_FAILURE;
+  }
+  atomic_store(&frame_index, 0);
+
 #ifdef OX_DEBUG_BUILD
-  if (mtx_init(&mem_mtx, mtx_plain) != thrd_success) {
+  if (ox_memtrack_init() != OX_SUCCESS) {
+    tss_delete(frame_arena_key);
+    return OX_FAILURE;
+  }
+#elif defined(OX_MEM_USE_SLAB)
+  if (ox_slab_init() != OX_SUCCESS) {
+    tss_delete(frame_arena_key);
     return OX_FAILURE;
   }
-  ox_list_init(&mem_allocs);
 #endif
   return OX_SUCCESS;
 }
 
 void ox_memory_exit(void)
 {
-#ifdef OX_DEBUG_BUILD
-  ox_list_entry_t* entry;
-  ox_list_entry_t* tmp;
-  OX_LIST_FOR_EACH_SAFE(entry, tmp, &mem_allocs)
-  {
-    ox_memory_header_t* header =
-      OX_LIST_OFFSET(entry, ox_memory_header_t, link);
-    OX_LOG_ERR("Leaked memory, file: %s, line: %u, size: %u",
-               ox_filename(header->source_location.file),
-               (unsigned)header->source_location.line,
-               (unsigned)header->buffer_size);
-    ox_list_remove(&header->link);
-    free(header);
-  }
+  // Other threads released their arenas on exit
+  ox_frame_arena_free(&frame_arena);
+  tss_delete(frame_arena_key);
 
-  mtx_destroy(&mem_mtx);
+#ifdef OX_DEBUG_BUILD
+  ox_memtrack_exit();
+#elif defined(OX_MEM_USE_SLAB)
+  ox_slab_exit();
 #endif
 }
 
@@ -51,34 +90,65 @@ void* ox_mem_acquire(const size_t size,
                      const ox_source_location_t source_location)
 {
 #if OX_DEBUG_BUILD
-  // ReSharper disable once CppDFAMemoryLeak
-  char* data = malloc(size + sizeof(ox_memory_header_t));
-  if (data) {
-    ox_memory_header_t* header = (ox_memory_header_t*)data;
-    header->source_location = source_location;
-    header->buffer_size = size;
-    mtx_lock(&mem_mtx);
-    ox_list_add_tail(&mem_allocs, &header->link);
-    mtx_unlock(&mem_mtx);
-    // ReSharper disable once CppDFAMemoryLeak
-    return &data[sizeof(ox_memory_header_t)];
-  }
-  return data;
+  return ox_memtrack_acquire(size, source_location);
+#elif defined(OX_MEM_USE_SLAB)
+  (void)source_location;
+  return ox_slab_acquire(size);
+#elif defined(_WIN32)
+  (void)source_location;
+  return _aligned_malloc(size, OX_MEM_DEFAULT_ALIGN);
 #else
   (void)source_location;
   return malloc(size);
 #endif
 }
 
+void* ox_mem_acquire_aligned(const size_t size, const size_t alignment,
+                             const ox_source_location_t source_location)
+{
+  if ((alignment & (alignment - 1)) != 0 || alignment > OX_MEM_ALIGNMENT_MAX) {
+    OX_LOG_ERR("Invalid alignment %u", (unsigned)alignment);
+    return NULL;
+  }
+
+#if OX_DEBUG_BUILD
+  return ox_memtrack_acquire_aligned(size, alignment, source_location);
+#elif defined(OX_MEM_USE_SLAB)
+  (void)source_location;
+  return ox_slab_acquire_aligned(size, alignment);
+#elif defined(_WIN32)
+  (void)source_location;
+  return _aligned_malloc(size, alignment > OX_MEM_DEFAULT_ALIGN
+                                 ? alignment
+                                 : OX_MEM_DEFAULT_ALIGN);
+#else
+  (void)source_location;
+  if (alignment <= OX_MEM_DEFAULT_ALIGN) {
+    return malloc(size);
+  }
+  // aligned_alloc wants the size to be a multiple of the alignment
+  return aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1));
+#endif
+}
+
 void* ox_mem_reclaim(void* mem, const size_t size,
                      const ox_source_location_t source_location)
 {
 #if OX_DEBUG_BUILD
-  ox_memory_header_t* header =
-    (ox_memory_header_t*)((char*)mem - sizeof(ox_memory_header_t));
-  header->source_location = source_location;
-  header->buffer_size = size;
-  return realloc(mem, size + sizeof(ox_memory_header_t));
+  return ox_memtrack_reclaim(mem, size, source_location);
+#elif defined(OX_MEM_USE_SLAB)
+  (void)source_location;
+  if (!mem) {
+    return ox_slab_acquire(size);
+  }
+  if (size == 0) {
+    ox_slab_release(mem);
+    return NULL;
+  }
+  return ox_slab_reclaim(mem, size);
+#elif defined(_WIN32)
+  (void)source_location;
+  return _aligned_realloc(mem, size, OX_MEM_DEFAULT_ALIGN);
 #else
   (void)source_location;
   return realloc(mem, size);
@@ -87,12 +157,323 @@ void* ox_mem_reclaim(void* mem, const size_t size,
 
 void ox_mem_release(void* mem)
 {
+  if (!mem) {
+    return;
+  }
+
 #if OX_DEBUG_BUILD
-  ox_memory_header_t* header =
-    (ox_memory_header_t*)((char*)mem - sizeof(ox_memory_header_t));
-  ox_list_remove(&header->link);
-  free(header);
+  ox_memtrack_release(mem);
+#elif defined(OX_MEM_USE_SLAB)
+  ox_slab_release(mem);
+#elif defined(_WIN32)
+  _aligned_free(mem);
 #else
   free(mem);
 #endif
-}
\ No newline at end of file
+}
+
+size_t ox_mem_class_stats(ox_mem_class_stats_t* stats, const size_t capacity)
+{
+#ifdef OX_MEM_USE_SLAB
+  return ox_slab_class_stats(stats, capacity);
+#else
+  (void)stats;
+  (void)capacity;
+  return 0;
+#endif
+}
+
+void ox_mem_snapshot(ox_mem_snapshot_t* snapshot)
+{
+#ifdef OX_DEBUG_BUILD
+  ox_memtrack_snapshot(snapshot);
+#else
+  memset(snapshot, 0, sizeof(*snapshot));
+#endif
+}
+
+size_t ox_mem_snapshot_diff(const ox_mem_snapshot_t* from,
+                            const ox_mem_snapshot_t* to,
+                            ox_mem_site_diff_t* diffs, const size_t capacity)
+{
+  const double elapsed = to->time - from->time;
+  size_t count = 0;
+
+  for (size_t i = 0; i < OX_ARRAY_SIZE(to->sites); ++i) {
+    const ox_mem_site_stats_t* before = &from->sites[i];
+    const ox_mem_site_stats_t* after = &to->sites[i];
+
+    // A site first seen in 'to' is compared against zero
+    const bool known = before->file != NULL;
+    const size_t allocs =
+      after->alloc_count - (known ? before->alloc_count : 0);
+    const size_t live = known ? before->live_bytes : 0;
+    if (!after->file || (allocs == 0 && after->live_bytes == live)) {
+      continue;
+    }
+
+    if (count < capacity) {
+      ox_mem_site_diff_t* diff = &diffs[count];
+      diff->file = after->file;
+      diff->line = after->line;
+      diff->live_bytes = (ptrdiff_t)(after->live_bytes - live);
+      diff->live_count = (ptrdiff_t)(after->live_count -
+                                     (known ? before->live_count : 0));
+      diff->peak_bytes = after->peak_bytes;
+      diff->alloc_count = allocs;
+      diff->alloc_bytes =
+        after->alloc_bytes - (known ? before->alloc_bytes : 0);
+      diff->alloc_rate = elapsed > 0.0 ? (double)allocs / elapsed : 0.0;
+    }
+    count++;
+  }
+
+  return count;
+}
+
+static size_t ox_mem_page_size(void)
+{
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwPageSize;
+#else
+  const long size = sysconf(_SC_PAGESIZE);
+  return size > 0 ? (size_t)size : 4096;
+#endif
+}
+
+long ox_mem_region_reserve(ox_mem_region_t* region, const size_t capacity,
+                           const bool huge_pages)
+{
+  memset(region, 0, sizeof(*region));
+
+  const size_t granule =
+    huge_pages ? OX_MEM_HUGE_PAGE_SIZE : ox_mem_page_size();
+  const size_t reserved = (capacity + granule - 1) & ~(granule - 1);
+
+#ifdef _WIN32
+  // Large pages on Windows need a privilege and can't be committed lazily,
+  // the request is ignored there
+  region->base = VirtualAlloc(NULL, reserved, MEM_RESERVE, PAGE_NOACCESS);
+  if (!region->base) {
+    return OX_FAILURE;
+  }
+#else
+  // Over-reserve by one granule so the base can be moved to a boundary
+  const size_t mapped = huge_pages ? reserved + granule : reserved;
+  char* mapping = mmap(NULL, mapped, PROT_NONE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (mapping == MAP_FAILED) {
+    return OX_FAILURE;
+  }
+
+  char* base = mapping;
+  if (huge_pages) {
+    base = (char*)(((uintptr_t)mapping + granule - 1) & ~(granule - 1));
+    const size_t head = (size_t)(base - mapping);
+    if (head != 0) {
+      munmap(mapping, head);
+    }
+    if (mapped - head - reserved != 0) {
+      munmap(base + reserved, mapped - head - reserved);
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(base, reserved, MADV_HUGEPAGE);
+#endif
+  }
+  region->base = base;
+#endif
+
+  region->reserved = reserved;
+  region->huge_pages = huge_pages;
+  return OX_SUCCESS;
+}
+
+long ox_mem_region_commit(ox_mem_region_t* region, const size_t size)
+{
+  if (size <= region->committed) {
+    return OX_SUCCESS;
+  }
+
+  if (size > region->reserved) {
+    OX_LOG_ERR("Region of %u bytes can't grow to %u bytes",
+               (unsigned)region->reserved, (unsigned)size);
+    return OX_FAILURE;
+  }
+
+  // Commit in whole granules, at least doubling, so growth costs few calls
+  const size_t granule =
+    region->huge_pages ? OX_MEM_HUGE_PAGE_SIZE : ox_mem_page_size();
+  size_t target = region->committed * 2 > size ? region->committed * 2 : size;
+  target = (target + granule - 1) & ~(granule - 1);
+  if (target > region->reserved) {
+    target = region->reserved;
+  }
+
+  char* start = region->base + region->committed;
+  const size_t length = target - region->committed;
+#ifdef _WIN32
+  if (!VirtualAlloc(start, length, MEM_COMMIT, PAGE_READWRITE)) {
+    return OX_FAILURE;
+  }
+#else
+  if (mprotect(start, length, PROT_READ | PROT_WRITE) != 0) {
+    return OX_FAILURE;
+  }
+#endif
+
+  region->committed = target;
+  return OX_SUCCESS;
+}
+
+void ox_mem_region_release(ox_mem_region_t* region)
+{
+  if (region->base) {
+#ifdef _WIN32
+    VirtualFree(region->base, 0, MEM_RELEASE);
+#else
+    munmap(region->base, region->reserved);
+#endif
+  }
+  memset(region, 0, sizeof(*region));
+}
+
+long ox_mem_map_file(ox_mem_file_t* file, const char* path)
+{
+  memset(file, 0, sizeof(*file));
+
+#ifdef _WIN32
+  HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (handle == INVALID_HANDLE_VALUE) {
+    return OX_FAILURE;
+  }
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0) {
+    CloseHandle(handle);
+    return OX_FAILURE;
+  }
+
+  HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+  const void* data =
+    mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+  if (!data) {
+    if (mapping) {
+      CloseHandle(mapping);
+    }
+    CloseHandle(handle);
+    return OX_FAILURE;
+  }
+
+  file->file = handle;
+  file->mapping = mapping;
+  file->size = (size_t)size.QuadPart;
+#else
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return OX_FAILURE;
+  }
+
+  // An empty file can't be mapped
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0) {
+    close(fd);
+    return OX_FAILURE;
+  }
+
+  // The mapping keeps the file referenced, the descriptor isn't needed
+  const void* data =
+    mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return OX_FAILURE;
+  }
+
+  file->size = (size_t)info.st_size;
+#endif
+
+  file->data = data;
+  return OX_SUCCESS;
+}
+
+void ox_mem_unmap_file(ox_mem_file_t* file)
+{
+  if (file->data) {
+#ifdef _WIN32
+    UnmapViewOfFile(file->data);
+    CloseHandle(file->mapping);
+    CloseHandle(file->file);
+#else
+    munmap((void*)file->data, file->size);
+#endif
+  }
+  memset(file, 0, sizeof(*file));
+}
+
+// The arena of the calling thread, reset for the current frame
+static ox_frame_arena_t* ox_frame_local(void)
+{
+  ox_frame_arena_t* arena = &frame_arena;
+  const size_t frame = atomic_load_explicit(&frame_index, memory_order_relaxed);
+
+  if (!arena->base) {
+    // Raw malloc: once per thread, and never reported as a leak
+    arena->base = malloc((size_t)OX_FRAME_BUFFERS * OX_FRAME_BUFFER_SIZE);
+    if (!arena->base) {
+      return NULL;
+    }
+    tss_set(frame_arena_key, arena);
+    arena->offset = 0;
+    arena->frame = frame;
+  } else if (arena->frame != frame) {
+    arena->offset = 0;
+    arena->frame = frame;
+  }
+
+  return arena;
+}
+
+void* ox_frame_acquire(const size_t size)
+{
+  ox_frame_arena_t* arena = ox_frame_local();
+  if (!arena) {
+    OX_LOG_ERR("Failed to create frame arena");
+    return NULL;
+  }
+
+  const size_t offset =
+    (arena->offset + OX_FRAME_ALIGN - 1) & ~(size_t)(OX_FRAME_ALIGN - 1);
+  if (size > OX_FRAME_BUFFER_SIZE - offset) {
+    OX_LOG_ERR("Frame arena exhausted, requested %u bytes", (unsigned)size);
+    return NULL;
+  }
+
+  arena->offset = offset + size;
+  const size_t buffer = arena->frame % OX_FRAME_BUFFERS;
+  return &arena->base[buffer * OX_FRAME_BUFFER_SIZE + offset];
+}
+
+void ox_frame_end(void)
+{
+  atomic_fetch_add_explicit(&frame_index, 1, memory_order_relaxed);
+}
+
+ox_scratch_t ox_scratch_begin(void)
+{
+  const ox_frame_arena_t* arena = ox_frame_local();
+  if (!arena) {
+    return (ox_scratch_t){ 0, SIZE_MAX };
+  }
+  return (ox_scratch_t){ arena->offset, arena->frame };
+}
+
+void ox_scratch_end(const ox_scratch_t scratch)
+{
+  ox_frame_arena_t* arena = &frame_arena;
+  if (arena->base && arena->frame == scratch.frame &&
+      scratch.offset <= arena->offset) {
+    arena->offset = scratch.offset;
+  }
+}
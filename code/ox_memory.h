@@ -1,11 +1,16 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #ifdef OX_DEBUG_BUILD
 #include "ox_list.h"
 #endif
 
+#define OX_MEM_SITES_MAX     4096
+#define OX_MEM_ALIGNMENT_MAX 4096
+
 #ifdef OX_DEBUG_BUILD
 
 typedef struct {
@@ -13,10 +18,14 @@ typedef struct {
   size_t line;
 } ox_source_location_t;
 
+// Precedes every tracked block, 32 bytes so the payload stays 16-byte aligned
 typedef struct {
-  ox_list_entry_t link;
-  ox_source_location_t source_location;
-  size_t buffer_size;
+  ox_list_entry_t link; /**< Entry in the list of its shard */
+  size_t buffer_size;   /**< Requested size */
+  uint8_t shard;        /**< Shard owning 'link' */
+  uint8_t align_log2;   /**< Requested alignment */
+  uint16_t offset;      /**< Bytes from the malloc block to this header */
+  uint32_t site;        /**< Callsite the block is accounted to */
 } ox_memory_header_t;
 
 #define OX_SOURCE_LOCATION                                                     \
@@ -32,6 +41,56 @@ typedef int ox_source_location_t;
 
 #endif
 
+/**
+ * @brief Counters of one allocator size class
+ */
+typedef struct {
+  size_t size;     /**< Bytes per block, including the block header */
+  size_t acquired; /**< Blocks handed out so far */
+  size_t released; /**< Blocks given back so far */
+  size_t refills;  /**< Trips from a thread cache to the shared free list */
+  size_t reserved; /**< Bytes carved from OS blocks for this class */
+} ox_mem_class_stats_t;
+
+/**
+ * @brief Allocation statistics of one OX_SOURCE_LOCATION callsite
+ */
+typedef struct {
+  const char* file;   /**< NULL for an unused entry */
+  size_t line;        /**< Line of the callsite */
+  size_t live_bytes;  /**< Bytes currently allocated */
+  size_t live_count;  /**< Blocks currently allocated */
+  size_t peak_bytes;  /**< Highest live_bytes seen */
+  size_t alloc_count; /**< Blocks allocated so far */
+  size_t alloc_bytes; /**< Bytes allocated so far */
+} ox_mem_site_stats_t;
+
+/**
+ * @brief Copy of every callsite's statistics at one point in time
+ *
+ * Sites keep their index for the lifetime of the program, so two snapshots
+ * can be compared entry by entry. The last entry collects the callsites
+ * that did not fit in the table. The struct is large, allocate it.
+ */
+typedef struct {
+  double time; /**< Monotonic seconds, only meaningful between snapshots */
+  ox_mem_site_stats_t sites[OX_MEM_SITES_MAX + 1];
+} ox_mem_snapshot_t;
+
+/**
+ * @brief Change of one callsite between two snapshots
+ */
+typedef struct {
+  const char* file;       /**< File of the callsite */
+  size_t line;            /**< Line of the callsite */
+  ptrdiff_t live_bytes;   /**< Change of live bytes */
+  ptrdiff_t live_count;   /**< Change of live blocks */
+  size_t peak_bytes;      /**< Peak bytes in the later snapshot */
+  size_t alloc_count;     /**< Blocks allocated in between */
+  size_t alloc_bytes;     /**< Bytes allocated in between */
+  double alloc_rate;      /**< Allocations per second in between */
+} ox_mem_site_diff_t;
+
 /**
  * @brief Initialize the memory management system
  * 
@@ -75,6 +134,27 @@ void ox_memory_exit(void);
  */
 void* ox_mem_acquire(size_t size, ox_source_location_t source_location);
 
+/**
+ * @brief Allocate memory aligned to a power of two
+ *
+ * Behaves like ox_mem_acquire(), which already guarantees 16 bytes, but
+ * places the block on an 'alignment' boundary. Use it for component
+ * columns and SIMD arrays that want 64-byte (cache line) alignment.
+ *
+ * @param size The size of memory to allocate in bytes
+ * @param alignment Power of two, at most OX_MEM_ALIGNMENT_MAX
+ * @param source_location Source location information (use OX_SOURCE_LOCATION macro)
+ * @return Pointer to allocated memory on success, NULL on failure
+ *
+ * @note Release with ox_mem_release(). ox_mem_reclaim() keeps the alignment,
+ *       except in release builds without the slab allocator where aligned
+ *       blocks must not be resized.
+ *
+ * @see ox_mem_release
+ */
+void* ox_mem_acquire_aligned(size_t size, size_t alignment,
+                             ox_source_location_t source_location);
+
 /**
  * @brief Reallocate memory with source location tracking
  * 
@@ -113,4 +193,165 @@ void* ox_mem_reclaim(void* mem, size_t size,
  * @see ox_mem_acquire
  * @see ox_mem_reclaim
  */
-void ox_mem_release(void* mem);
\ No newline at end of file
+void ox_mem_release(void* mem);
+
+/**
+ * @brief Copy the counters of every allocator size class
+ *
+ * Threads fold their counters into the shared ones whenever they visit the
+ * shared free lists and when they exit, so counts of running threads lag
+ * slightly behind.
+ *
+ * @param stats Receives up to 'capacity' entries
+ * @param capacity Size of 'stats'
+ * @return Number of entries written, 0 when the slab allocator is not in use
+ */
+size_t ox_mem_class_stats(ox_mem_class_stats_t* stats, size_t capacity);
+
+/**
+ * @brief Address range reserved up front and committed as it grows
+ *
+ * The base address never changes, so arrays living in a region grow in
+ * place without copying and pointers into them stay valid.
+ */
+typedef struct {
+  char* base;       /**< Start of the region */
+  size_t committed; /**< Bytes usable from base */
+  size_t reserved;  /**< Bytes of address space held for growth */
+  bool huge_pages;  /**< Transparent huge pages were requested */
+} ox_mem_region_t;
+
+/**
+ * @brief Reserve address space for a region without committing memory
+ *
+ * With 'huge_pages' the region is 2 MiB aligned and, where the system
+ * supports it (Linux transparent huge pages), backed by huge pages, which
+ * cuts TLB misses on large arrays. Elsewhere the flag is ignored.
+ *
+ * @param region Region to initialize
+ * @param capacity Largest size the region may grow to
+ * @param huge_pages Request huge pages
+ * @return OX_SUCCESS or OX_FAILURE
+ */
+long ox_mem_region_reserve(ox_mem_region_t* region, size_t capacity,
+                           bool huge_pages);
+
+/**
+ * @brief Make at least 'size' bytes of the region usable
+ * @param region Reserved region
+ * @param size Bytes needed from the base, at most the reserved capacity
+ * @return OX_SUCCESS or OX_FAILURE
+ *
+ * @note Newly committed memory is zero-filled
+ */
+long ox_mem_region_commit(ox_mem_region_t* region, size_t size);
+
+/**
+ * @brief Give the whole region back to the system
+ * @param region Region to release, may be zeroed/never reserved
+ */
+void ox_mem_region_release(ox_mem_region_t* region);
+
+/**
+ * @brief Read-only view of a whole file
+ */
+typedef struct {
+  const void* data; /**< First byte of the file */
+  size_t size;      /**< Bytes in the file */
+#ifdef _WIN32
+  void* file;    /**< File handle */
+  void* mapping; /**< File mapping handle */
+#endif
+} ox_mem_file_t;
+
+/**
+ * @brief Map a file into memory read-only
+ *
+ * Pages are read in on first access, a file that is never fully touched is
+ * never fully read.
+ *
+ * @param file Mapping to initialize
+ * @param path File to map
+ * @return OX_SUCCESS or OX_FAILURE
+ */
+long ox_mem_map_file(ox_mem_file_t* file, const char* path);
+
+/**
+ * @brief Unmap a file mapped by ox_mem_map_file()
+ * @param file Mapping to release, may be zeroed/never mapped
+ */
+void ox_mem_unmap_file(ox_mem_file_t* file);
+
+/**
+ * @brief Position in the calling thread's frame arena
+ */
+typedef struct {
+  size_t offset;
+  size_t frame;
+} ox_scratch_t;
+
+/**
+ * @brief Allocate memory that lives until the end of the next frame
+ *
+ * Every thread bumps through its own double-buffered arena, so this never
+ * takes a lock or touches the general heap once the thread's arena exists.
+ * Frame N allocates from one buffer while the data of frame N - 1 stays
+ * readable in the other, each buffer is reset when it becomes current again.
+ *
+ * @param size The size of memory to allocate in bytes
+ * @return 16-byte aligned memory, NULL if the arena is exhausted
+ *
+ * @note There is no release, the memory is reclaimed by ox_frame_end()
+ *
+ * @see ox_frame_end
+ * @see ox_scratch_begin
+ */
+void* ox_frame_acquire(size_t size);
+
+/**
+ * @brief Finish the current frame
+ *
+ * Must be called once per frame while no other thread is allocating from
+ * a frame arena. Allocations made two frames ago become invalid.
+ */
+void ox_frame_end(void);
+
+/**
+ * @brief Open a temporary scope in the calling thread's frame arena
+ *
+ * Scopes nest: everything acquired after ox_scratch_begin() is given back
+ * by the matching ox_scratch_end(), so temporaries of a hot loop don't
+ * accumulate until the end of the frame.
+ *
+ * @return Marker to pass to ox_scratch_end()
+ */
+ox_scratch_t ox_scratch_begin(void);
+
+/**
+ * @brief Close a scope opened by ox_scratch_begin()
+ * @param scratch Marker of the scope, ignored if its frame already ended
+ */
+void ox_scratch_end(ox_scratch_t scratch);
+
+/**
+ * @brief Capture the statistics of every allocation callsite
+ *
+ * Tracking is only compiled into builds defining OX_DEBUG_BUILD, other
+ * builds produce an empty snapshot. Counters are read without stopping
+ * other threads, so a snapshot taken under load is approximate.
+ *
+ * @param snapshot Receives the statistics
+ */
+void ox_mem_snapshot(ox_mem_snapshot_t* snapshot);
+
+/**
+ * @brief Compare two snapshots callsite by callsite
+ * @param from Earlier snapshot
+ * @param to Later snapshot
+ * @param diffs Receives one entry per callsite that changed
+ * @param capacity Size of 'diffs'
+ * @return Number of changed callsites, may exceed 'capacity'
+ */
+size_t ox_mem_snapshot_diff(const ox_mem_snapshot_t* from,
+                            const ox_mem_snapshot_t* to,
+                            ox_mem_site_diff_t* diffs, size_t capacity);
@@ -0,0 +1,314 @@
+#include "ox_memtrack.h"
+
+#ifdef OX_DEBUG_BUILD
+
+#include "ox_core.h"
+#include "ox_log.h"
+#include "ox_time.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+static_assert(sizeof(ox_memory_header_t) % 16 == 0,
+              "Memory header must keep the payload 16-byte aligned");
+static_assert((OX_MEM_SITES_MAX & (OX_MEM_SITES_MAX - 1)) == 0,
+              "OX_MEM_SITES_MAX must be a power of two");
+static_assert(OX_MEM_ALIGNMENT_MAX <= UINT16_MAX,
+              "Header offsets must fit in 16 bits");
+
+// Alignment every header-prefixed block gets without asking
+#define OX_MEMTRACK_ALIGN_LOG2 4
+
+enum {
+  OX_MEMTRACK_SITE_FREE,
+  OX_MEMTRACK_SITE_CLAIMED,
+  OX_MEMTRACK_SITE_READY,
+};
+
+typedef struct {
+  atomic_int state;
+  const char* file;
+  size_t line;
+  atomic_size_t live_bytes;
+  atomic_size_t live_count;
+  atomic_size_t peak_bytes;
+  atomic_size_t alloc_count;
+  atomic_size_t alloc_bytes;
+} ox_memtrack_site_t;
+
+typedef struct {
+  mtx_t mtx;
+  ox_list_head_t allocs;
+} ox_memtrack_shard_t;
+
+// The last entry collects callsites that no longer fit in the table
+static ox_memtrack_site_t track_sites[OX_MEM_SITES_MAX + 1];
+static ox_memtrack_shard_t track_shards[OX_MEMTRACK_SHARDS];
+static atomic_uint track_next_shard;
+static thread_local unsigned track_shard;
+
+static uint32_t ox_memtrack_site_of(const ox_source_location_t location)
+{
+  const uint64_t key = (uint64_t)(uintptr_t)location.file ^
+                       ((uint64_t)location.line * 0x9E3779B97F4A7C15ull);
+  size_t slot = (size_t)((key ^ (key >> 29)) & (OX_MEM_SITES_MAX - 1));
+
+  for (size_t probe = 0; probe < OX_MEM_SITES_MAX; ++probe) {
+    ox_memtrack_site_t* site = &track_sites[slot];
+    int state = atomic_load_explicit(&site->state, memory_order_acquire);
+
+    if (state == OX_MEMTRACK_SITE_FREE) {
+      if (atomic_compare_exchange_strong(&site->state, &state,
+                                         OX_MEMTRACK_SITE_CLAIMED)) {
+        site->file = location.file;
+        site->line = location.line;
+        atomic_store_explicit(&site->state, OX_MEMTRACK_SITE_READY,
+                              memory_order_release);
+        return (uint32_t)slot;
+      }
+    }
+
+    // Another thread is filling the entry in, it may be this callsite
+    while (state == OX_MEMTRACK_SITE_CLAIMED) {
+      thrd_yield();
+      state = atomic_load_explicit(&site->state, memory_order_acquire);
+    }
+
+    if (site->file == location.file && site->line == location.line) {
+      return (uint32_t)slot;
+    }
+    slot = (slot + 1) & (OX_MEM_SITES_MAX - 1);
+  }
+
+  return OX_MEM_SITES_MAX;
+}
+
+static void ox_memtrack_site_add(const uint32_t index, const size_t size)
+{
+  ox_memtrack_site_t* site = &track_sites[index];
+  const size_t live =
+    atomic_fetch_add_explicit(&site->live_bytes, size, memory_order_relaxed) +
+    size;
+  atomic_fetch_add_explicit(&site->live_count, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&site->alloc_count, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&site->alloc_bytes, size, memory_order_relaxed);
+
+  size_t peak = atomic_load_explicit(&site->peak_bytes, memory_order_relaxed);
+  while (live > peak &&
+         !atomic_compare_exchange_weak_explicit(&site->peak_bytes, &peak, live,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+  }
+}
+
+static void ox_memtrack_site_sub(const uint32_t index, const size_t size)
+{
+  ox_memtrack_site_t* site = &track_sites[index];
+  atomic_fetch_sub_explicit(&site->live_bytes, size, memory_order_relaxed);
+  atomic_fetch_sub_explicit(&site->live_count, 1, memory_order_relaxed);
+}
+
+// Shards are handed out round-robin, one per thread on first use
+static uint8_t ox_memtrack_shard(void)
+{
+  // Stored off by one so zero means unassigned
+  if (track_shard == 0) {
+    const unsigned next = atomic_fetch_add(&track_next_shard, 1);
+    track_shard = next % OX_MEMTRACK_SHARDS + 1;
+  }
+  return (uint8_t)(track_shard - 1);
+}
+
+static void ox_memtrack_link(ox_memory_header_t* header)
+{
+  ox_memtrack_shard_t* shard = &track_shards[header->shard];
+  mtx_lock(&shard->mtx);
+  ox_list_add_tail(&shard->allocs, &header->link);
+  mtx_unlock(&shard->mtx);
+}
+
+static void ox_memtrack_unlink(ox_memory_header_t* header)
+{
+  ox_memtrack_shard_t* shard = &track_shards[header->shard];
+  mtx_lock(&shard->mtx);
+  ox_list_remove(&header->link);
+  mtx_unlock(&shard->mtx);
+}
+
+static void* ox_memtrack_block(const ox_memory_header_t* header)
+{
+  return (char*)header - header->offset;
+}
+
+long ox_memtrack_init(void)
+{
+  for (size_t i = 0; i < OX_MEMTRACK_SHARDS; ++i) {
+    if (mtx_init(&track_shards[i].mtx, mtx_plain) != thrd_success) {
+      while (i-- > 0) {
+        mtx_destroy(&track_shards[i].mtx);
+      }
+      return OX_FAILURE;
+    }
+    ox_list_init(&track_shards[i].allocs);
+  }
+
+  ox_memtrack_site_t* overflow = &track_sites[OX_MEM_SITES_MAX];
+  overflow->file = "<untracked callsites>";
+  overflow->line = 0;
+  atomic_store(&overflow->state, OX_MEMTRACK_SITE_READY);
+  return OX_SUCCESS;
+}
+
+void ox_memtrack_exit(void)
+{
+  for (size_t i = 0; i < OX_MEMTRACK_SHARDS; ++i) {
+    ox_list_entry_t* entry;
+    ox_list_entry_t* tmp;
+    OX_LIST_FOR_EACH_SAFE(entry, tmp, &track_shards[i].allocs)
+    {
+      ox_memory_header_t* header =
+        OX_LIST_OFFSET(entry, ox_memory_header_t, link);
+      const ox_memtrack_site_t* site = &track_sites[header->site];
+      OX_LOG_ERR("Leaked memory, file: %s, line: %u, size: %u",
+                 ox_filename(site->file), (unsigned)site->line,
+                 (unsigned)header->buffer_size);
+      ox_list_remove(&header->link);
+      free(ox_memtrack_block(header));
+    }
+    mtx_destroy(&track_shards[i].mtx);
+  }
+}
+
+void* ox_memtrack_acquire(const size_t size,
+                          const ox_source_location_t source_location)
+{
+  // ReSharper disable once CppDFAMemoryLeak
+  ox_memory_header_t* header = malloc(size + sizeof(ox_memory_header_t));
+  if (!header) {
+    return NULL;
+  }
+
+  header->buffer_size = size;
+  header->align_log2 = OX_MEMTRACK_ALIGN_LOG2;
+  header->offset = 0;
+  header->shard = ox_memtrack_shard();
+  header->site = ox_memtrack_site_of(source_location);
+  ox_memtrack_site_add(header->site, size);
+  ox_memtrack_link(header);
+  // ReSharper disable once CppDFAMemoryLeak
+  return header + 1;
+}
+
+void* ox_memtrack_acquire_aligned(const size_t size, const size_t alignment,
+                                  const ox_source_location_t source_location)
+{
+  if (alignment <= ((size_t)1 << OX_MEMTRACK_ALIGN_LOG2)) {
+    return ox_memtrack_acquire(size, source_location);
+  }
+
+  // The header sits right before the aligned payload, anywhere in the
+  // slack in front of it
+  char* block = malloc(size + sizeof(ox_memory_header_t) + alignment);
+  if (!block) {
+    return NULL;
+  }
+
+  const uintptr_t start = (uintptr_t)block + sizeof(ox_memory_header_t);
+  const uintptr_t payload =
+    (start + alignment - 1) & ~(uintptr_t)(alignment - 1);
+  ox_memory_header_t* header = (ox_memory_header_t*)payload - 1;
+
+  header->buffer_size = size;
+  header->align_log2 = (uint8_t)ox_ctz64(alignment);
+  header->offset = (uint16_t)((char*)header - block);
+  header->shard = ox_memtrack_shard();
+  header->site = ox_memtrack_site_of(source_location);
+  ox_memtrack_site_add(header->site, size);
+  ox_memtrack_link(header);
+  return header + 1;
+}
+
+void* ox_memtrack_reclaim(void* mem, const size_t size,
+                          const ox_source_location_t source_location)
+{
+  if (!mem) {
+    return ox_memtrack_acquire(size, source_location);
+  }
+
+  if (size == 0) {
+    ox_memtrack_release(mem);
+    return NULL;
+  }
+
+  ox_memory_header_t* header = (ox_memory_header_t*)mem - 1;
+
+  // realloc can't preserve a custom alignment, such blocks are copied
+  if (header->align_log2 != OX_MEMTRACK_ALIGN_LOG2) {
+    void* resized = ox_memtrack_acquire_aligned(
+      size, (size_t)1 << header->align_log2, source_location);
+    if (resized) {
+      memcpy(resized, mem,
+             header->buffer_size < size ? header->buffer_size : size);
+      ox_memtrack_release(mem);
+    }
+    return resized;
+  }
+
+  // realloc may move the block, so it leaves its list first and joins again
+  // at its new address
+  ox_memtrack_unlink(header);
+
+  ox_memory_header_t* moved =
+    realloc(header, size + sizeof(ox_memory_header_t));
+  if (!moved) {
+    ox_memtrack_link(header);
+    return NULL;
+  }
+
+  // The block is accounted to the callsite that resized it last
+  ox_memtrack_site_sub(moved->site, moved->buffer_size);
+  moved->buffer_size = size;
+  moved->site = ox_memtrack_site_of(source_location);
+  ox_memtrack_site_add(moved->site, size);
+  ox_memtrack_link(moved);
+  return moved + 1;
+}
+
+void ox_memtrack_release(void* mem)
+{
+  ox_memory_header_t* header = (ox_memory_header_t*)mem - 1;
+  ox_memtrack_unlink(header);
+  ox_memtrack_site_sub(header->site, header->buffer_size);
+  free(ox_memtrack_block(header));
+}
+
+void ox_memtrack_snapshot(ox_mem_snapshot_t* snapshot)
+{
+  // Monotonic, a wall clock step between two snapshots would skew the rates
+  snapshot->time = (double)ox_time_ns() * 1e-9;
+
+  for (size_t i = 0; i <= OX_MEM_SITES_MAX; ++i) {
+    ox_memtrack_site_t* site = &track_sites[i];
+    ox_mem_site_stats_t* stats = &snapshot->sites[i];
+
+    if (atomic_load_explicit(&site->state, memory_order_acquire) !=
+        OX_MEMTRACK_SITE_READY) {
+      memset(stats, 0, sizeof(*stats));
+      continue;
+    }
+
+    stats->file = site->file;
+    stats->line = site->line;
+    stats->live_bytes = atomic_load(&site->live_bytes);
+    stats->live_count = atomic_load(&site->live_count);
+    stats->peak_bytes = atomic_load(&site->peak_bytes);
+    stats->alloc_count = atomic_load(&site->alloc_count);
+    stats->alloc_bytes = atomic_load(&site->alloc_bytes);
+  }
+}
+
+#endif
@@ -0,0 +1,39 @@
+/**
+ * @file ox_memtrack.h
+ * @brief Allocation tracking behind ox_mem_acquire in debug builds
+ *
+ * Live blocks are linked into one of OX_MEMTRACK_SHARDS lists, each behind
+ * its own lock. A thread always allocates through the same shard, so locks
+ * are rarely contended. Statistics are kept per OX_SOURCE_LOCATION callsite
+ * in a fixed-size table filled without locks, with atomic counters.
+ */
+
+#pragma once
+
+#include "ox_memory.h"
+
+#define OX_MEMTRACK_SHARDS 16
+
+#ifdef OX_DEBUG_BUILD
+
+/**
+ * @brief Create the shard locks
+ * @return OX_SUCCESS or OX_FAILURE
+ */
+long ox_memtrack_init(void);
+
+/**
+ * @brief Report and free every block still alive, then destroy the locks
+ */
+void ox_memtrack_exit(void);
+
+void* ox_memtrack_acquire(size_t size, ox_source_location_t source_location);
+void* ox_memtrack_acquire_aligned(size_t size, size_t alignment,
+                                  ox_source_location_t source_location);
+void* ox_memtrack_reclaim(void* mem, size_t size,
+                          ox_source_location_t source_location);
+void ox_memtrack_release(void* mem);
+
+void ox_memtrack_snapshot(ox_mem_snapshot_t* snapshot);
+
+#endif
@@ -0,0 +1,368 @@
+#include "ox_profile.h"
+
+#include "ox_core.h"
+#include "ox_job.h"
+#include "ox_log.h"
+#include "ox_memory.h"
+#include "ox_time.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <threads.h>
+
+static_assert((OX_PROFILE_ZONES_MAX & (OX_PROFILE_ZONES_MAX - 1)) == 0,
+              "OX_PROFILE_ZONES_MAX must be a power of two");
+static_assert(OX_PROFILE_THREADS_MAX <= UINT16_MAX,
+              "Thread slots must fit in 16 bits");
+
+// Only the owning thread writes the ring and the open zones. A zone is
+// published by bumping 'written'; a reader copies zones already published
+// and drops every one the owner may have overwritten meanwhile.
+typedef struct {
+  atomic_uint_fast64_t written;
+  int job_index; // Job thread index at registration, -1 for other threads
+  uint16_t slot;
+  uint16_t depth;
+  const char* open_names[OX_PROFILE_DEPTH_MAX];
+  uint64_t open_starts[OX_PROFILE_DEPTH_MAX];
+  ox_profile_zone_t zones[OX_PROFILE_ZONES_MAX];
+} ox_profile_thread_t;
+
+static _Atomic(ox_profile_thread_t*) profile_threads[OX_PROFILE_THREADS_MAX];
+static atomic_uint profile_thread_count;
+
+// Bumped by every init, a thread registers again once it sees a new value
+static atomic_uint profile_generation;
+static atomic_bool profile_running;
+
+static thread_local ox_profile_thread_t* profile_thread;
+static thread_local unsigned profile_thread_generation;
+
+// Frame markers are written and read by the main thread only
+static uint64_t profile_frame_starts[OX_PROFILE_FRAMES_MAX];
+static uint64_t profile_frame_ends[OX_PROFILE_FRAMES_MAX];
+static uint64_t profile_frame_count;
+static uint64_t profile_frame_start;
+static uint64_t profile_time_base;
+
+static ox_profile_thread_t* ox_profile_register(void)
+{
+  const unsigned generation = atomic_load(&profile_generation);
+  if (profile_thread_generation == generation) {
+    return profile_thread;
+  }
+
+  // A thread that finds no free slot stays unregistered for this generation
+  profile_thread = NULL;
+  profile_thread_generation = generation;
+
+  const unsigned slot = atomic_fetch_add(&profile_thread_count, 1);
+  if (slot >= OX_PROFILE_THREADS_MAX) {
+    return NULL;
+  }
+
+  ox_profile_thread_t* thread =
+    ox_mem_acquire(sizeof(ox_profile_thread_t), OX_SOURCE_LOCATION);
+  if (!thread) {
+    return NULL;
+  }
+
+  atomic_init(&thread->written, 0);
+  thread->job_index = ox_job_thread_index();
+  thread->slot = (uint16_t)slot;
+  thread->depth = 0;
+  atomic_store_explicit(&profile_threads[slot], thread, memory_order_release);
+  profile_thread = thread;
+  return thread;
+}
+
+long ox_profile_init(void)
+{
+  profile_time_base = ox_time_ns();
+  profile_frame_start = profile_time_base;
+  profile_frame_count = 0;
+  atomic_fetch_add(&profile_generation, 1);
+  atomic_store(&profile_running, true);
+  return OX_SUCCESS;
+}
+
+void ox_profile_exit(void)
+{
+  atomic_store(&profile_running, false);
+
+  const unsigned count = atomic_load(&profile_thread_count);
+  for (unsigned i = 0; i < count && i < OX_PROFILE_THREADS_MAX; ++i) {
+    ox_profile_thread_t* thread = atomic_exchange(&profile_threads[i], NULL);
+    if (thread) {
+      ox_mem_release(thread);
+    }
+  }
+
+  atomic_store(&profile_thread_count, 0);
+}
+
+void ox_profile_begin(const char* name)
+{
+  if (!atomic_load_explicit(&profile_running, memory_order_relaxed)) {
+    return;
+  }
+
+  ox_profile_thread_t* thread = ox_profile_register();
+  if (!thread) {
+    return;
+  }
+
+  // Zones nested deeper than the stack are counted but not recorded
+  if (thread->depth < OX_PROFILE_DEPTH_MAX) {
+    thread->open_names[thread->depth] = name;
+    thread->open_starts[thread->depth] = ox_time_ns();
+  }
+  ++thread->depth;
+}
+
+void ox_profile_end(void)
+{
+  if (!atomic_load_explicit(&profile_running, memory_order_relaxed)) {
+    return;
+  }
+
+  // The zone may have begun before the profiler was (re)started
+  ox_profile_thread_t* thread = profile_thread;
+  if (!thread ||
+      profile_thread_generation != atomic_load(&profile_generation) ||
+      thread->depth == 0) {
+    return;
+  }
+
+  const uint16_t depth = --thread->depth;
+  if (depth >= OX_PROFILE_DEPTH_MAX) {
+    return;
+  }
+
+  const uint64_t written =
+    atomic_load_explicit(&thread->written, memory_order_relaxed);
+  thread->zones[written & (OX_PROFILE_ZONES_MAX - 1)] = (ox_profile_zone_t){
+    .name = thread->open_names[depth],
+    .start = thread->open_starts[depth],
+    .end = ox_time_ns(),
+    .thread = thread->slot,
+    .depth = depth,
+  };
+  atomic_store_explicit(&thread->written, written + 1, memory_order_release);
+}
+
+void ox_profile_frame(void)
+{
+  const uint64_t now = ox_time_ns();
+  const size_t slot = profile_frame_count % OX_PROFILE_FRAMES_MAX;
+  profile_frame_starts[slot] = profile_frame_start;
+  profile_frame_ends[slot] = now;
+  profile_frame_start = now;
+  ++profile_frame_count;
+}
+
+bool ox_profile_get_frame(const size_t age, ox_profile_frame_t* frame)
+{
+  if (age >= OX_PROFILE_FRAMES_MAX || age >= profile_frame_count) {
+    return false;
+  }
+
+  const uint64_t index = profile_frame_count - 1 - age;
+  const size_t slot = index % OX_PROFILE_FRAMES_MAX;
+  frame->index = index;
+  frame->start = profile_frame_starts[slot];
+  frame->end = profile_frame_ends[slot];
+  return true;
+}
+
+// Receives the zones of one thread in recording order, returns false to stop
+typedef bool (*ox_profile_visit_fn)(void* data, const ox_profile_zone_t* zone);
+
+static void ox_profile_read_thread(ox_profile_thread_t* thread,
+                                   const ox_profile_visit_fn visit, void* data)
+{
+  const uint64_t written =
+    atomic_load_explicit(&thread->written, memory_order_acquire);
+  const uint64_t first =
+    written > OX_PROFILE_ZONES_MAX ? written - OX_PROFILE_ZONES_MAX : 0;
+
+  for (uint64_t i = first; i < written; ++i) {
+    const ox_profile_zone_t zone =
+      thread->zones[i & (OX_PROFILE_ZONES_MAX - 1)];
+
+    // The owner writes zone 'now' into the slot of 'now - size', the copy
+    // is only good if that can't have happened yet
+    atomic_thread_fence(memory_order_acquire);
+    const uint64_t now =
+      atomic_load_explicit(&thread->written, memory_order_relaxed);
+    if (i + OX_PROFILE_ZONES_MAX <= now) {
+      continue;
+    }
+
+    if (!visit(data, &zone)) {
+      return;
+    }
+  }
+}
+
+typedef struct {
+  uint64_t start;
+  uint64_t end;
+  ox_profile_zone_t* zones;
+  size_t capacity;
+  size_t count;
+} ox_profile_collect_t;
+
+static bool ox_profile_collect_zone(void* data, const ox_profile_zone_t* zone)
+{
+  ox_profile_collect_t* collect = data;
+  if (zone->start < collect->start || zone->start >= collect->end) {
+    return true;
+  }
+
+  if (collect->count == collect->capacity) {
+    return false;
+  }
+
+  collect->zones[collect->count++] = *zone;
+  return true;
+}
+
+static int ox_profile_compare_zones(const void* a, const void* b)
+{
+  const ox_profile_zone_t* lhs = a;
+  const ox_profile_zone_t* rhs = b;
+  if (lhs->thread != rhs->thread) {
+    return lhs->thread < rhs->thread ? -1 : 1;
+  }
+  if (lhs->start != rhs->start) {
+    return lhs->start < rhs->start ? -1 : 1;
+  }
+  return (lhs->depth > rhs->depth) - (lhs->depth < rhs->depth);
+}
+
+size_t ox_profile_collect(const uint64_t start, const uint64_t end,
+                          ox_profile_zone_t* zones, const size_t capacity)
+{
+  ox_profile_collect_t collect = {
+    .start = start,
+    .end = end,
+    .zones = zones,
+    .capacity = capacity,
+  };
+
+  const unsigned count = atomic_load(&profile_thread_count);
+  for (unsigned i = 0; i < count && i < OX_PROFILE_THREADS_MAX; ++i) {
+    ox_profile_thread_t* thread =
+      atomic_load_explicit(&profile_threads[i], memory_order_acquire);
+    if (thread) {
+      ox_profile_read_thread(thread, ox_profile_collect_zone, &collect);
+    }
+  }
+
+  qsort(zones, collect.count, sizeof(ox_profile_zone_t),
+        ox_profile_compare_zones);
+  return collect.count;
+}
+
+typedef struct {
+  FILE* file;
+  bool first;
+} ox_profile_trace_t;
+
+// Zone names are plain identifiers in practice, anything that would break
+// the JSON string is replaced
+static void ox_profile_write_name(FILE* file, const char* name)
+{
+  for (const char* c = name; *c; ++c) {
+    const bool plain = *c != '"' && *c != '\\' && (unsigned char)*c >= 0x20;
+    (void)fputc(plain ? *c : '?', file);
+  }
+}
+
+static void ox_profile_trace_separator(ox_profile_trace_t* trace)
+{
+  (void)fputs(trace->first ? "\n" : ",\n", trace->file);
+  trace->first = false;
+}
+
+static bool ox_profile_trace_zone(void* data, const ox_profile_zone_t* zone)
+{
+  ox_profile_trace_t* trace = data;
+  ox_profile_trace_separator(trace);
+
+  // Timestamps are microseconds since ox_profile_init
+  (void)fputs("{\"name\":\"", trace->file);
+  ox_profile_write_name(trace->file, zone->name);
+  (void)fprintf(trace->file,
+                "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,"
+                "\"dur\":%.3f}",
+                (unsigned)zone->thread,
+                (double)(zone->start - profile_time_base) * 1e-3,
+                (double)(zone->end - zone->start) * 1e-3);
+  return true;
+}
+
+long ox_profile_write_chrome_trace(const char* path)
+{
+  FILE* file = fopen(path, "w");
+  if (!file) {
+    OX_LOG_ERR("Failed to create '%s'", path);
+    return OX_FAILURE;
+  }
+
+  ox_profile_trace_t trace = { .file = file, .first = true };
+  (void)fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", file);
+
+  const unsigned count = atomic_load(&profile_thread_count);
+  for (unsigned i = 0; i < count && i < OX_PROFILE_THREADS_MAX; ++i) {
+    ox_profile_thread_t* thread =
+      atomic_load_explicit(&profile_threads[i], memory_order_acquire);
+    if (!thread) {
+      continue;
+    }
+
+    char name[32];
+    if (thread->job_index == 0) {
+      (void)snprintf(name, sizeof(name), "Main");
+    } else if (thread->job_index > 0) {
+      (void)snprintf(name, sizeof(name), "Worker %d", thread->job_index);
+    } else {
+      (void)snprintf(name, sizeof(name), "Thread %u", i);
+    }
+
+    ox_profile_trace_separator(&trace);
+    (void)fprintf(file,
+                  "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                  "\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                  i, name);
+    ox_profile_read_thread(thread, ox_profile_trace_zone, &trace);
+  }
+
+  // Frame boundaries become global instant events
+  const uint64_t frames = profile_frame_count < OX_PROFILE_FRAMES_MAX
+                            ? profile_frame_count
+                            : OX_PROFILE_FRAMES_MAX;
+  for (uint64_t age = frames; age-- > 0;) {
+    ox_profile_frame_t frame;
+    if (!ox_profile_get_frame((size_t)age, &frame)) {
+      continue;
+    }
+    ox_profile_trace_separator(&trace);
+    (void)fprintf(file,
+                  "{\"name\":\"Frame %llu\",\"ph\":\"i\",\"s\":\"g\","
+                  "\"pid\":1,\"tid\":0,\"ts\":%.3f}",
+                  (unsigned long long)frame.index,
+                  (double)(frame.end - profile_time_base) * 1e-3);
+  }
+
+  (void)fputs("\n]}\n", file);
+
+  if (fclose(file) != 0) {
+    OX_LOG_ERR("Failed to write '%s'", path);
+    return OX_FAILURE;
+  }
+  return OX_SUCCESS;
+}
@@ -0,0 +1,122 @@
+/**
+ * @file ox_profile.h
+ * @brief Hierarchical CPU profiler
+ *
+ * Zones are opened and closed with OX_PROFILE_BEGIN and OX_PROFILE_END and
+ * nest per thread. Every thread writes its closed zones into a ring of its
+ * own, so recording takes no lock. The main thread marks frame boundaries
+ * with OX_PROFILE_FRAME, readers collect the zones of a time range from all
+ * rings while the other threads keep recording.
+ *
+ * The macros compile out unless OX_DEBUG_BUILD or OX_PROFILER is defined.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(OX_DEBUG_BUILD) || defined(OX_PROFILER)
+#define OX_PROFILE_ENABLED
+#endif
+
+#define OX_PROFILE_THREADS_MAX 64
+#define OX_PROFILE_ZONES_MAX   16384
+#define OX_PROFILE_DEPTH_MAX   32
+#define OX_PROFILE_FRAMES_MAX  256
+
+/**
+ * @brief One closed zone, times come from ox_time_ns
+ */
+typedef struct {
+  const char* name; // Must outlive the profiler, usually a literal
+  uint64_t start;
+  uint64_t end;
+  uint16_t thread; // Profiler thread slot, not the job thread index
+  uint16_t depth;  // Zones open on the thread when this one began
+} ox_profile_zone_t;
+
+typedef struct {
+  uint64_t index;
+  uint64_t start;
+  uint64_t end;
+} ox_profile_frame_t;
+
+/**
+ * @brief Start recording, the first frame begins now
+ * @return OX_SUCCESS or OX_FAILURE
+ */
+long ox_profile_init(void);
+
+/**
+ * @brief Stop recording and release the rings of every thread
+ *
+ * No other thread may record while this runs.
+ */
+void ox_profile_exit(void);
+
+/**
+ * @brief Open a zone on the calling thread
+ * @param name Zone name, compared by content when zones are aggregated
+ */
+void ox_profile_begin(const char* name);
+
+/**
+ * @brief Close the innermost open zone of the calling thread
+ */
+void ox_profile_end(void);
+
+/**
+ * @brief Close the current frame and begin the next one, main thread only
+ */
+void ox_profile_frame(void);
+
+/**
+ * @brief Look up a closed frame
+ * @param age 0 for the last closed frame, 1 for the one before and so on
+ * @param frame Receives the frame
+ * @return false if the frame is no longer (or not yet) recorded
+ */
+bool ox_profile_get_frame(size_t age, ox_profile_frame_t* frame);
+
+/**
+ * @brief Copy the recorded zones that began within [start, end)
+ *
+ * Zones are sorted by thread, then by start time and depth, so every zone
+ * directly follows its parent or an earlier sibling.
+ *
+ * @param start First nanosecond of the range
+ * @param end Nanosecond past the range
+ * @param zones Receives up to 'capacity' zones
+ * @param capacity Size of 'zones'
+ * @return Number of zones written
+ */
+size_t ox_profile_collect(uint64_t start, uint64_t end,
+                          ox_profile_zone_t* zones, size_t capacity);
+
+/**
+ * @brief Write every recorded zone and frame in the Chrome trace format
+ *
+ * The file loads in chrome://tracing and Perfetto.
+ *
+ * @param path Output file
+ * @return OX_SUCCESS or OX_FAILURE
+ */
+long ox_profile_write_chrome_trace(const char* path);
+
+#ifdef OX_PROFILE_ENABLED
+#define OX_PROFILE_BEGIN(name) ox_profile_begin(name)
+#define OX_PROFILE_END()       ox_profile_end()
+#define OX_PROFILE_FRAME()     ox_profile_frame()
+#else
+#define OX_PROFILE_BEGIN(...)                                                  \
+  do {                                                                         \
+  } while (0)
+#define OX_PROFILE_END()                                                       \
+  do {                                                                         \
+  } while (0)
+#define OX_PROFILE_FRAME()                                                     \
+  do {                                                                         \
+  } while (0)
+#endif
@@ -1,38 +1,79 @@
 #include "ox_render.h"
 
 #include "ox_core.h"
+#include "ox_profile.h"
+#include "ox_render_font.h"
+#include "ox_render_text.h"
 
 #include "raylib.h"
 
+#include <stdlib.h>
+#include <string.h>
+
+#define OX_RENDER_GLYPH_COUNT 250
+
 static Font current_font;
 static bool font_loaded = false;
 
+// Try to load a system font first (common monospace fonts)
+static const char* font_paths[] = {
+  "/usr/share/fonts/truetype/dejavu/DejaVuSansMono.ttf",
+  "/usr/share/fonts/TTF/Hack-Regular.ttf",
+  "/usr/share/fonts/TTF/DejaVuSansMono.ttf",
+  "/System/Library/Fonts/Monaco.ttf", // macOS
+  "C:/Windows/Fonts/consola.ttf",     // Windows
+  ""                                  // Fallback to default
+};
+
+// Candidate to carry on with if the background load fails
+static int font_path_next = 0;
+
+// Loads the first usable font from font_paths[first] on. A cached atlas is
+// uploaded right away. Otherwise the font is rasterized in the background,
+// unless OX_FONT_ASYNC is 0, and false is returned: ox_render_update picks
+// the font up, or carries on with the next candidate if rasterizing fails.
+static bool ox_render_load_font(const int first, Font* font)
+{
+  const char* async = getenv("OX_FONT_ASYNC");
+  const bool background = !async || strcmp(async, "0") != 0;
+
+  for (int i = first; i < 4; ++i) {
+    if (!FileExists(font_paths[i])) {
+      continue;
+    }
+
+    if (ox_render_font_load_cached(font_paths[i], ox_render_get_font_size(),
+                                   OX_RENDER_GLYPH_COUNT, font)) {
+      return true;
+    }
+
+    if (background &&
+        ox_render_font_load_async(font_paths[i], ox_render_get_font_size(),
+                                  OX_RENDER_GLYPH_COUNT)) {
+      font_path_next = i + 1;
+      return false;
+    }
+
+    if (ox_render_font_load(font_paths[i], ox_render_get_font_size(),
+                            OX_RENDER_GLYPH_COUNT, font)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
 long ox_render_init(void)
 {
   InitWindow(1920, 1080, "OX");
   ClearWindowState(FLAG_VSYNC_HINT);
   // SetTargetFPS(60);
 
-  // Try to load a system font first (common monospace fonts)
-  static const char* font_paths[] = {
-    "/usr/share/fonts/truetype/dejavu/DejaVuSansMono.ttf",
-    "/usr/share/fonts/TTF/Hack-Regular.ttf",
-    "/usr/share/fonts/TTF/DejaVuSansMono.ttf",
-    "/System/Library/Fonts/Monaco.ttf", // macOS
-    "C:/Windows/Fonts/consola.ttf",     // Windows
-    ""                                  // Fallback to default
-  };
-
+  // The default font is used until a background load is picked up
+  OX_PROFILE_BEGIN("load font");
   current_font = (Font){ 0 };
-  for (int i = 0; i < 4; ++i) {
-    if (FileExists(font_paths[i])) {
-      current_font =
-        LoadFontEx(font_paths[i], ox_render_get_font_size(), 0, 250);
-      if (current_font.texture.id != 0) {
-        break;
-      }
-    }
-  }
+  ox_render_load_font(0, &current_font);
+  OX_PROFILE_END();
 
   // If no custom font was loaded, use the default font
   if (current_font.texture.id == 0) {
@@ -41,17 +82,44 @@ long ox_render_init(void)
 
   font_loaded = true;
 
+  if (ox_render_text_init() != OX_SUCCESS) {
+    ox_render_exit();
+    return OX_FAILURE;
+  }
+
+  ox_render_set_backend(OX_RENDER_BACKEND_RLGL);
   return OX_SUCCESS;
 }
 
 void ox_render_exit(void)
 {
+  ox_render_set_backend(OX_RENDER_BACKEND_NULL);
+  ox_render_font_exit();
+  ox_render_text_exit();
   if (font_loaded && current_font.texture.id != GetFontDefault().texture.id) {
     UnloadFont(current_font);
   }
   CloseWindow();
 }
 
+void ox_render_update(void)
+{
+  Font font = { 0 };
+  switch (ox_render_font_poll(&font)) {
+  case OX_RENDER_FONT_PENDING:
+    break;
+  case OX_RENDER_FONT_FAILED:
+    // The current font stays until one of the remaining candidates loads
+    if (ox_render_load_font(font_path_next, &font)) {
+      ox_render_set_font(font);
+    }
+    break;
+  case OX_RENDER_FONT_READY:
+    ox_render_set_font(font);
+    break;
+  }
+}
+
 Font ox_render_get_default_font(void)
 {
   return GetFontDefault();
@@ -69,6 +137,9 @@ int ox_render_get_font_size(void)
 
 void ox_render_set_font(const Font font)
 {
+  // Layouts of the old font would match a new one reusing its texture id
+  // and glyph array address
+  ox_render_text_clear();
   if (font_loaded && current_font.texture.id != GetFontDefault().texture.id) {
     UnloadFont(current_font);
   }
@@ -81,16 +152,22 @@ void ox_render_draw_text(const char* text, const int posX, const int posY,
                          const int fontSize, const Color color)
 {
   if (font_loaded) {
-    DrawTextEx(current_font, text, (Vector2){ (float)posX, (float)posY },
-               (float)fontSize, 1.0f, color);
-  } else {
-    DrawText(text, posX, posY, fontSize, color);
+    ox_render_text_draw(current_font, text,
+                        (Vector2){ (float)posX, (float)posY },
+                        (float)fontSize, 1.0f, color);
+    return;
   }
+
+  // DrawText's size and spacing for the default font
+  const int size = fontSize < 10 ? 10 : fontSize;
+  ox_render_text_draw(GetFontDefault(), text,
+                      (Vector2){ (float)posX, (float)posY }, (float)size,
+                      (float)(size / 10), color);
 }
 
 void ox_render_draw_text_ex(const Font font, const char* text,
                             const Vector2 position, const float fontSize,
                             const float spacing, const Color tint)
 {
-  DrawTextEx(font, text, position, fontSize, spacing, tint);
+  ox_render_text_draw(font, text, position, fontSize, spacing, tint);
 }
\ No newline at end of file
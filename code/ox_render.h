@@ -2,8 +2,13 @@
 
 #include "raylib.h"
 
+#include <stddef.h>
+
 long ox_render_init(void);
 void ox_render_exit(void);
+// Once per frame, switches to the font once its background load is done or
+// moves on to the next candidate font if that load failed
+void ox_render_update(void);
 
 Font ox_render_get_default_font(void);
 Font ox_render_get_current_font(void);
@@ -13,4 +18,55 @@ void ox_render_set_font(Font font);
 void ox_render_draw_text(const char* text, int posX, int posY, int fontSize,
                          Color color);
 void ox_render_draw_text_ex(Font font, const char* text, Vector2 position,
-                            float fontSize, float spacing, Color tint);
\ No newline at end of file
+                            float fontSize, float spacing, Color tint);
+
+// Counters of the text layout cache since ox_render_init
+typedef struct {
+  size_t hits;            // Texts drawn from a cached layout
+  size_t misses;          // Texts that needed a new layout
+  size_t glyphs_reused;   // Glyphs a new layout took from a cached prefix
+  size_t glyphs_laid_out; // Glyphs a new layout placed itself
+} ox_render_text_stats_t;
+
+void ox_render_get_text_stats(ox_render_text_stats_t* stats);
+
+// Command queue: shapes are pushed during the frame and submitted by
+// ox_render_flush, sorted by layer and material into as few batches as
+// possible. Commands of one layer and material keep their push order, so
+// alternating circles and lines within them starts a new batch each time.
+
+#define OX_RENDER_CIRCLE_SEGMENTS 36
+#define OX_RENDER_MATERIALS_MAX   64
+#define OX_RENDER_VERTICES_MAX    6144
+
+typedef enum {
+  OX_RENDER_BACKEND_NULL, // Builds the batches but submits nothing
+  OX_RENDER_BACKEND_RLGL,
+} ox_render_backend_t;
+
+// Counters of the last ox_render_flush
+typedef struct {
+  size_t commands; // Shapes pushed
+  size_t batches;  // Runs of one layer, material and primitive
+  size_t vertices; // Vertices handed to the backend
+} ox_render_stats_t;
+
+// The queue starts on the null backend, ox_render_init switches it to rlgl
+long ox_render_queue_init(void);
+void ox_render_queue_exit(void);
+void ox_render_set_backend(ox_render_backend_t backend);
+
+// Layers are drawn in ascending order, 0 to 255
+void ox_render_set_layer(int layer);
+// Texture and shader of the shapes pushed next, circles map the whole
+// texture onto their bounding box
+void ox_render_set_material(Texture2D texture, Shader shader);
+void ox_render_reset_material(void);
+
+void ox_render_push_circle(Vector2 center, float radius, Color color);
+void ox_render_push_line(Vector2 start, Vector2 end, Color color);
+
+// Submits and clears the queue, between BeginDrawing and EndDrawing for the
+// rlgl backend
+void ox_render_flush(void);
+void ox_render_get_stats(ox_render_stats_t* stats);
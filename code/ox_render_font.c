@@ -0,0 +1,413 @@
+#include "ox_render_font.h"
+
+#include "ox_core.h"
+#include "ox_log.h"
+#include "ox_memory.h"
+#include "ox_time.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+static_assert(sizeof(ox_render_font_cache_header_t) % 8 == 0,
+              "The path must start 8-byte aligned");
+static_assert(sizeof(ox_render_font_cache_glyph_t) % 8 == 0,
+              "The atlas must start 8-byte aligned");
+
+typedef struct {
+  char path[OX_RENDER_FONT_PATH_MAX];
+  int font_size;
+  int glyph_count;
+  GlyphInfo* glyphs;
+  Rectangle* recs;
+  Image atlas;
+} ox_render_font_raster_t;
+
+// Only the main thread starts, polls and joins the background load
+static ox_render_font_raster_t font_raster;
+static thrd_t font_thread;
+static bool font_thread_running;
+static atomic_bool font_thread_done;
+
+static size_t ox_render_font_align(const size_t size)
+{
+  return (size + 7) & ~(size_t)7;
+}
+
+// OX_FONT_CACHE when set, otherwise an "ox" directory in the user's cache
+// directory. The application directory may be read-only, so it's not used.
+static bool ox_render_font_cache_directory(char* out, const size_t out_size)
+{
+  const char* directory = getenv("OX_FONT_CACHE");
+  const char* subdirectory = "";
+  if (!directory) {
+#if defined(_WIN32)
+    directory = getenv("LOCALAPPDATA");
+    subdirectory = "/ox";
+#elif defined(__APPLE__)
+    directory = getenv("HOME");
+    subdirectory = "/Library/Caches/ox";
+#else
+    directory = getenv("XDG_CACHE_HOME");
+    subdirectory = "/ox";
+    if (!directory || directory[0] == '\0') {
+      directory = getenv("HOME");
+      subdirectory = "/.cache/ox";
+    }
+#endif
+  }
+
+  if (!directory || directory[0] == '\0') {
+    return false;
+  }
+
+  const int written = snprintf(out, out_size, "%s%s", directory, subdirectory);
+  return written > 0 && (size_t)written < out_size;
+}
+
+static bool ox_render_font_cache_path(char* out, const size_t out_size,
+                                      const char* path, const int font_size)
+{
+  char directory[OX_RENDER_FONT_PATH_MAX];
+  if (!ox_render_font_cache_directory(directory, sizeof(directory))) {
+    return false;
+  }
+
+  uint64_t hash = 0xCBF29CE484222325ull;
+  for (const char* c = path; *c; ++c) {
+    hash = (hash ^ (unsigned char)*c) * 0x100000001B3ull;
+  }
+
+  const char last = directory[strlen(directory) - 1];
+  const char* separator = last == '/' || last == '\\' ? "" : "/";
+  const int written =
+    snprintf(out, out_size, "%s%sox_font_%016llx_%d.cache", directory,
+             separator, (unsigned long long)hash, font_size);
+  return written > 0 && (size_t)written < out_size;
+}
+
+static void ox_render_font_free_raster(ox_render_font_raster_t* raster)
+{
+  if (raster->glyphs) {
+    UnloadFontData(raster->glyphs, raster->glyph_count);
+  }
+  MemFree(raster->recs);
+  UnloadImage(raster->atlas);
+  raster->glyphs = NULL;
+  raster->recs = NULL;
+  raster->atlas = (Image){ 0 };
+}
+
+// Written under a temporary name and renamed, so instances starting at the
+// same time never map a half-written file
+static void ox_render_font_write_cache(const ox_render_font_raster_t* raster)
+{
+  char directory[OX_RENDER_FONT_PATH_MAX];
+  char cache_path[OX_RENDER_FONT_PATH_MAX];
+  char temp_path[OX_RENDER_FONT_PATH_MAX + 32];
+  if (!ox_render_font_cache_directory(directory, sizeof(directory)) ||
+      !ox_render_font_cache_path(cache_path, sizeof(cache_path),
+                                 raster->path, raster->font_size)) {
+    return;
+  }
+
+  // Creates the missing parents too, the user cache directory may be new
+  if (MakeDirectory(directory) != 0) {
+    OX_LOG_WRN("Failed to create '%s'", directory);
+    return;
+  }
+  (void)snprintf(temp_path, sizeof(temp_path), "%s.%llx.tmp", cache_path,
+                 (unsigned long long)ox_time_ns());
+
+  const size_t path_length = strlen(raster->path);
+  const ox_render_font_cache_header_t header = {
+    .magic = OX_RENDER_FONT_CACHE_MAGIC,
+    .version = OX_RENDER_FONT_CACHE_VERSION,
+    .font_mtime = GetFileModTime(raster->path),
+    .font_length = GetFileLength(raster->path),
+    .font_size = raster->font_size,
+    .glyph_count = raster->glyph_count,
+    .glyph_padding = OX_RENDER_FONT_PADDING,
+    .atlas_width = raster->atlas.width,
+    .atlas_height = raster->atlas.height,
+    .atlas_format = raster->atlas.format,
+    .path_length = (uint32_t)path_length,
+    .atlas_size = (uint64_t)GetPixelDataSize(
+      raster->atlas.width, raster->atlas.height, raster->atlas.format),
+  };
+
+  FILE* file = fopen(temp_path, "wb");
+  if (!file) {
+    OX_LOG_WRN("Failed to create '%s'", temp_path);
+    return;
+  }
+
+  static const char padding[8] = { 0 };
+  const size_t padding_length = ox_render_font_align(path_length) - path_length;
+  bool written =
+    fwrite(&header, sizeof(header), 1, file) == 1 &&
+    fwrite(raster->path, 1, path_length, file) == path_length &&
+    fwrite(padding, 1, padding_length, file) == padding_length;
+
+  for (int i = 0; written && i < raster->glyph_count; ++i) {
+    const GlyphInfo* glyph = &raster->glyphs[i];
+    const Rectangle* rec = &raster->recs[i];
+    const ox_render_font_cache_glyph_t entry = {
+      .value = glyph->value,
+      .offset_x = glyph->offsetX,
+      .offset_y = glyph->offsetY,
+      .advance_x = glyph->advanceX,
+      .x = rec->x,
+      .y = rec->y,
+      .width = rec->width,
+      .height = rec->height,
+    };
+    written = fwrite(&entry, sizeof(entry), 1, file) == 1;
+  }
+
+  written = written && fwrite(raster->atlas.data, 1, header.atlas_size,
+                              file) == header.atlas_size;
+
+  if (fclose(file) != 0 || !written) {
+    OX_LOG_WRN("Failed to write '%s'", temp_path);
+    remove(temp_path);
+    return;
+  }
+
+#ifdef _WIN32
+  // rename doesn't replace an existing file there
+  remove(cache_path);
+#endif
+  if (rename(temp_path, cache_path) != 0) {
+    remove(temp_path);
+  }
+}
+
+// Everything up to the texture upload, safe off the main thread
+static bool ox_render_font_rasterize(ox_render_font_raster_t* raster)
+{
+  int data_size = 0;
+  unsigned char* data = LoadFileData(raster->path, &data_size);
+  if (!data) {
+    return false;
+  }
+
+  raster->glyphs = LoadFontData(data, data_size, raster->font_size, NULL,
+                                raster->glyph_count, FONT_DEFAULT);
+  UnloadFileData(data);
+  if (!raster->glyphs) {
+    return false;
+  }
+
+  raster->atlas =
+    GenImageFontAtlas(raster->glyphs, &raster->recs, raster->glyph_count,
+                      raster->font_size, OX_RENDER_FONT_PADDING, 0);
+  if (!raster->atlas.data) {
+    ox_render_font_free_raster(raster);
+    return false;
+  }
+
+  ox_render_font_write_cache(raster);
+  return true;
+}
+
+// Moves the glyphs into 'font', the atlas is freed once it's on the GPU
+static bool ox_render_font_upload(ox_render_font_raster_t* raster,
+                                  Font* font)
+{
+  const Texture2D texture = LoadTextureFromImage(raster->atlas);
+  UnloadImage(raster->atlas);
+  raster->atlas = (Image){ 0 };
+
+  if (texture.id == 0) {
+    ox_render_font_free_raster(raster);
+    return false;
+  }
+
+  *font = (Font){
+    .baseSize = raster->font_size,
+    .glyphCount = raster->glyph_count,
+    .glyphPadding = OX_RENDER_FONT_PADDING,
+    .texture = texture,
+    .recs = raster->recs,
+    .glyphs = raster->glyphs,
+  };
+  raster->recs = NULL;
+  raster->glyphs = NULL;
+  return true;
+}
+
+static bool ox_render_font_prepare(ox_render_font_raster_t* raster,
+                                   const char* path, const int font_size,
+                                   const int glyph_count)
+{
+  if (strlen(path) >= sizeof(raster->path)) {
+    return false;
+  }
+
+  memset(raster, 0, sizeof(*raster));
+  strcpy(raster->path, path);
+  raster->font_size = font_size;
+  raster->glyph_count = glyph_count;
+  return true;
+}
+
+bool ox_render_font_load_cached(const char* path, const int font_size,
+                                const int glyph_count, Font* font)
+{
+  char cache_path[OX_RENDER_FONT_PATH_MAX];
+  if (!ox_render_font_cache_path(cache_path, sizeof(cache_path), path,
+                                 font_size)) {
+    return false;
+  }
+
+  ox_mem_file_t file;
+  if (ox_mem_map_file(&file, cache_path) != OX_SUCCESS) {
+    return false;
+  }
+
+  // Any mismatch makes the file stale, it's replaced by the next rasterizing
+  const char* bytes = file.data;
+  const ox_render_font_cache_header_t* header = file.data;
+  const size_t path_length = strlen(path);
+  const size_t path_offset = sizeof(ox_render_font_cache_header_t);
+  const size_t glyph_offset = path_offset + ox_render_font_align(path_length);
+  const size_t atlas_offset =
+    glyph_offset + sizeof(ox_render_font_cache_glyph_t) * (size_t)glyph_count;
+
+  if (file.size < atlas_offset ||
+      header->magic != OX_RENDER_FONT_CACHE_MAGIC ||
+      header->version != OX_RENDER_FONT_CACHE_VERSION ||
+      header->font_mtime != GetFileModTime(path) ||
+      header->font_length != GetFileLength(path) ||
+      header->font_size != font_size || header->glyph_count != glyph_count ||
+      header->path_length != path_length ||
+      memcmp(bytes + path_offset, path, path_length) != 0 ||
+      header->atlas_size !=
+        (uint64_t)GetPixelDataSize(header->atlas_width, header->atlas_height,
+                                   header->atlas_format) ||
+      file.size != atlas_offset + header->atlas_size) {
+    OX_LOG_DBG("Font cache '%s' is stale", cache_path);
+    ox_mem_unmap_file(&file);
+    return false;
+  }
+
+  GlyphInfo* glyphs = MemAlloc((unsigned)(sizeof(GlyphInfo) * glyph_count));
+  Rectangle* recs = MemAlloc((unsigned)(sizeof(Rectangle) * glyph_count));
+  if (!glyphs || !recs) {
+    MemFree(glyphs);
+    MemFree(recs);
+    ox_mem_unmap_file(&file);
+    return false;
+  }
+
+  const ox_render_font_cache_glyph_t* entries =
+    (const ox_render_font_cache_glyph_t*)(bytes + glyph_offset);
+  for (int i = 0; i < glyph_count; ++i) {
+    glyphs[i] = (GlyphInfo){
+      .value = entries[i].value,
+      .offsetX = entries[i].offset_x,
+      .offsetY = entries[i].offset_y,
+      .advanceX = entries[i].advance_x,
+    };
+    recs[i] = (Rectangle){ entries[i].x, entries[i].y, entries[i].width,
+                           entries[i].height };
+  }
+
+  // The pixels go to the GPU straight from the mapping
+  const Image atlas = {
+    .data = (void*)(bytes + atlas_offset),
+    .width = header->atlas_width,
+    .height = header->atlas_height,
+    .mipmaps = 1,
+    .format = header->atlas_format,
+  };
+  const Texture2D texture = LoadTextureFromImage(atlas);
+  ox_mem_unmap_file(&file);
+
+  if (texture.id == 0) {
+    MemFree(glyphs);
+    MemFree(recs);
+    return false;
+  }
+
+  *font = (Font){
+    .baseSize = font_size,
+    .glyphCount = glyph_count,
+    .glyphPadding = OX_RENDER_FONT_PADDING,
+    .texture = texture,
+    .recs = recs,
+    .glyphs = glyphs,
+  };
+
+  OX_LOG_DBG("Loaded '%s' from the atlas cache", path);
+  return true;
+}
+
+bool ox_render_font_load(const char* path, const int font_size,
+                         const int glyph_count, Font* font)
+{
+  ox_render_font_raster_t raster;
+  if (!ox_render_font_prepare(&raster, path, font_size, glyph_count) ||
+      !ox_render_font_rasterize(&raster)) {
+    return false;
+  }
+  return ox_render_font_upload(&raster, font);
+}
+
+static int ox_render_font_thread(void* data)
+{
+  ox_render_font_raster_t* raster = data;
+  const bool loaded = ox_render_font_rasterize(raster);
+  atomic_store_explicit(&font_thread_done, true, memory_order_release);
+  return loaded;
+}
+
+bool ox_render_font_load_async(const char* path, const int font_size,
+                               const int glyph_count)
+{
+  if (font_thread_running ||
+      !ox_render_font_prepare(&font_raster, path, font_size, glyph_count)) {
+    return false;
+  }
+
+  atomic_store(&font_thread_done, false);
+  if (thrd_create(&font_thread, ox_render_font_thread, &font_raster) !=
+      thrd_success) {
+    return false;
+  }
+
+  font_thread_running = true;
+  return true;
+}
+
+ox_render_font_status_t ox_render_font_poll(Font* font)
+{
+  if (!font_thread_running ||
+      !atomic_load_explicit(&font_thread_done, memory_order_acquire)) {
+    return OX_RENDER_FONT_PENDING;
+  }
+
+  int loaded = 0;
+  thrd_join(font_thread, &loaded);
+  font_thread_running = false;
+
+  if (!loaded) {
+    OX_LOG_ERR("Failed to rasterize '%s'", font_raster.path);
+    return OX_RENDER_FONT_FAILED;
+  }
+  return ox_render_font_upload(&font_raster, font) ? OX_RENDER_FONT_READY
+                                                   : OX_RENDER_FONT_FAILED;
+}
+
+void ox_render_font_exit(void)
+{
+  if (font_thread_running) {
+    thrd_join(font_thread, NULL);
+    font_thread_running = false;
+    ox_render_font_free_raster(&font_raster);
+  }
+}
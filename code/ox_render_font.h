@@ -0,0 +1,74 @@
+#pragma once
+
+#include "raylib.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Rasterized fonts are kept in an atlas cache, one file per font path and
+// size in the directory named by OX_FONT_CACHE. When unset the cache lives
+// in an "ox" directory of the user's cache directory (LOCALAPPDATA,
+// ~/Library/Caches, XDG_CACHE_HOME or ~/.cache), when empty caching is off.
+// A file is used as long as the font's modification time and length match
+// the ones it was made from. Later launches map it and upload the atlas
+// straight from the mapping.
+//
+// File layout, host byte order: ox_render_font_cache_header_t, the font
+// path padded to 8 bytes, one ox_render_font_cache_glyph_t per glyph, then
+// the atlas pixels.
+#define OX_RENDER_FONT_CACHE_MAGIC   0x43464F58u // "OXFC"
+#define OX_RENDER_FONT_CACHE_VERSION 1
+#define OX_RENDER_FONT_PADDING       4 // LoadFontEx's glyph padding
+#define OX_RENDER_FONT_PATH_MAX      1024
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  int64_t font_mtime;
+  int64_t font_length;
+  int32_t font_size;
+  int32_t glyph_count;
+  int32_t glyph_padding;
+  int32_t atlas_width;
+  int32_t atlas_height;
+  int32_t atlas_format;
+  uint32_t path_length;
+  uint32_t reserved;
+  uint64_t atlas_size;
+} ox_render_font_cache_header_t;
+
+typedef struct {
+  int32_t value;
+  int32_t offset_x;
+  int32_t offset_y;
+  int32_t advance_x;
+  float x; // Atlas rectangle
+  float y;
+  float width;
+  float height;
+} ox_render_font_cache_glyph_t;
+
+// Glyphs are the 'glyph_count' codepoints from 32 on, like LoadFontEx
+// without a codepoint list. Every loader returns false on failure.
+
+bool ox_render_font_load_cached(const char* path, int font_size,
+                                int glyph_count, Font* font);
+
+// Rasterizes on the calling thread and writes the cache
+bool ox_render_font_load(const char* path, int font_size, int glyph_count,
+                         Font* font);
+
+typedef enum {
+  OX_RENDER_FONT_PENDING, // Still rasterizing, or no background load
+  OX_RENDER_FONT_READY,   // The font was handed out
+  OX_RENDER_FONT_FAILED,  // The background load is over without a font
+} ox_render_font_status_t;
+
+// Rasterizes and writes the cache on a background thread, the font is
+// handed out by ox_render_font_poll once it's done
+bool ox_render_font_load_async(const char* path, int font_size,
+                               int glyph_count);
+ox_render_font_status_t ox_render_font_poll(Font* font);
+
+// Waits for a background load and drops its result
+void ox_render_font_exit(void);
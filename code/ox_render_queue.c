@@ -0,0 +1,381 @@
+#include "ox_render.h"
+
+#include "ox_core.h"
+#include "ox_log.h"
+#include "ox_memory.h"
+#include "ox_profile.h"
+
+#include "rlgl.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OX_RENDER_QUEUE_CAPACITY 1024
+#define OX_RENDER_CIRCLE_VERTICES (OX_RENDER_CIRCLE_SEGMENTS * 3)
+
+static_assert(OX_RENDER_VERTICES_MAX % 6 == 0,
+              "Vertex chunks must end on a line and a triangle boundary");
+static_assert(OX_RENDER_VERTICES_MAX >= OX_RENDER_CIRCLE_VERTICES,
+              "A circle must fit in one vertex chunk");
+static_assert(OX_RENDER_MATERIALS_MAX <= 256,
+              "Material indices must fit in 8 bits");
+
+enum {
+  OX_RENDER_TRIANGLES,
+  OX_RENDER_LINES,
+};
+
+enum {
+  OX_RENDER_CIRCLE,
+  OX_RENDER_LINE,
+};
+
+// Sort key, most significant first: layer, shader, texture and material
+// index. The primitive stays out of it so commands of one material keep
+// their push order, a run of equal keys is split where the primitive
+// changes.
+typedef struct {
+  uint64_t key;
+  uint32_t sequence; // Push order, keeps the sort stable
+  uint8_t type;
+  uint8_t primitive;
+  Color color;
+  float data[4]; // Circle: x, y, radius. Line: x1, y1, x2, y2.
+} ox_render_command_t;
+
+typedef struct {
+  Texture2D texture; // id 0 for the rlgl default texture
+  Shader shader;     // id 0 for the rlgl default shader
+} ox_render_material_t;
+
+typedef struct {
+  float x;
+  float y;
+  float u;
+  float v;
+  Color color;
+} ox_render_vertex_t;
+
+// A backend opens a batch, receives its vertices in chunks of whole
+// primitives and closes it again
+typedef struct {
+  void (*begin)(const ox_render_material_t* material, int primitive);
+  void (*submit)(const ox_render_vertex_t* vertices, size_t count);
+  void (*end)(const ox_render_material_t* material);
+} ox_render_backend_ops_t;
+
+static void ox_render_null_begin(const ox_render_material_t* material,
+                                 const int primitive)
+{
+  (void)material;
+  (void)primitive;
+}
+
+static void ox_render_null_submit(const ox_render_vertex_t* vertices,
+                                  const size_t count)
+{
+  (void)vertices;
+  (void)count;
+}
+
+static void ox_render_null_end(const ox_render_material_t* material)
+{
+  (void)material;
+}
+
+static void ox_render_rlgl_begin(const ox_render_material_t* material,
+                                 const int primitive)
+{
+  if (material->shader.id != 0) {
+    rlSetShader(material->shader.id, material->shader.locs);
+  }
+
+  // rlBegin resets the texture of a new draw call, so it goes first. The
+  // default texture is set explicitly, rlgl keeps the last one otherwise.
+  rlBegin(primitive == OX_RENDER_LINES ? RL_LINES : RL_TRIANGLES);
+  rlSetTexture(material->texture.id != 0 ? material->texture.id
+                                         : rlGetTextureIdDefault());
+}
+
+static void ox_render_rlgl_submit(const ox_render_vertex_t* vertices,
+                                  const size_t count)
+{
+  // Flushes the rlgl batch and restores mode and texture when it's full
+  rlCheckRenderBatchLimit((int)count);
+
+  for (size_t i = 0; i < count; ++i) {
+    const ox_render_vertex_t* vertex = &vertices[i];
+    rlColor4ub(vertex->color.r, vertex->color.g, vertex->color.b,
+               vertex->color.a);
+    rlTexCoord2f(vertex->u, vertex->v);
+    rlVertex2f(vertex->x, vertex->y);
+  }
+}
+
+static void ox_render_rlgl_end(const ox_render_material_t* material)
+{
+  rlEnd();
+  rlSetTexture(0);
+
+  if (material->shader.id != 0) {
+    rlSetShader(rlGetShaderIdDefault(), rlGetShaderLocsDefault());
+  }
+}
+
+static const ox_render_backend_ops_t render_backends[] = {
+  [OX_RENDER_BACKEND_NULL] = { ox_render_null_begin, ox_render_null_submit,
+                               ox_render_null_end },
+  [OX_RENDER_BACKEND_RLGL] = { ox_render_rlgl_begin, ox_render_rlgl_submit,
+                               ox_render_rlgl_end },
+};
+
+static ox_render_command_t* render_commands;
+static size_t render_command_count;
+static size_t render_command_capacity;
+
+static ox_render_material_t render_materials[OX_RENDER_MATERIALS_MAX];
+static size_t render_material_count;
+static uint8_t render_material;
+static uint8_t render_layer;
+
+static const ox_render_backend_ops_t* render_backend;
+static ox_render_stats_t render_stats;
+
+// Unit circle in the winding of DrawCircleV, with an extra closing point
+static float render_circle_cos[OX_RENDER_CIRCLE_SEGMENTS + 1];
+static float render_circle_sin[OX_RENDER_CIRCLE_SEGMENTS + 1];
+
+static ox_render_vertex_t render_vertices[OX_RENDER_VERTICES_MAX];
+
+long ox_render_queue_init(void)
+{
+  render_commands = ox_mem_acquire(
+    sizeof(ox_render_command_t) * OX_RENDER_QUEUE_CAPACITY, OX_SOURCE_LOCATION);
+  if (!render_commands) {
+    return OX_FAILURE;
+  }
+
+  render_command_count = 0;
+  render_command_capacity = OX_RENDER_QUEUE_CAPACITY;
+
+  // Material 0 is the default texture and shader
+  memset(render_materials, 0, sizeof(render_materials));
+  render_material_count = 1;
+  render_material = 0;
+  render_layer = 0;
+
+  render_backend = &render_backends[OX_RENDER_BACKEND_NULL];
+  memset(&render_stats, 0, sizeof(render_stats));
+
+  for (int i = 0; i <= OX_RENDER_CIRCLE_SEGMENTS; ++i) {
+    const float angle = 2.f * PI * (float)i / OX_RENDER_CIRCLE_SEGMENTS;
+    render_circle_cos[i] = cosf(angle);
+    render_circle_sin[i] = sinf(angle);
+  }
+
+  return OX_SUCCESS;
+}
+
+void ox_render_queue_exit(void)
+{
+  ox_mem_release(render_commands);
+  render_commands = NULL;
+  render_command_count = 0;
+  render_command_capacity = 0;
+}
+
+void ox_render_set_backend(const ox_render_backend_t backend)
+{
+  render_backend = &render_backends[backend];
+}
+
+void ox_render_set_layer(const int layer)
+{
+  render_layer = (uint8_t)(layer < 0 ? 0 : (layer > 255 ? 255 : layer));
+}
+
+void ox_render_set_material(const Texture2D texture, const Shader shader)
+{
+  for (size_t i = 0; i < render_material_count; ++i) {
+    if (render_materials[i].texture.id == texture.id &&
+        render_materials[i].shader.id == shader.id) {
+      render_material = (uint8_t)i;
+      return;
+    }
+  }
+
+  if (render_material_count == OX_RENDER_MATERIALS_MAX) {
+    OX_LOG_ERR("Too many materials, using the default one");
+    render_material = 0;
+    return;
+  }
+
+  render_materials[render_material_count] = (ox_render_material_t){
+    .texture = texture,
+    .shader = shader,
+  };
+  render_material = (uint8_t)render_material_count++;
+}
+
+void ox_render_reset_material(void)
+{
+  render_material = 0;
+}
+
+static ox_render_command_t* ox_render_push(const int type,
+                                           const int primitive)
+{
+  if (render_command_count == render_command_capacity) {
+    const size_t capacity = render_command_capacity * 2;
+    ox_render_command_t* commands = ox_mem_reclaim(
+      render_commands, sizeof(ox_render_command_t) * capacity,
+      OX_SOURCE_LOCATION);
+    if (!commands) {
+      OX_LOG_ERR("Failed to grow the render queue to %zu commands", capacity);
+      return NULL;
+    }
+    render_commands = commands;
+    render_command_capacity = capacity;
+  }
+
+  const ox_render_material_t* material = &render_materials[render_material];
+  ox_render_command_t* command = &render_commands[render_command_count];
+  command->key = (uint64_t)render_layer << 56 |
+                 (uint64_t)(material->shader.id & 0xFFFF) << 40 |
+                 (uint64_t)(material->texture.id & 0xFFFFFF) << 16 |
+                 render_material;
+  command->sequence = (uint32_t)render_command_count++;
+  command->type = (uint8_t)type;
+  command->primitive = (uint8_t)primitive;
+  return command;
+}
+
+void ox_render_push_circle(const Vector2 center, const float radius,
+                           const Color color)
+{
+  ox_render_command_t* command =
+    ox_render_push(OX_RENDER_CIRCLE, OX_RENDER_TRIANGLES);
+  if (command) {
+    command->color = color;
+    command->data[0] = center.x;
+    command->data[1] = center.y;
+    command->data[2] = radius;
+  }
+}
+
+void ox_render_push_line(const Vector2 start, const Vector2 end,
+                         const Color color)
+{
+  ox_render_command_t* command =
+    ox_render_push(OX_RENDER_LINE, OX_RENDER_LINES);
+  if (command) {
+    command->color = color;
+    command->data[0] = start.x;
+    command->data[1] = start.y;
+    command->data[2] = end.x;
+    command->data[3] = end.y;
+  }
+}
+
+static int ox_render_compare_commands(const void* a, const void* b)
+{
+  const ox_render_command_t* lhs = a;
+  const ox_render_command_t* rhs = b;
+  if (lhs->key != rhs->key) {
+    return lhs->key < rhs->key ? -1 : 1;
+  }
+  return (lhs->sequence > rhs->sequence) - (lhs->sequence < rhs->sequence);
+}
+
+static size_t ox_render_circle_vertices(const ox_render_command_t* command,
+                                        ox_render_vertex_t* vertices)
+{
+  const float x = command->data[0];
+  const float y = command->data[1];
+  const float radius = command->data[2];
+  const ox_render_vertex_t center = { x, y, 0.5f, 0.5f, command->color };
+
+  ox_render_vertex_t* vertex = vertices;
+  for (int i = 0; i < OX_RENDER_CIRCLE_SEGMENTS; ++i) {
+    const float cos0 = render_circle_cos[i];
+    const float sin0 = render_circle_sin[i];
+    const float cos1 = render_circle_cos[i + 1];
+    const float sin1 = render_circle_sin[i + 1];
+
+    *vertex++ = center;
+    *vertex++ = (ox_render_vertex_t){ x + cos1 * radius, y + sin1 * radius,
+                                      0.5f + 0.5f * cos1, 0.5f + 0.5f * sin1,
+                                      command->color };
+    *vertex++ = (ox_render_vertex_t){ x + cos0 * radius, y + sin0 * radius,
+                                      0.5f + 0.5f * cos0, 0.5f + 0.5f * sin0,
+                                      command->color };
+  }
+
+  return OX_RENDER_CIRCLE_VERTICES;
+}
+
+static size_t ox_render_line_vertices(const ox_render_command_t* command,
+                                      ox_render_vertex_t* vertices)
+{
+  vertices[0] = (ox_render_vertex_t){ command->data[0], command->data[1], 0.f,
+                                      0.f, command->color };
+  vertices[1] = (ox_render_vertex_t){ command->data[2], command->data[3], 1.f,
+                                      1.f, command->color };
+  return 2;
+}
+
+void ox_render_flush(void)
+{
+  OX_PROFILE_BEGIN("render flush");
+
+  render_stats = (ox_render_stats_t){ .commands = render_command_count };
+  qsort(render_commands, render_command_count, sizeof(ox_render_command_t),
+        ox_render_compare_commands);
+
+  for (size_t begin = 0; begin < render_command_count;) {
+    const uint64_t key = render_commands[begin].key;
+    const ox_render_material_t* material = &render_materials[key & 0xFF];
+    const int primitive = render_commands[begin].primitive;
+
+    render_backend->begin(material, primitive);
+    ++render_stats.batches;
+
+    // Vertices go out in chunks, a shape never straddles two of them
+    size_t vertex_count = 0;
+    size_t end = begin;
+    for (; end < render_command_count && render_commands[end].key == key &&
+           render_commands[end].primitive == primitive;
+         ++end) {
+      const ox_render_command_t* command = &render_commands[end];
+      const size_t needed =
+        command->type == OX_RENDER_CIRCLE ? OX_RENDER_CIRCLE_VERTICES : 2;
+      if (vertex_count + needed > OX_RENDER_VERTICES_MAX) {
+        render_backend->submit(render_vertices, vertex_count);
+        render_stats.vertices += vertex_count;
+        vertex_count = 0;
+      }
+
+      vertex_count += command->type == OX_RENDER_CIRCLE
+                        ? ox_render_circle_vertices(
+                            command, &render_vertices[vertex_count])
+                        : ox_render_line_vertices(
+                            command, &render_vertices[vertex_count]);
+    }
+
+    render_backend->submit(render_vertices, vertex_count);
+    render_stats.vertices += vertex_count;
+    render_backend->end(material);
+    begin = end;
+  }
+
+  render_command_count = 0;
+  OX_PROFILE_END();
+}
+
+void ox_render_get_stats(ox_render_stats_t* stats)
+{
+  *stats = render_stats;
+}
@@ -0,0 +1,297 @@
+#include "ox_render_text.h"
+
+#include "ox_core.h"
+#include "ox_memory.h"
+#include "ox_render.h"
+
+#include "rlgl.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+static_assert(OX_RENDER_TEXT_ENTRIES % OX_RENDER_TEXT_WAYS == 0,
+              "Entries must fill whole sets");
+static_assert(((OX_RENDER_TEXT_ENTRIES / OX_RENDER_TEXT_WAYS) &
+               (OX_RENDER_TEXT_ENTRIES / OX_RENDER_TEXT_WAYS - 1)) == 0,
+              "The set count must be a power of two");
+static_assert(OX_RENDER_TEXT_LENGTH_MAX <= UINT16_MAX,
+              "Byte offsets must fit in 16 bits");
+
+// Positions are relative to the text position. 'end' and the pen position
+// after the glyph tell where layout resumes when the text up to 'end' is
+// taken over by another layout.
+typedef struct {
+  float x0;
+  float y0;
+  float x1;
+  float y1;
+  float u0;
+  float v0;
+  float u1;
+  float v1;
+  float pen_x;
+  float pen_y;
+  uint16_t end;
+} ox_render_glyph_quad_t;
+
+typedef struct {
+  uint64_t hash;
+  unsigned texture;
+  const GlyphInfo* glyphs; // Tells fonts sharing a texture id apart
+  float font_size;
+  float spacing;
+  uint64_t used; // Last lookup, 0 for a free entry
+  int length;
+  int quad_count;
+  char text[OX_RENDER_TEXT_LENGTH_MAX];
+  ox_render_glyph_quad_t quads[OX_RENDER_TEXT_LENGTH_MAX];
+} ox_render_text_entry_t;
+
+static ox_render_text_entry_t* text_entries;
+static uint64_t text_clock;
+static ox_render_text_stats_t text_stats;
+
+long ox_render_text_init(void)
+{
+  text_entries =
+    ox_mem_acquire(sizeof(ox_render_text_entry_t) * OX_RENDER_TEXT_ENTRIES,
+                   OX_SOURCE_LOCATION);
+  if (!text_entries) {
+    return OX_FAILURE;
+  }
+
+  ox_render_text_clear();
+  text_clock = 0;
+  memset(&text_stats, 0, sizeof(text_stats));
+  return OX_SUCCESS;
+}
+
+void ox_render_text_exit(void)
+{
+  ox_mem_release(text_entries);
+  text_entries = NULL;
+}
+
+void ox_render_text_clear(void)
+{
+  if (!text_entries) {
+    return;
+  }
+
+  for (size_t i = 0; i < OX_RENDER_TEXT_ENTRIES; ++i) {
+    text_entries[i].used = 0;
+  }
+}
+
+void ox_render_get_text_stats(ox_render_text_stats_t* stats)
+{
+  *stats = text_stats;
+}
+
+static bool ox_render_text_same_font(const ox_render_text_entry_t* entry,
+                                     const Font* font, const float font_size,
+                                     const float spacing)
+{
+  return entry->used != 0 && entry->texture == font->texture.id &&
+         entry->glyphs == font->glyphs && entry->font_size == font_size &&
+         entry->spacing == spacing;
+}
+
+// Lays 'text' out into 'entry', reusing the glyphs of the longest prefix
+// some other cached layout of the same font already has
+static void ox_render_text_layout(ox_render_text_entry_t* entry,
+                                  const Font* font, const char* text,
+                                  const int length)
+{
+  const ox_render_text_entry_t* donor = NULL;
+  int donor_prefix = 0;
+  for (size_t i = 0; i < OX_RENDER_TEXT_ENTRIES; ++i) {
+    const ox_render_text_entry_t* other = &text_entries[i];
+    if (other == entry || !ox_render_text_same_font(other, font,
+                                                     entry->font_size,
+                                                     entry->spacing)) {
+      continue;
+    }
+
+    const int limit = other->length < length ? other->length : length;
+    int prefix = 0;
+    while (prefix < limit && other->text[prefix] == text[prefix]) {
+      ++prefix;
+    }
+    if (prefix > donor_prefix) {
+      donor = other;
+      donor_prefix = prefix;
+    }
+  }
+
+  // Glyphs that end within the common prefix are placed the same way in
+  // both texts, layout resumes behind the last of them
+  int quad_count = 0;
+  int start = 0;
+  float pen_x = 0.f;
+  float pen_y = 0.f;
+  if (donor) {
+    while (quad_count < donor->quad_count &&
+           donor->quads[quad_count].end <= donor_prefix) {
+      ++quad_count;
+    }
+    memcpy(entry->quads, donor->quads,
+           sizeof(ox_render_glyph_quad_t) * (size_t)quad_count);
+    if (quad_count > 0) {
+      start = entry->quads[quad_count - 1].end;
+      pen_x = entry->quads[quad_count - 1].pen_x;
+      pen_y = entry->quads[quad_count - 1].pen_y;
+    }
+    text_stats.glyphs_reused += (size_t)quad_count;
+  }
+
+  // Mirrors DrawTextEx and DrawTextCodepoint
+  const float scale = entry->font_size / (float)font->baseSize;
+  const float padding = (float)font->glyphPadding;
+  const float texture_width = (float)font->texture.width;
+  const float texture_height = (float)font->texture.height;
+
+  for (int i = start; i < length;) {
+    int bytes = 0;
+    const int codepoint = GetCodepointNext(&text[i], &bytes);
+    const int index = GetGlyphIndex(*font, codepoint);
+    i += bytes;
+
+    if (codepoint == '\n') {
+      pen_x = 0.f;
+      pen_y += entry->font_size + OX_RENDER_TEXT_LINE_SPACING;
+      continue;
+    }
+
+    const GlyphInfo* glyph = &font->glyphs[index];
+    const Rectangle* rec = &font->recs[index];
+    const float x = pen_x;
+    const float advance =
+      glyph->advanceX == 0 ? rec->width : (float)glyph->advanceX;
+    pen_x += advance * scale + entry->spacing;
+
+    if (codepoint == ' ' || codepoint == '\t') {
+      continue;
+    }
+
+    ox_render_glyph_quad_t* quad = &entry->quads[quad_count++];
+    quad->x0 = x + ((float)glyph->offsetX - padding) * scale;
+    quad->y0 = pen_y + ((float)glyph->offsetY - padding) * scale;
+    quad->x1 = quad->x0 + (rec->width + 2.f * padding) * scale;
+    quad->y1 = quad->y0 + (rec->height + 2.f * padding) * scale;
+    quad->u0 = (rec->x - padding) / texture_width;
+    quad->v0 = (rec->y - padding) / texture_height;
+    quad->u1 = (rec->x + rec->width + padding) / texture_width;
+    quad->v1 = (rec->y + rec->height + padding) / texture_height;
+    quad->pen_x = pen_x;
+    quad->pen_y = pen_y;
+    quad->end = (uint16_t)i;
+    ++text_stats.glyphs_laid_out;
+  }
+
+  entry->quad_count = quad_count;
+  entry->length = length;
+  memcpy(entry->text, text, (size_t)length);
+}
+
+static const ox_render_text_entry_t*
+ox_render_text_lookup(const Font* font, const char* text, const int length,
+                      const uint64_t hash, const float font_size,
+                      const float spacing)
+{
+  const size_t sets = OX_RENDER_TEXT_ENTRIES / OX_RENDER_TEXT_WAYS;
+  ox_render_text_entry_t* set =
+    &text_entries[(hash & (sets - 1)) * OX_RENDER_TEXT_WAYS];
+  ox_render_text_entry_t* victim = &set[0];
+  ++text_clock;
+
+  for (int way = 0; way < OX_RENDER_TEXT_WAYS; ++way) {
+    ox_render_text_entry_t* entry = &set[way];
+    if (entry->hash == hash && entry->length == length &&
+        ox_render_text_same_font(entry, font, font_size, spacing) &&
+        memcmp(entry->text, text, (size_t)length) == 0) {
+      entry->used = text_clock;
+      ++text_stats.hits;
+      return entry;
+    }
+
+    if (entry->used < victim->used) {
+      victim = entry;
+    }
+  }
+
+  // The least recently used way is laid out again. It's taken out of the
+  // cache first, so it can't donate glyphs to itself.
+  ++text_stats.misses;
+  victim->used = 0;
+  victim->hash = hash;
+  victim->texture = font->texture.id;
+  victim->glyphs = font->glyphs;
+  victim->font_size = font_size;
+  victim->spacing = spacing;
+  ox_render_text_layout(victim, font, text, length);
+  victim->used = text_clock;
+  return victim;
+}
+
+static void ox_render_text_emit(const ox_render_text_entry_t* entry,
+                                const Texture2D texture,
+                                const Vector2 position, const Color tint)
+{
+  if (entry->quad_count == 0) {
+    return;
+  }
+
+  rlCheckRenderBatchLimit(4 * entry->quad_count);
+  rlSetTexture(texture.id);
+  rlBegin(RL_QUADS);
+  rlColor4ub(tint.r, tint.g, tint.b, tint.a);
+  rlNormal3f(0.f, 0.f, 1.f);
+
+  // Corner order of DrawTexturePro
+  for (int i = 0; i < entry->quad_count; ++i) {
+    const ox_render_glyph_quad_t* quad = &entry->quads[i];
+    const float x0 = position.x + quad->x0;
+    const float y0 = position.y + quad->y0;
+    const float x1 = position.x + quad->x1;
+    const float y1 = position.y + quad->y1;
+
+    rlTexCoord2f(quad->u0, quad->v0);
+    rlVertex2f(x0, y0);
+    rlTexCoord2f(quad->u0, quad->v1);
+    rlVertex2f(x0, y1);
+    rlTexCoord2f(quad->u1, quad->v1);
+    rlVertex2f(x1, y1);
+    rlTexCoord2f(quad->u1, quad->v0);
+    rlVertex2f(x1, y0);
+  }
+
+  rlEnd();
+  rlSetTexture(0);
+}
+
+void ox_render_text_draw(Font font, const char* text, const Vector2 position,
+                         const float font_size, const float spacing,
+                         const Color tint)
+{
+  if (font.texture.id == 0) {
+    font = GetFontDefault();
+  }
+
+  // FNV-1a, stops early on texts too long to cache
+  uint64_t hash = 0xCBF29CE484222325ull;
+  int length = 0;
+  while (text[length] && length < OX_RENDER_TEXT_LENGTH_MAX) {
+    hash = (hash ^ (unsigned char)text[length++]) * 0x100000001B3ull;
+  }
+
+  if (!text_entries || text[length]) {
+    DrawTextEx(font, text, position, font_size, spacing, tint);
+    return;
+  }
+
+  const ox_render_text_entry_t* entry =
+    ox_render_text_lookup(&font, text, length, hash, font_size, spacing);
+  ox_render_text_emit(entry, font.texture, position, tint);
+}
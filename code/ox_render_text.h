@@ -0,0 +1,28 @@
+#pragma once
+
+#include "raylib.h"
+
+// Text layout cache behind ox_render_draw_text. A layout keeps the glyph
+// quads of one (font, text, size, spacing) relative to the text position and
+// is drawn again as a single batch. A text that is not cached yet takes the
+// glyphs of its longest cached prefix over and only lays out the rest, so a
+// changing counter redoes only its last digits.
+
+#define OX_RENDER_TEXT_ENTRIES    128
+#define OX_RENDER_TEXT_WAYS       4
+#define OX_RENDER_TEXT_LENGTH_MAX 128
+
+// Line spacing DrawTextEx applies after '\n', raylib's default
+#define OX_RENDER_TEXT_LINE_SPACING 2
+
+long ox_render_text_init(void);
+void ox_render_text_exit(void);
+
+// Drops every layout. Call it when a font is unloaded or replaced, a later
+// font may get the same texture id and glyph array address.
+void ox_render_text_clear(void);
+
+// Same output as DrawTextEx, texts longer than OX_RENDER_TEXT_LENGTH_MAX
+// bytes are handed to it uncached
+void ox_render_text_draw(Font font, const char* text, Vector2 position,
+                         float font_size, float spacing, Color tint);
@@ -0,0 +1,143 @@
+#include "ox_scheduler.h"
+
+#include "ox_core.h"
+#include "ox_log.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static bool ox_system_conflicts(const ox_system_t* a, const ox_system_t* b)
+{
+  return !ox_component_mask_excludes(&a->writes, &b->writes) ||
+         !ox_component_mask_excludes(&a->writes, &b->reads) ||
+         !ox_component_mask_excludes(&a->reads, &b->writes);
+}
+
+// Job body: runs one system, then releases the systems waiting on it
+static void ox_scheduler_job(void* data, const size_t system, const size_t end)
+{
+  (void)end;
+  ox_scheduler_t* scheduler = data;
+
+  const ox_system_t* self = &scheduler->systems[system];
+  self->run(scheduler->world, self->query, &scheduler->commands,
+            self->userdata);
+
+  const uint64_t* dependents = scheduler->dependents[system];
+  for (int word = 0; word < OX_SCHEDULER_SYSTEM_WORDS; ++word) {
+    uint64_t bits = dependents[word];
+    while (bits) {
+      const size_t next = (size_t)word * 64 + ox_ctz64(bits);
+      bits &= bits - 1;
+      if (atomic_fetch_sub(&scheduler->pending[next], 1) == 1) {
+        ox_job_submit(ox_scheduler_job, scheduler, next, next,
+                      &scheduler->counter);
+      }
+    }
+  }
+}
+
+long ox_scheduler_init(ox_scheduler_t* scheduler, ox_world_t* world)
+{
+  memset(scheduler, 0, sizeof(*scheduler));
+  scheduler->world = world;
+  ox_job_counter_init(&scheduler->counter);
+  ox_command_queue_init(&scheduler->commands, world);
+  return OX_SUCCESS;
+}
+
+void ox_scheduler_term(ox_scheduler_t* scheduler)
+{
+  ox_command_queue_term(&scheduler->commands);
+  scheduler->system_count = 0;
+}
+
+ox_system_id ox_scheduler_register(ox_scheduler_t* scheduler,
+                                   const ox_system_desc_t* desc)
+{
+  if (scheduler->system_count >= OX_SCHEDULER_SYSTEMS_MAX) {
+    OX_LOG_ERR("Too many systems, can't register '%s'", desc->name);
+    return (ox_system_id){ OX_INVALID_ID };
+  }
+
+  const ox_query_id query =
+    ox_world_register_query(scheduler->world, &desc->query);
+  if (query.value == OX_INVALID_ID) {
+    return (ox_system_id){ OX_INVALID_ID };
+  }
+
+  const ox_system_id id = { (int)scheduler->system_count++ };
+  ox_system_t* system = &scheduler->systems[id.value];
+  system->name = desc->name;
+  system->run = desc->run;
+  system->userdata = desc->userdata;
+  system->query = query;
+  system->enabled = true;
+
+  // Columns the query yields are read at least, so a system writing one it
+  // didn't list in 'writes' still waits on the systems writing it
+  ox_component_mask_init(&system->reads);
+  for (size_t i = 0; i < desc->query.include_count; ++i) {
+    ox_component_mask_set(&system->reads, desc->query.include[i]);
+  }
+  for (size_t i = 0; i < desc->read_count; ++i) {
+    ox_component_mask_set(&system->reads, desc->reads[i]);
+  }
+
+  ox_component_mask_init(&system->writes);
+  for (size_t i = 0; i < desc->write_count; ++i) {
+    ox_component_mask_set(&system->writes, desc->writes[i]);
+  }
+
+  OX_LOG_DBG("Registered system '%s' (id: %d)", desc->name, id.value);
+  return id;
+}
+
+void ox_scheduler_set_enabled(ox_scheduler_t* scheduler,
+                              const ox_system_id system, const bool enabled)
+{
+  scheduler->systems[system.value].enabled = enabled;
+}
+
+static void ox_scheduler_build_graph(ox_scheduler_t* scheduler)
+{
+  memset(scheduler->dependents, 0, sizeof(scheduler->dependents));
+
+  // Registration order breaks ties, so for any conflicting pair the system
+  // registered first runs first
+  for (size_t j = 0; j < scheduler->system_count; ++j) {
+    const ox_system_t* system = &scheduler->systems[j];
+    int pending = 0;
+
+    if (system->enabled) {
+      for (size_t i = 0; i < j; ++i) {
+        const ox_system_t* before = &scheduler->systems[i];
+        if (before->enabled && ox_system_conflicts(before, system)) {
+          scheduler->dependents[i][j / 64] |= (uint64_t)1 << (j % 64);
+          pending++;
+        }
+      }
+    }
+
+    atomic_store(&scheduler->pending[j], pending);
+  }
+}
+
+void ox_scheduler_run(ox_scheduler_t* scheduler)
+{
+  ox_scheduler_build_graph(scheduler);
+
+  // Only roots are queued here, every other system is queued by the job of
+  // its last finishing dependency
+  for (size_t i = 0; i < scheduler->system_count; ++i) {
+    if (scheduler->systems[i].enabled &&
+        atomic_load(&scheduler->pending[i]) == 0) {
+      ox_job_submit(ox_scheduler_job, scheduler, i, i, &scheduler->counter);
+    }
+  }
+
+  ox_job_wait(&scheduler->counter);
+
+  // Sync point, no system is iterating chunks anymore
+  ox_command_queue_flush(&scheduler->commands);
+}
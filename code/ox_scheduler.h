@@ -0,0 +1,107 @@
+/**
+ * @file ox_scheduler.h
+ * @brief ECS system registration and parallel frame scheduling
+ *
+ * Each system declares the components it reads and writes, the include
+ * terms of its query always count as read. Every frame the scheduler orders
+ * systems by registration and adds an edge from an earlier system to a
+ * later one when their sets conflict (write/write or read/write). Systems
+ * without a path between them run concurrently as jobs on the job system.
+ * Structural changes are recorded into the scheduler's command queue and
+ * applied once every system of the frame has finished.
+ */
+
+#pragma once
+
+#include "ox_command.h"
+#include "ox_ecs.h"
+#include "ox_job.h"
+
+#define OX_SCHEDULER_SYSTEMS_MAX 256
+
+#define OX_SCHEDULER_SYSTEM_WORDS (OX_SCHEDULER_SYSTEMS_MAX / 64)
+
+typedef void (*ox_system_fn)(ox_world_t* world, ox_query_id query,
+                             ox_command_queue_t* commands, void* userdata);
+
+/**
+ * @brief System registration parameters
+ */
+typedef struct {
+  const char* name;              /**< Name used in logs */
+  ox_system_fn run;              /**< Called once per frame */
+  void* userdata;                /**< Passed to run */
+  ox_query_desc_t query;         /**< Query handed to run */
+  const ox_component_id* reads;  /**< Read beyond the query's includes */
+  size_t read_count;             /**< Number of entries in reads */
+  const ox_component_id* writes; /**< Components written */
+  size_t write_count;            /**< Number of entries in writes */
+} ox_system_desc_t;
+
+typedef struct {
+  const char* name;
+  ox_system_fn run;
+  void* userdata;
+  ox_query_id query;
+  ox_component_mask_t reads;
+  ox_component_mask_t writes;
+  bool enabled;
+} ox_system_t;
+
+typedef struct {
+  ox_world_t* world;
+
+  ox_system_t systems[OX_SCHEDULER_SYSTEMS_MAX];
+  size_t system_count;
+
+  // Per-frame DAG: bit j of dependents[i] is set if j must wait for i
+  uint64_t dependents[OX_SCHEDULER_SYSTEMS_MAX][OX_SCHEDULER_SYSTEM_WORDS];
+  atomic_int pending[OX_SCHEDULER_SYSTEMS_MAX];
+
+  // Counts the system jobs of the frame in flight
+  ox_job_counter_t counter;
+
+  // Deferred structural changes, flushed at the end of every run
+  ox_command_queue_t commands;
+} ox_scheduler_t;
+
+/**
+ * @brief Initialize a scheduler
+ * @param scheduler Scheduler to initialize
+ * @param world World passed to every system
+ * @return OX_SUCCESS or OX_FAILURE
+ */
+long ox_scheduler_init(ox_scheduler_t* scheduler, ox_world_t* world);
+
+/**
+ * @brief Release scheduler resources
+ * @param scheduler Scheduler to terminate
+ */
+void ox_scheduler_term(ox_scheduler_t* scheduler);
+
+/**
+ * @brief Register a system and its query
+ * @param scheduler Scheduler to register with
+ * @param desc System description
+ * @return System id, value OX_INVALID_ID on failure
+ */
+ox_system_id ox_scheduler_register(ox_scheduler_t* scheduler,
+                                   const ox_system_desc_t* desc);
+
+/**
+ * @brief Enable or disable a system for following frames
+ * @param scheduler Scheduler owning the system
+ * @param system System to toggle
+ * @param enabled New state
+ */
+void ox_scheduler_set_enabled(ox_scheduler_t* scheduler, ox_system_id system,
+                              bool enabled);
+
+/**
+ * @brief Run every enabled system once, returning when all have finished
+ * @param scheduler Scheduler to run
+ *
+ * The calling thread executes systems alongside the job workers. Commands
+ * recorded by the systems are flushed before returning.
+ */
+void ox_scheduler_run(ox_scheduler_t* scheduler);
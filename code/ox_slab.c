@@ -0,0 +1,464 @@
+#include "ox_slab.h"
+
+#ifdef OX_MEM_USE_SLAB
+
+#include "ox_core.h"
+#include "ox_log.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+// Class index stored in the header of blocks that bypass the slabs
+#define OX_SLAB_LARGE UINT32_MAX
+
+// Sizes up to this are resolved through a lookup table in 16-byte steps
+#define OX_SLAB_LOOKUP_MAX 1024
+
+// Alignment every payload gets without asking
+#define OX_SLAB_ALIGN_LOG2 4
+
+// Precedes every payload, keeps it 16-byte aligned. Aligned payloads may
+// sit further into their block, 'offset' leads back to its start.
+typedef struct {
+  uint32_t size_class;
+  uint16_t offset;
+  uint8_t align_log2;
+  uint8_t unused;
+  uint64_t size;
+} ox_slab_header_t;
+
+static_assert(sizeof(ox_slab_header_t) == 16, "Slab header must be 16 bytes");
+
+typedef struct ox_slab_free {
+  struct ox_slab_free* next;
+} ox_slab_free_t;
+
+typedef struct {
+  mtx_t mtx;
+  ox_slab_free_t* head;
+  size_t count;
+  size_t acquired;
+  size_t released;
+  size_t refills;
+  size_t reserved;
+} ox_slab_class_t;
+
+typedef struct {
+  ox_slab_free_t* head;
+  uint32_t count;
+  size_t acquired;
+  size_t released;
+} ox_slab_bin_t;
+
+typedef struct {
+  ox_slab_bin_t bins[OX_SLAB_CLASS_COUNT];
+  bool registered;
+} ox_slab_cache_t;
+
+// OS blocks are chained through their first bytes
+typedef struct ox_slab_block {
+  struct ox_slab_block* next;
+  uint64_t unused;
+} ox_slab_block_t;
+
+// Four classes per power of two keeps the rounding waste under 25%
+static const uint32_t slab_sizes[OX_SLAB_CLASS_COUNT] = {
+  16,   32,   48,   64,   80,   96,    112,   128,   160,   192,   224,   256,
+  320,  384,  448,  512,  640,  768,   896,   1024,  1280,  1536,  1792,  2048,
+  2560, 3072, 3584, 4096, 5120, 6144,  7168,  8192,  10240, 12288, 14336, 16384,
+};
+
+static uint8_t slab_lookup[OX_SLAB_LOOKUP_MAX / 16 + 1];
+static ox_slab_class_t slab_classes[OX_SLAB_CLASS_COUNT];
+
+static mtx_t slab_block_mtx;
+static ox_slab_block_t* slab_blocks;
+static char* slab_bump;
+static size_t slab_bump_left;
+
+static tss_t slab_cache_key;
+static thread_local ox_slab_cache_t slab_cache;
+
+static_assert(OX_SLAB_SIZE_MAX == 16384, "Size table and limit disagree");
+
+static void* ox_slab_os_acquire(const size_t size)
+{
+#ifdef _WIN32
+  return VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+  void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return mem == MAP_FAILED ? NULL : mem;
+#endif
+}
+
+static void ox_slab_os_release(void* mem, const size_t size)
+{
+#ifdef _WIN32
+  (void)size;
+  VirtualFree(mem, 0, MEM_RELEASE);
+#else
+  munmap(mem, size);
+#endif
+}
+
+// Class able to hold 'total' bytes (header included), 'total' must not
+// exceed OX_SLAB_SIZE_MAX
+static uint32_t ox_slab_class_of(const size_t total)
+{
+  if (total <= OX_SLAB_LOOKUP_MAX) {
+    return slab_lookup[(total + 15) >> 4];
+  }
+
+  uint32_t index = slab_lookup[OX_SLAB_LOOKUP_MAX >> 4];
+  while (slab_sizes[index] < total) {
+    index++;
+  }
+  return index;
+}
+
+// Blocks moved between a thread cache and the shared list at once
+static uint32_t ox_slab_batch(const uint32_t size_class)
+{
+  const uint32_t batch = 8192 / slab_sizes[size_class];
+  return batch < 4 ? 4 : batch > 64 ? 64 : batch;
+}
+
+// Carves one span from the current OS block, called with the class locked
+static long ox_slab_carve(ox_slab_class_t* slab_class, const uint32_t size)
+{
+  mtx_lock(&slab_block_mtx);
+  if (slab_bump_left < OX_SLAB_SPAN_SIZE) {
+    ox_slab_block_t* block = ox_slab_os_acquire(OX_SLAB_BLOCK_SIZE);
+    if (!block) {
+      mtx_unlock(&slab_block_mtx);
+      return OX_FAILURE;
+    }
+
+    // The tail of the previous block (less than a span) is abandoned
+    block->next = slab_blocks;
+    slab_blocks = block;
+    slab_bump = (char*)block + sizeof(ox_slab_block_t);
+    slab_bump_left = OX_SLAB_BLOCK_SIZE - sizeof(ox_slab_block_t);
+  }
+
+  char* span = slab_bump;
+  slab_bump += OX_SLAB_SPAN_SIZE;
+  slab_bump_left -= OX_SLAB_SPAN_SIZE;
+  mtx_unlock(&slab_block_mtx);
+
+  const size_t count = OX_SLAB_SPAN_SIZE / size;
+  for (size_t i = count; i-- > 0;) {
+    ox_slab_free_t* entry = (ox_slab_free_t*)&span[i * size];
+    entry->next = slab_class->head;
+    slab_class->head = entry;
+  }
+  slab_class->count += count;
+  slab_class->reserved += count * size;
+  return OX_SUCCESS;
+}
+
+// Folds the counters of a bin into its class, called with the class locked
+static void ox_slab_fold(ox_slab_class_t* slab_class, ox_slab_bin_t* bin)
+{
+  slab_class->acquired += bin->acquired;
+  slab_class->released += bin->released;
+  bin->acquired = 0;
+  bin->released = 0;
+}
+
+static bool ox_slab_refill(ox_slab_bin_t* bin, const uint32_t size_class)
+{
+  ox_slab_class_t* slab_class = &slab_classes[size_class];
+  const uint32_t batch = ox_slab_batch(size_class);
+
+  mtx_lock(&slab_class->mtx);
+  ox_slab_fold(slab_class, bin);
+  slab_class->refills++;
+
+  if (slab_class->count < batch &&
+      ox_slab_carve(slab_class, slab_sizes[size_class]) != OX_SUCCESS &&
+      slab_class->count == 0) {
+    mtx_unlock(&slab_class->mtx);
+    return false;
+  }
+
+  const uint32_t take =
+    slab_class->count < batch ? (uint32_t)slab_class->count : batch;
+  ox_slab_free_t* first = slab_class->head;
+  ox_slab_free_t* last = first;
+  for (uint32_t i = 1; i < take; ++i) {
+    last = last->next;
+  }
+  slab_class->head = last->next;
+  slab_class->count -= take;
+  mtx_unlock(&slab_class->mtx);
+
+  last->next = bin->head;
+  bin->head = first;
+  bin->count += take;
+  return true;
+}
+
+// Gives 'count' blocks from the front of the bin back to the shared list
+static void ox_slab_drain(ox_slab_bin_t* bin, const uint32_t size_class,
+                          const uint32_t count)
+{
+  ox_slab_class_t* slab_class = &slab_classes[size_class];
+
+  ox_slab_free_t* first = bin->head;
+  ox_slab_free_t* last = first;
+  for (uint32_t i = 1; i < count; ++i) {
+    last = last->next;
+  }
+  bin->head = last->next;
+  bin->count -= count;
+
+  mtx_lock(&slab_class->mtx);
+  ox_slab_fold(slab_class, bin);
+  last->next = slab_class->head;
+  slab_class->head = first;
+  slab_class->count += count;
+  mtx_unlock(&slab_class->mtx);
+}
+
+static void ox_slab_cache_flush(void* data)
+{
+  ox_slab_cache_t* cache = data;
+  for (uint32_t i = 0; i < OX_SLAB_CLASS_COUNT; ++i) {
+    ox_slab_bin_t* bin = &cache->bins[i];
+    if (bin->count != 0) {
+      ox_slab_drain(bin, i, bin->count);
+    } else if (bin->acquired != 0 || bin->released != 0) {
+      mtx_lock(&slab_classes[i].mtx);
+      ox_slab_fold(&slab_classes[i], bin);
+      mtx_unlock(&slab_classes[i].mtx);
+    }
+  }
+  cache->registered = false;
+}
+
+// The key destructor gives the cache back when the thread exits
+static ox_slab_cache_t* ox_slab_local(void)
+{
+  ox_slab_cache_t* cache = &slab_cache;
+  if (!cache->registered) {
+    cache->registered = true;
+    tss_set(slab_cache_key, cache);
+  }
+  return cache;
+}
+
+long ox_slab_init(void)
+{
+  uint32_t index = 0;
+  for (size_t i = 0; i < OX_ARRAY_SIZE(slab_lookup); ++i) {
+    while (slab_sizes[index] < i * 16) {
+      index++;
+    }
+    slab_lookup[i] = (uint8_t)index;
+  }
+
+  if (mtx_init(&slab_block_mtx, mtx_plain) != thrd_success) {
+    return OX_FAILURE;
+  }
+
+  for (size_t i = 0; i < OX_SLAB_CLASS_COUNT; ++i) {
+    if (mtx_init(&slab_classes[i].mtx, mtx_plain) != thrd_success) {
+      while (i-- > 0) {
+        mtx_destroy(&slab_classes[i].mtx);
+      }
+      mtx_destroy(&slab_block_mtx);
+      return OX_FAILURE;
+    }
+  }
+
+  if (tss_create(&slab_cache_key, ox_slab_cache_flush) != thrd_success) {
+    for (size_t i = 0; i < OX_SLAB_CLASS_COUNT; ++i) {
+      mtx_destroy(&slab_classes[i].mtx);
+    }
+    mtx_destroy(&slab_block_mtx);
+    return OX_FAILURE;
+  }
+
+  return OX_SUCCESS;
+}
+
+void ox_slab_exit(void)
+{
+  // Other threads are gone by now, their caches were flushed on exit
+  memset(&slab_cache, 0, sizeof(slab_cache));
+  tss_delete(slab_cache_key);
+
+  while (slab_blocks) {
+    ox_slab_block_t* next = slab_blocks->next;
+    ox_slab_os_release(slab_blocks, OX_SLAB_BLOCK_SIZE);
+    slab_blocks = next;
+  }
+  slab_bump = NULL;
+  slab_bump_left = 0;
+
+  for (size_t i = 0; i < OX_SLAB_CLASS_COUNT; ++i) {
+    mtx_destroy(&slab_classes[i].mtx);
+    memset(&slab_classes[i], 0, sizeof(slab_classes[i]));
+  }
+  mtx_destroy(&slab_block_mtx);
+}
+
+// Takes a raw block of at least 'total' bytes from a class bin or, past the
+// largest class, from malloc
+static void* ox_slab_block(const size_t total, uint32_t* size_class)
+{
+  if (total > OX_SLAB_SIZE_MAX) {
+    *size_class = OX_SLAB_LARGE;
+    return malloc(total);
+  }
+
+  *size_class = ox_slab_class_of(total);
+  ox_slab_bin_t* bin = &ox_slab_local()->bins[*size_class];
+  if (!bin->head && !ox_slab_refill(bin, *size_class)) {
+    return NULL;
+  }
+
+  ox_slab_free_t* block = bin->head;
+  bin->head = block->next;
+  bin->count--;
+  bin->acquired++;
+  return block;
+}
+
+void* ox_slab_acquire(const size_t size)
+{
+  uint32_t size_class;
+  ox_slab_header_t* header =
+    ox_slab_block(size + sizeof(ox_slab_header_t), &size_class);
+  if (!header) {
+    return NULL;
+  }
+
+  header->size_class = size_class;
+  header->offset = 0;
+  header->align_log2 = OX_SLAB_ALIGN_LOG2;
+  header->size = size;
+  return header + 1;
+}
+
+void* ox_slab_acquire_aligned(const size_t size, const size_t alignment)
+{
+  if (alignment <= ((size_t)1 << OX_SLAB_ALIGN_LOG2)) {
+    return ox_slab_acquire(size);
+  }
+
+  // Blocks start 16-byte aligned, so at most alignment - 16 bytes are
+  // skipped to reach the first aligned payload after the header
+  uint32_t size_class;
+  char* block = ox_slab_block(size + sizeof(ox_slab_header_t) + alignment -
+                                (1u << OX_SLAB_ALIGN_LOG2),
+                              &size_class);
+  if (!block) {
+    return NULL;
+  }
+
+  const uintptr_t start = (uintptr_t)block + sizeof(ox_slab_header_t);
+  const uintptr_t payload =
+    (start + alignment - 1) & ~(uintptr_t)(alignment - 1);
+  ox_slab_header_t* header = (ox_slab_header_t*)payload - 1;
+
+  header->size_class = size_class;
+  header->offset = (uint16_t)((char*)header - block);
+  header->align_log2 = (uint8_t)ox_ctz64(alignment);
+  header->size = size;
+  return header + 1;
+}
+
+void ox_slab_release(void* mem)
+{
+  ox_slab_header_t* header = (ox_slab_header_t*)mem - 1;
+  const uint32_t size_class = header->size_class;
+  char* block = (char*)header - header->offset;
+
+  if (size_class == OX_SLAB_LARGE) {
+    free(block);
+    return;
+  }
+
+  ox_slab_bin_t* bin = &ox_slab_local()->bins[size_class];
+  ox_slab_free_t* entry = (ox_slab_free_t*)block;
+  entry->next = bin->head;
+  bin->head = entry;
+  bin->count++;
+  bin->released++;
+
+  // Keeps up to two batches, so alternating acquire/release stays local
+  const uint32_t batch = ox_slab_batch(size_class);
+  if (bin->count >= batch * 2) {
+    ox_slab_drain(bin, size_class, batch);
+  }
+}
+
+void* ox_slab_reclaim(void* mem, const size_t size)
+{
+  ox_slab_header_t* header = (ox_slab_header_t*)mem - 1;
+  const size_t total = size + sizeof(ox_slab_header_t);
+  const bool aligned = header->align_log2 != OX_SLAB_ALIGN_LOG2;
+
+  if (!aligned && header->size_class == OX_SLAB_LARGE &&
+      total > OX_SLAB_SIZE_MAX) {
+    header = realloc(header, total);
+    if (!header) {
+      return NULL;
+    }
+    header->size = size;
+    return header + 1;
+  }
+
+  // Shrinking or growing within the class keeps the block
+  if (header->size_class != OX_SLAB_LARGE &&
+      total + header->offset <= slab_sizes[header->size_class]) {
+    header->size = size;
+    return mem;
+  }
+
+  void* grown =
+    ox_slab_acquire_aligned(size, (size_t)1 << header->align_log2);
+  if (!grown) {
+    return NULL;
+  }
+
+  memcpy(grown, mem, header->size < size ? header->size : size);
+  ox_slab_release(mem);
+  return grown;
+}
+
+size_t ox_slab_class_stats(ox_mem_class_stats_t* stats, const size_t capacity)
+{
+  const size_t count =
+    capacity < OX_SLAB_CLASS_COUNT ? capacity : OX_SLAB_CLASS_COUNT;
+
+  ox_slab_cache_t* cache = &slab_cache;
+  for (size_t i = 0; i < count; ++i) {
+    ox_slab_class_t* slab_class = &slab_classes[i];
+    mtx_lock(&slab_class->mtx);
+    ox_slab_fold(slab_class, &cache->bins[i]);
+    stats[i].size = slab_sizes[i];
+    stats[i].acquired = slab_class->acquired;
+    stats[i].released = slab_class->released;
+    stats[i].refills = slab_class->refills;
+    stats[i].reserved = slab_class->reserved;
+    mtx_unlock(&slab_class->mtx);
+  }
+  return count;
+}
+
+#endif
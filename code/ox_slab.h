@@ -0,0 +1,56 @@
+/**
+ * @file ox_slab.h
+ * @brief Size-class slab allocator backing ox_mem_acquire in release builds
+ *
+ * Requests up to OX_SLAB_SIZE_MAX bytes are rounded up to one of a fixed set
+ * of size classes. Every class keeps a shared free list refilled from spans
+ * carved out of large blocks obtained from the OS, and every thread keeps a
+ * small cache per class in front of it, so the common acquire and release
+ * touch no lock. Larger requests go to malloc.
+ *
+ * Only compiled in when OX_SLAB_ALLOCATOR is defined and OX_DEBUG_BUILD is
+ * not, debug builds keep the tracking allocator.
+ */
+
+#pragma once
+
+#include "ox_memory.h"
+
+#include <stddef.h>
+
+#if defined(OX_SLAB_ALLOCATOR) && !defined(OX_DEBUG_BUILD)
+#define OX_MEM_USE_SLAB
+#endif
+
+#define OX_SLAB_CLASS_COUNT 36
+#define OX_SLAB_SIZE_MAX    16384
+#define OX_SLAB_SPAN_SIZE   (64 * 1024)
+#define OX_SLAB_BLOCK_SIZE  (1024 * 1024)
+
+#ifdef OX_MEM_USE_SLAB
+
+/**
+ * @brief Create the class locks and the thread cache key
+ * @return OX_SUCCESS or OX_FAILURE
+ */
+long ox_slab_init(void);
+
+/**
+ * @brief Return every OS block, outstanding allocations become invalid
+ */
+void ox_slab_exit(void);
+
+void* ox_slab_acquire(size_t size);
+void* ox_slab_acquire_aligned(size_t size, size_t alignment);
+void* ox_slab_reclaim(void* mem, size_t size);
+void ox_slab_release(void* mem);
+
+/**
+ * @brief Copy the counters of every size class
+ * @param stats Receives up to 'capacity' entries
+ * @param capacity Size of 'stats'
+ * @return Number of entries written
+ */
+size_t ox_slab_class_stats(ox_mem_class_stats_t* stats, size_t capacity);
+
+#endif
@@ -0,0 +1,490 @@
+#include "ox_snapshot.h"
+
+#include "ox_log.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#define OX_SNAPSHOT_PATH_MAX 1024
+
+static_assert(sizeof(ox_entity_id) == sizeof(uint64_t),
+              "Entity handles are stored as they are in memory");
+static_assert(sizeof(ox_snapshot_header_t) % 8 == 0 &&
+                sizeof(ox_snapshot_component_t) % 8 == 0 &&
+                sizeof(ox_snapshot_archetype_t) % 8 == 0 &&
+                sizeof(ox_snapshot_column_t) % 8 == 0,
+              "Tables must keep their 64-bit fields aligned");
+
+// Writes in file order, padding up to offsets laid out beforehand
+typedef struct {
+  FILE* file;
+  uint64_t position;
+  bool failed;
+} ox_snapshot_writer_t;
+
+static uint64_t ox_snapshot_align(const uint64_t offset)
+{
+  return (offset + OX_SNAPSHOT_ALIGNMENT - 1) &
+         ~(uint64_t)(OX_SNAPSHOT_ALIGNMENT - 1);
+}
+
+static void ox_snapshot_write(ox_snapshot_writer_t* writer, const void* data,
+                              const size_t size)
+{
+  if (!writer->failed && size != 0 &&
+      fwrite(data, 1, size, writer->file) != size) {
+    writer->failed = true;
+  }
+  writer->position += size;
+}
+
+static void ox_snapshot_pad(ox_snapshot_writer_t* writer,
+                            const uint64_t offset)
+{
+  static const char zeros[OX_SNAPSHOT_ALIGNMENT] = { 0 };
+  while (writer->position < offset) {
+    const uint64_t left = offset - writer->position;
+    ox_snapshot_write(writer, zeros,
+                      left < sizeof(zeros) ? (size_t)left : sizeof(zeros));
+  }
+}
+
+// Rows of one column, chunk by chunk
+static void ox_snapshot_write_rows(ox_snapshot_writer_t* writer,
+                                   const ox_archetype_t* archetype,
+                                   const ox_memory_pool_t* pool)
+{
+  const size_t chunks = ox_archetype_chunk_count(archetype);
+  for (size_t chunk = 0; chunk < chunks; ++chunk) {
+    ox_snapshot_write(writer, pool->chunks[chunk].data,
+                      pool->element_size *
+                        ox_archetype_chunk_rows(archetype, chunk));
+  }
+}
+
+long ox_world_save_snapshot(const ox_world_t* world, const char* path)
+{
+  const ox_component_registry_t* registry = &world->component_registry;
+  char temp_path[OX_SNAPSHOT_PATH_MAX];
+  const int written = snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+  if (written <= 0 || (size_t)written >= sizeof(temp_path)) {
+    OX_LOG_ERR("Snapshot path '%s' is too long", path);
+    return OX_FAILURE;
+  }
+
+  size_t column_total = 0;
+  for (size_t i = 0; i < world->archetype_count; ++i) {
+    column_total += world->archetypes[i]->component_pool_count;
+  }
+
+  // Every table is filled in before the first byte is written
+  const size_t table_size =
+    sizeof(ox_snapshot_component_t) * registry->component_count +
+    sizeof(ox_snapshot_archetype_t) * world->archetype_count +
+    sizeof(ox_snapshot_column_t) * column_total;
+  void* tables = ox_mem_acquire(table_size, OX_SOURCE_LOCATION);
+  if (!tables) {
+    return OX_FAILURE;
+  }
+  memset(tables, 0, table_size);
+
+  ox_snapshot_component_t* components = tables;
+  ox_snapshot_archetype_t* archetypes =
+    (ox_snapshot_archetype_t*)(components + registry->component_count);
+  ox_snapshot_column_t* columns =
+    (ox_snapshot_column_t*)(archetypes + world->archetype_count);
+
+  ox_snapshot_header_t header = {
+    .magic = OX_SNAPSHOT_MAGIC,
+    .version = OX_SNAPSHOT_VERSION,
+    .component_count = (uint32_t)registry->component_count,
+    .archetype_count = (uint32_t)world->archetype_count,
+    .record_size = sizeof(ox_entity_record_t),
+    .entity_count = world->entities_count,
+    .alive_count = world->alive_count,
+    .free_head = world->free_head,
+    .free_count = world->free_count,
+  };
+
+  uint64_t offset = sizeof(header);
+  header.components_offset = offset;
+  offset += sizeof(ox_snapshot_component_t) * registry->component_count;
+  for (size_t i = 0; i < registry->component_count; ++i) {
+    components[i].size = registry->components[i].size;
+    components[i].name_offset = offset;
+    components[i].name_length =
+      (uint32_t)strlen(registry->components[i].name);
+    offset += components[i].name_length;
+  }
+
+  header.archetypes_offset = ox_snapshot_align(offset);
+  offset = header.archetypes_offset +
+           sizeof(ox_snapshot_archetype_t) * world->archetype_count;
+  for (size_t i = 0; i < world->archetype_count; ++i) {
+    archetypes[i].column_count =
+      (uint32_t)world->archetypes[i]->component_pool_count;
+    archetypes[i].columns_offset = offset;
+    offset += sizeof(ox_snapshot_column_t) * archetypes[i].column_count;
+  }
+
+  header.entities_offset = ox_snapshot_align(offset);
+  offset =
+    header.entities_offset + sizeof(ox_entity_id) * world->entities_count;
+  header.records_offset = ox_snapshot_align(offset);
+  offset = header.records_offset +
+           sizeof(ox_entity_record_t) * world->entities_count;
+
+  ox_snapshot_column_t* column = columns;
+  for (size_t i = 0; i < world->archetype_count; ++i) {
+    const ox_archetype_t* archetype = world->archetypes[i];
+    archetypes[i].entity_count = archetype->entity_count;
+    archetypes[i].entities_offset = ox_snapshot_align(offset);
+    offset = archetypes[i].entities_offset +
+             sizeof(ox_entity_id) * archetype->entity_count;
+
+    for (size_t j = 0; j < archetype->component_pool_count; ++j, ++column) {
+      column->component = archetype->component_ids[j].value;
+      column->size = archetype->component_pools[j].element_size;
+      if (column->size != 0) {
+        column->offset = ox_snapshot_align(offset);
+        offset = column->offset + column->size * archetype->entity_count;
+      }
+    }
+  }
+  header.size = offset;
+
+  FILE* file = fopen(temp_path, "wb");
+  if (!file) {
+    OX_LOG_ERR("Failed to create '%s'", temp_path);
+    ox_mem_release(tables);
+    return OX_FAILURE;
+  }
+
+  ox_snapshot_writer_t writer = { file, 0, false };
+  ox_snapshot_write(&writer, &header, sizeof(header));
+  ox_snapshot_write(&writer, components,
+                    sizeof(ox_snapshot_component_t) *
+                      registry->component_count);
+  for (size_t i = 0; i < registry->component_count; ++i) {
+    ox_snapshot_write(&writer, registry->components[i].name,
+                      components[i].name_length);
+  }
+
+  // The column directories follow the archetype table without a gap
+  ox_snapshot_pad(&writer, header.archetypes_offset);
+  ox_snapshot_write(&writer, archetypes,
+                    sizeof(ox_snapshot_archetype_t) * world->archetype_count);
+  ox_snapshot_write(&writer, columns,
+                    sizeof(ox_snapshot_column_t) * column_total);
+
+  ox_snapshot_pad(&writer, header.entities_offset);
+  ox_snapshot_write(&writer, world->entities,
+                    sizeof(ox_entity_id) * world->entities_count);
+  ox_snapshot_pad(&writer, header.records_offset);
+  ox_snapshot_write(&writer, world->records,
+                    sizeof(ox_entity_record_t) * world->entities_count);
+
+  column = columns;
+  for (size_t i = 0; i < world->archetype_count; ++i) {
+    const ox_archetype_t* archetype = world->archetypes[i];
+    ox_snapshot_pad(&writer, archetypes[i].entities_offset);
+    ox_snapshot_write_rows(&writer, archetype, &archetype->entity_pool);
+
+    for (size_t j = 0; j < archetype->component_pool_count; ++j, ++column) {
+      if (column->size != 0) {
+        ox_snapshot_pad(&writer, column->offset);
+        ox_snapshot_write_rows(&writer, archetype,
+                               &archetype->component_pools[j]);
+      }
+    }
+  }
+
+  ox_mem_release(tables);
+  if (fclose(file) != 0 || writer.failed || writer.position != header.size) {
+    OX_LOG_ERR("Failed to write '%s'", temp_path);
+    remove(temp_path);
+    return OX_FAILURE;
+  }
+
+#ifdef _WIN32
+  // rename doesn't replace an existing file there
+  remove(path);
+#endif
+  if (rename(temp_path, path) != 0) {
+    OX_LOG_ERR("Failed to replace '%s'", path);
+    remove(temp_path);
+    return OX_FAILURE;
+  }
+
+  OX_LOG_DBG("Saved %u entities in %u archetypes to '%s'",
+             (unsigned)world->alive_count, (unsigned)world->archetype_count,
+             path);
+  return OX_SUCCESS;
+}
+
+// True if 'count' elements of 'size' bytes at 'offset' lie within the file
+// and 'offset' is a multiple of 'alignment'
+static bool ox_snapshot_within(const ox_mem_file_t* file,
+                               const uint64_t offset, const uint64_t count,
+                               const uint64_t size, const uint64_t alignment)
+{
+  if (offset % alignment != 0 || offset > file->size) {
+    return false;
+  }
+  return size == 0 || count <= (file->size - offset) / size;
+}
+
+static bool ox_snapshot_validate(const ox_mem_file_t* file)
+{
+  const char* bytes = file->data;
+  const ox_snapshot_header_t* header = file->data;
+  if (file->size < sizeof(*header) || header->magic != OX_SNAPSHOT_MAGIC ||
+      header->version != OX_SNAPSHOT_VERSION ||
+      header->record_size != sizeof(ox_entity_record_t) ||
+      header->size != file->size ||
+      header->component_count > OX_COMPONENTS_MAX ||
+      header->archetype_count == 0 ||
+      header->archetype_count > OX_ECS_ARCHETYPES_MAX ||
+      header->entity_count > OX_ENTITY_FREE_LIST_END ||
+      header->alive_count > header->entity_count ||
+      header->free_count != header->entity_count - header->alive_count) {
+    return false;
+  }
+
+  if (!ox_snapshot_within(file, header->components_offset,
+                          header->component_count,
+                          sizeof(ox_snapshot_component_t), 8) ||
+      !ox_snapshot_within(file, header->archetypes_offset,
+                          header->archetype_count,
+                          sizeof(ox_snapshot_archetype_t), 8) ||
+      !ox_snapshot_within(file, header->entities_offset,
+                          header->entity_count, sizeof(ox_entity_id), 8) ||
+      !ox_snapshot_within(file, header->records_offset, header->entity_count,
+                          sizeof(ox_entity_record_t), 8)) {
+    return false;
+  }
+
+  const ox_snapshot_component_t* components =
+    (const ox_snapshot_component_t*)(bytes + header->components_offset);
+  for (uint32_t i = 0; i < header->component_count; ++i) {
+    if (!ox_snapshot_within(file, components[i].name_offset,
+                            components[i].name_length, 1, 1)) {
+      return false;
+    }
+  }
+
+  // Every live entity sits in exactly one archetype row
+  uint64_t rows = 0;
+  const ox_snapshot_archetype_t* archetypes =
+    (const ox_snapshot_archetype_t*)(bytes + header->archetypes_offset);
+  for (uint32_t i = 0; i < header->archetype_count; ++i) {
+    const ox_snapshot_archetype_t* archetype = &archetypes[i];
+    if ((i == 0 && archetype->column_count != 0) ||
+        archetype->column_count > header->component_count ||
+        archetype->entity_count > header->alive_count - rows ||
+        !ox_snapshot_within(file, archetype->entities_offset,
+                            archetype->entity_count, sizeof(ox_entity_id),
+                            OX_SNAPSHOT_ALIGNMENT) ||
+        !ox_snapshot_within(file, archetype->columns_offset,
+                            archetype->column_count,
+                            sizeof(ox_snapshot_column_t), 8)) {
+      return false;
+    }
+    rows += archetype->entity_count;
+
+    const ox_snapshot_column_t* columns =
+      (const ox_snapshot_column_t*)(bytes + archetype->columns_offset);
+    for (uint32_t j = 0; j < archetype->column_count; ++j) {
+      const ox_snapshot_column_t* column = &columns[j];
+      if (column->component < 0 ||
+          (uint32_t)column->component >= header->component_count ||
+          (j > 0 && column->component <= columns[j - 1].component) ||
+          column->size != components[column->component].size ||
+          (column->size != 0 &&
+           !ox_snapshot_within(file, column->offset, archetype->entity_count,
+                               column->size, OX_SNAPSHOT_ALIGNMENT))) {
+        return false;
+      }
+    }
+  }
+
+  return rows == header->alive_count;
+}
+
+long ox_snapshot_open(ox_snapshot_t* snapshot, const char* path)
+{
+  memset(snapshot, 0, sizeof(*snapshot));
+  if (ox_mem_map_file(&snapshot->file, path) != OX_SUCCESS) {
+    OX_LOG_ERR("Failed to map '%s'", path);
+    return OX_FAILURE;
+  }
+
+  if (!ox_snapshot_validate(&snapshot->file)) {
+    OX_LOG_ERR("'%s' is not a valid snapshot", path);
+    ox_mem_unmap_file(&snapshot->file);
+    return OX_FAILURE;
+  }
+
+  const char* bytes = snapshot->file.data;
+  snapshot->header = snapshot->file.data;
+  snapshot->components =
+    (const ox_snapshot_component_t*)(bytes +
+                                     snapshot->header->components_offset);
+  snapshot->archetypes =
+    (const ox_snapshot_archetype_t*)(bytes +
+                                     snapshot->header->archetypes_offset);
+  return OX_SUCCESS;
+}
+
+void ox_snapshot_close(ox_snapshot_t* snapshot)
+{
+  ox_mem_unmap_file(&snapshot->file);
+  snapshot->header = NULL;
+  snapshot->components = NULL;
+  snapshot->archetypes = NULL;
+}
+
+const ox_entity_id* ox_snapshot_entities(const ox_snapshot_t* snapshot,
+                                         const size_t archetype)
+{
+  const char* bytes = snapshot->file.data;
+  return (const ox_entity_id*)(bytes +
+                               snapshot->archetypes[archetype].entities_offset);
+}
+
+static const ox_snapshot_column_t*
+ox_snapshot_columns(const ox_snapshot_t* snapshot, const size_t archetype)
+{
+  const char* bytes = snapshot->file.data;
+  return (const ox_snapshot_column_t*)(bytes +
+                                       snapshot->archetypes[archetype]
+                                         .columns_offset);
+}
+
+const void* ox_snapshot_column(const ox_snapshot_t* snapshot,
+                               const size_t archetype, const size_t column)
+{
+  const ox_snapshot_column_t* columns =
+    ox_snapshot_columns(snapshot, archetype);
+  if (columns[column].size == 0) {
+    return NULL;
+  }
+  return (const char*)snapshot->file.data + columns[column].offset;
+}
+
+// Fills the rows of a freshly appended column, one memcpy per chunk
+static void ox_snapshot_copy_rows(const ox_archetype_t* archetype,
+                                  const ox_memory_pool_t* pool,
+                                  const char* rows)
+{
+  const size_t chunks = ox_archetype_chunk_count(archetype);
+  for (size_t chunk = 0; chunk < chunks; ++chunk) {
+    const size_t size =
+      pool->element_size * ox_archetype_chunk_rows(archetype, chunk);
+    memcpy(pool->chunks[chunk].data, rows, size);
+    rows += size;
+  }
+}
+
+static ox_component_id
+ox_snapshot_find_component(const ox_component_registry_t* registry,
+                           const char* name, const size_t length)
+{
+  for (size_t i = 0; i < registry->component_count; ++i) {
+    const char* other = registry->components[i].name;
+    if (strncmp(other, name, length) == 0 && other[length] == '\0') {
+      return (ox_component_id){ (int)i };
+    }
+  }
+  return (ox_component_id){ OX_INVALID_ID };
+}
+
+long ox_world_load_snapshot(ox_world_t* world, const ox_snapshot_t* snapshot)
+{
+  const ox_snapshot_header_t* header = snapshot->header;
+  const char* bytes = snapshot->file.data;
+
+  // Archetypes are recreated in snapshot order, so the archetype ids in
+  // the saved entity records stay valid
+  if (world->entities_count != 0 || world->archetype_count != 1) {
+    OX_LOG_ERR("Snapshots only load into fresh worlds");
+    return OX_FAILURE;
+  }
+
+  ox_component_id components[OX_COMPONENTS_MAX];
+  for (uint32_t i = 0; i < header->component_count; ++i) {
+    const ox_snapshot_component_t* component = &snapshot->components[i];
+    const char* name = bytes + component->name_offset;
+    components[i] = ox_snapshot_find_component(
+      &world->component_registry, name, component->name_length);
+
+    if (components[i].value == OX_INVALID_ID ||
+        world->component_registry.components[components[i].value].size !=
+          component->size) {
+      OX_LOG_ERR("Component '%.*s' of size %u is not registered",
+                 (int)component->name_length, name, (unsigned)component->size);
+      return OX_FAILURE;
+    }
+  }
+
+  for (uint32_t i = 1; i < header->archetype_count; ++i) {
+    const ox_snapshot_column_t* columns = ox_snapshot_columns(snapshot, i);
+    ox_component_mask_t mask;
+    ox_component_mask_init(&mask);
+    for (uint32_t j = 0; j < snapshot->archetypes[i].column_count; ++j) {
+      ox_component_mask_set(&mask, components[columns[j].component]);
+    }
+
+    if (ox_world_get_archetype(world, &mask).value != (int)i) {
+      OX_LOG_ERR("Failed to recreate snapshot archetype %u", i);
+      return OX_FAILURE;
+    }
+  }
+
+  if (ox_world_reserve_entities(world, header->entity_count) != OX_SUCCESS) {
+    OX_LOG_ERR("Failed to grow entity table");
+    return OX_FAILURE;
+  }
+
+  for (uint32_t i = 0; i < header->archetype_count; ++i) {
+    const ox_snapshot_archetype_t* src = &snapshot->archetypes[i];
+    ox_archetype_t* archetype = world->archetypes[i];
+    if (src->entity_count == 0) {
+      continue;
+    }
+
+    if (ox_archetype_append_rows(archetype, src->entity_count) == SIZE_MAX) {
+      OX_LOG_ERR("Failed to reserve %u rows", (unsigned)src->entity_count);
+      return OX_FAILURE;
+    }
+
+    ox_snapshot_copy_rows(archetype, &archetype->entity_pool,
+                          bytes + src->entities_offset);
+
+    const ox_snapshot_column_t* columns = ox_snapshot_columns(snapshot, i);
+    for (uint32_t j = 0; j < src->column_count; ++j) {
+      if (columns[j].size == 0) {
+        continue;
+      }
+
+      const int column = ox_archetype_find_column(
+        archetype, components[columns[j].component]);
+      ox_snapshot_copy_rows(archetype, &archetype->component_pools[column],
+                            bytes + columns[j].offset);
+    }
+  }
+
+  memcpy(world->entities, bytes + header->entities_offset,
+         sizeof(ox_entity_id) * header->entity_count);
+  memcpy(world->records, bytes + header->records_offset,
+         sizeof(ox_entity_record_t) * header->entity_count);
+  world->entities_count = header->entity_count;
+  world->alive_count = header->alive_count;
+  world->free_head = header->free_head;
+  world->free_count = header->free_count;
+
+  OX_LOG_DBG("Loaded %u entities in %u archetypes",
+             (unsigned)world->alive_count, (unsigned)header->archetype_count);
+  return OX_SUCCESS;
+}
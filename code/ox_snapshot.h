@@ -0,0 +1,151 @@
+/**
+ * @file ox_snapshot.h
+ * @brief Memory-mappable binary world snapshots
+ *
+ * A snapshot stores the component registry (names and sizes), the entity
+ * table and every archetype's entity and component columns as raw blobs,
+ * each 64-byte aligned. Opening one maps the file, so the columns can be
+ * read in place, and loading copies them into a world one memcpy per column
+ * chunk, without touching entities one by one.
+ *
+ * File layout, host byte order:
+ *   ox_snapshot_header_t
+ *   ox_snapshot_component_t per component, then their names
+ *   ox_snapshot_archetype_t per archetype, then their column directories
+ *   entity table (ox_entity_id per slot), entity records
+ *   per archetype: entity column, then every component column
+ */
+
+#pragma once
+
+#include "ox_ecs.h"
+#include "ox_memory.h"
+
+#define OX_SNAPSHOT_MAGIC     0x53574F58u /* "OXWS" */
+#define OX_SNAPSHOT_VERSION   1
+#define OX_SNAPSHOT_ALIGNMENT OX_ECS_COLUMN_ALIGNMENT
+
+/**
+ * @brief Start of a snapshot file, offsets are from the start of the file
+ */
+typedef struct {
+  uint32_t magic;             /**< OX_SNAPSHOT_MAGIC */
+  uint32_t version;           /**< OX_SNAPSHOT_VERSION */
+  uint32_t component_count;   /**< Registered components */
+  uint32_t archetype_count;   /**< Archetypes, 0 is the empty one */
+  uint32_t record_size;       /**< sizeof(ox_entity_record_t) of the writer */
+  uint32_t reserved;          /**< Zero */
+  uint64_t entity_count;      /**< Entity table slots, dead ones included */
+  uint64_t alive_count;       /**< Live entities */
+  uint64_t free_head;         /**< First slot of the free list */
+  uint64_t free_count;        /**< Slots on the free list */
+  uint64_t components_offset; /**< ox_snapshot_component_t array */
+  uint64_t archetypes_offset; /**< ox_snapshot_archetype_t array */
+  uint64_t entities_offset;   /**< ox_entity_id per entity table slot */
+  uint64_t records_offset;    /**< ox_entity_record_t per entity table slot */
+  uint64_t size;              /**< Size of the whole file */
+} ox_snapshot_header_t;
+
+/**
+ * @brief Registered component, the id is its index
+ */
+typedef struct {
+  uint64_t size;        /**< Component size in bytes */
+  uint64_t name_offset; /**< Name bytes, not terminated */
+  uint32_t name_length; /**< Name length in bytes */
+  uint32_t reserved;    /**< Zero */
+} ox_snapshot_component_t;
+
+/**
+ * @brief Archetype with its rows
+ */
+typedef struct {
+  uint64_t entity_count;    /**< Rows */
+  uint64_t entities_offset; /**< ox_entity_id per row */
+  uint64_t columns_offset;  /**< ox_snapshot_column_t per column */
+  uint32_t column_count;    /**< Components of the archetype */
+  uint32_t reserved;        /**< Zero */
+} ox_snapshot_archetype_t;
+
+/**
+ * @brief Component column of an archetype, sorted by component id
+ */
+typedef struct {
+  int32_t component; /**< Snapshot component id */
+  uint32_t reserved; /**< Zero */
+  uint64_t size;     /**< Bytes per row */
+  uint64_t offset;   /**< Rows, 0 for zero-sized components */
+} ox_snapshot_column_t;
+
+/**
+ * @brief Mapped snapshot, read-only
+ */
+typedef struct {
+  ox_mem_file_t file;                        /**< Mapping of the file */
+  const ox_snapshot_header_t* header;        /**< Start of the mapping */
+  const ox_snapshot_component_t* components; /**< Component table */
+  const ox_snapshot_archetype_t* archetypes; /**< Archetype table */
+} ox_snapshot_t;
+
+/**
+ * @brief Write every archetype and the entity table of a world
+ *
+ * The file is written under a temporary name and renamed, so a crash never
+ * leaves a torn snapshot behind.
+ *
+ * @param world World to save, queries are not saved
+ * @param path File to create or replace
+ * @return OX_SUCCESS or OX_FAILURE
+ */
+long ox_world_save_snapshot(const ox_world_t* world, const char* path);
+
+/**
+ * @brief Map a snapshot and check its structure
+ *
+ * Every table and column must lie within the file. Column contents and the
+ * entity records are trusted.
+ *
+ * @param snapshot Snapshot to initialize
+ * @param path File to map
+ * @return OX_SUCCESS or OX_FAILURE
+ */
+long ox_snapshot_open(ox_snapshot_t* snapshot, const char* path);
+
+/**
+ * @brief Unmap a snapshot, pointers into it become invalid
+ * @param snapshot Opened snapshot
+ */
+void ox_snapshot_close(ox_snapshot_t* snapshot);
+
+/**
+ * @brief Entity handles of an archetype's rows, in place
+ * @param snapshot Opened snapshot
+ * @param archetype Snapshot archetype index
+ * @return entity_count handles
+ */
+const ox_entity_id* ox_snapshot_entities(const ox_snapshot_t* snapshot,
+                                         size_t archetype);
+
+/**
+ * @brief Rows of one component column of an archetype, in place
+ * @param snapshot Opened snapshot
+ * @param archetype Snapshot archetype index
+ * @param column Column index, columns are sorted by component id
+ * @return entity_count rows, NULL for zero-sized components
+ */
+const void* ox_snapshot_column(const ox_snapshot_t* snapshot,
+                               size_t archetype, size_t column);
+
+/**
+ * @brief Copy a snapshot into a world
+ *
+ * Components are matched by name and must have the same size. The world
+ * must be fresh: no entities and no archetypes but the empty one. It gets
+ * the snapshot's entity handles, so handles saved elsewhere stay valid.
+ *
+ * @param world Initialized world with the snapshot's components registered
+ * @param snapshot Opened snapshot, may be closed afterwards
+ * @return OX_SUCCESS or OX_FAILURE, the world is left partially loaded on
+ *         failure and should be terminated
+ */
+long ox_world_load_snapshot(ox_world_t* world, const ox_snapshot_t* snapshot);
@@ -0,0 +1,13 @@
+/**
+ * @file ox_time.h
+ * @brief Monotonic clock
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Nanoseconds from an arbitrary fixed point, never goes backwards
+ */
+uint64_t ox_time_ns(void);
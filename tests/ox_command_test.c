@@ -0,0 +1,287 @@
+// Deferred commands against the same edits applied directly to a twin world
+//
+// Commands on one entity fold into a single move, commands on dead or
+// recycled handles are dropped and spawns land as one batch per archetype.
+
+#include "ox_command.h"
+#include "ox_core.h"
+#include "ox_ecs.h"
+#include "ox_job.h"
+#include "ox_log.h"
+#include "ox_memory.h"
+#include "ox_test.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define TEST_ENTITIES 7
+
+typedef enum {
+  TEST_ADD,
+  TEST_REMOVE,
+  TEST_DESTROY,
+} test_edit_type_t;
+
+typedef struct {
+  test_edit_type_t type;
+  size_t entity; // Index into the handle table
+  bool velocity; // Velocity rather than position
+  int value;
+} test_edit_t;
+
+typedef struct {
+  int position;
+  int velocity;
+  bool moving; // Spawned with a velocity
+} test_spawn_t;
+
+// Each world gets the same handles, 4 and 5 are dead by the time commands
+// are recorded and 6 recycles the slot of 5
+typedef struct {
+  ox_world_t world;
+  ox_component_id position;
+  ox_component_id velocity;
+  ox_entity_id entities[TEST_ENTITIES];
+} test_world_t;
+
+// Interleaved so every entity's commands are spread over the buffer, the
+// stale handle 5 records both before and after the live handle 6 of its slot
+static const test_edit_t test_edits[] = {
+  { TEST_ADD, 0, true, 10 },  { TEST_ADD, 1, true, 20 },
+  { TEST_ADD, 5, true, 50 },  { TEST_ADD, 0, false, 11 },
+  { TEST_ADD, 6, true, 60 },  { TEST_REMOVE, 2, false, 0 },
+  { TEST_ADD, 3, true, 30 },  { TEST_REMOVE, 1, true, 0 },
+  { TEST_ADD, 4, true, 40 },  { TEST_ADD, 0, false, 12 },
+  { TEST_ADD, 5, true, 51 },  { TEST_ADD, 2, false, 22 },
+  { TEST_DESTROY, 3, false, 0 },
+};
+
+static const test_spawn_t test_spawns[] = {
+  { 100, 101, true },
+  { 102, 0, false },
+  { 103, 104, true },
+  { 105, 0, false },
+};
+
+static void test_world_init(test_world_t* test)
+{
+  OX_CHECK(ox_world_init(&test->world) == OX_SUCCESS);
+  test->position =
+    ox_component_register(&test->world.component_registry, "position",
+                          sizeof(int));
+  test->velocity =
+    ox_component_register(&test->world.component_registry, "velocity",
+                          sizeof(int));
+
+  for (size_t i = 0; i < TEST_ENTITIES - 1; ++i) {
+    test->entities[i] = ox_world_create_entity(&test->world);
+    const int value = (int)i;
+    ox_world_add_component(&test->world, test->entities[i], test->position,
+                           &value);
+  }
+
+  ox_world_destroy_entity(&test->world, test->entities[4]);
+  ox_world_destroy_entity(&test->world, test->entities[5]);
+  test->entities[6] = ox_world_create_entity(&test->world);
+}
+
+static void test_record(ox_command_queue_t* queue, const test_world_t* test)
+{
+  for (size_t i = 0; i < OX_ARRAY_SIZE(test_edits); ++i) {
+    const test_edit_t* edit = &test_edits[i];
+    const ox_entity_id entity = test->entities[edit->entity];
+    const ox_component_id component =
+      edit->velocity ? test->velocity : test->position;
+
+    switch (edit->type) {
+    case TEST_ADD:
+      ox_command_add(queue, entity, component, &edit->value);
+      break;
+    case TEST_REMOVE:
+      ox_command_remove(queue, entity, component);
+      break;
+    case TEST_DESTROY:
+      ox_command_destroy(queue, entity);
+      break;
+    }
+  }
+
+  for (size_t i = 0; i < OX_ARRAY_SIZE(test_spawns); ++i) {
+    const test_spawn_t* spawn = &test_spawns[i];
+    const ox_component_id components[] = { test->position, test->velocity };
+    const void* data[] = { &spawn->position, &spawn->velocity };
+    ox_command_spawn(queue, components, data, spawn->moving ? 2 : 1);
+  }
+}
+
+static void test_apply(test_world_t* test)
+{
+  ox_world_t* world = &test->world;
+
+  for (size_t i = 0; i < OX_ARRAY_SIZE(test_edits); ++i) {
+    const test_edit_t* edit = &test_edits[i];
+    const ox_entity_id entity = test->entities[edit->entity];
+    const ox_component_id component =
+      edit->velocity ? test->velocity : test->position;
+
+    // Dropped like the commands on dead handles
+    if (!ox_world_is_alive(world, entity)) {
+      continue;
+    }
+
+    switch (edit->type) {
+    case TEST_ADD:
+      ox_world_add_component(world, entity, component, &edit->value);
+      break;
+    case TEST_REMOVE:
+      ox_world_remove_component(world, entity, component);
+      break;
+    case TEST_DESTROY:
+      ox_world_destroy_entity(world, entity);
+      break;
+    }
+  }
+
+  for (size_t i = 0; i < OX_ARRAY_SIZE(test_spawns); ++i) {
+    const test_spawn_t* spawn = &test_spawns[i];
+    const ox_entity_id entity = ox_world_create_entity(world);
+    ox_world_add_component(world, entity, test->position, &spawn->position);
+    if (spawn->moving) {
+      ox_world_add_component(world, entity, test->velocity, &spawn->velocity);
+    }
+  }
+}
+
+static bool test_same_component(const test_world_t* lhs,
+                                const test_world_t* rhs, const size_t entity,
+                                const bool velocity)
+{
+  const int* a = ox_world_get_component(
+    &lhs->world, lhs->entities[entity],
+    velocity ? lhs->velocity : lhs->position);
+  const int* b = ox_world_get_component(
+    &rhs->world, rhs->entities[entity],
+    velocity ? rhs->velocity : rhs->position);
+
+  return a && b ? *a == *b : a == b;
+}
+
+// Position values of the query's rows in iteration order, returns the count
+static size_t test_positions(test_world_t* test, const bool velocity,
+                             int* positions, const size_t capacity)
+{
+  const ox_query_desc_t desc = {
+    .include = &test->position,
+    .include_count = 1,
+    .exclude = velocity ? NULL : &test->velocity,
+    .exclude_count = velocity ? 0 : 1,
+  };
+  const ox_query_id query = ox_world_register_query(&test->world, &desc);
+
+  size_t count = 0;
+  ox_query_iter_t iter;
+  ox_query_iter_init(&iter, &test->world, query);
+  while (ox_query_iter_next(&iter)) {
+    const int* position = iter.columns[0];
+    for (size_t i = 0; i < iter.count && count < capacity; ++i) {
+      positions[count++] = position[i];
+    }
+  }
+
+  return count;
+}
+
+// Spawned rows follow each other in recording order
+static bool test_spawns_grouped(const int* positions, const size_t count,
+                                const int first, const int second)
+{
+  for (size_t i = 0; i + 1 < count; ++i) {
+    if (positions[i] == first) {
+      return positions[i + 1] == second;
+    }
+  }
+
+  return false;
+}
+
+int main(void)
+{
+  if (ox_log_init() != OX_SUCCESS || ox_memory_init() != OX_SUCCESS ||
+      ox_job_init() != OX_SUCCESS) {
+    return EXIT_FAILURE;
+  }
+
+  static test_world_t deferred;
+  static test_world_t direct;
+  test_world_init(&deferred);
+  test_world_init(&direct);
+
+  // The recycled slot must be reused with a new nonce for the stale check
+  OX_CHECK(deferred.entities[6].index == deferred.entities[5].index);
+  OX_CHECK(deferred.entities[6].nonce != deferred.entities[5].nonce);
+
+  static ox_command_queue_t queue;
+  ox_command_queue_init(&queue, &deferred.world);
+  test_record(&queue, &deferred);
+  OX_CHECK(ox_command_queue_flush(&queue) == OX_SUCCESS);
+  test_apply(&direct);
+
+  // Folding: last value wins, add then remove leaves nothing behind
+  const int* position =
+    ox_world_get_component(&deferred.world, deferred.entities[0],
+                           deferred.position);
+  OX_CHECK(position && *position == 12);
+  OX_CHECK(!ox_world_get_component(&deferred.world, deferred.entities[1],
+                                   deferred.velocity));
+  OX_CHECK(!ox_world_is_alive(&deferred.world, deferred.entities[3]));
+
+  // Stale handles: the dead one stays dead, the recycled slot only gets the
+  // value recorded against its live handle
+  OX_CHECK(!ox_world_is_alive(&deferred.world, deferred.entities[4]));
+  const int* velocity =
+    ox_world_get_component(&deferred.world, deferred.entities[6],
+                           deferred.velocity);
+  OX_CHECK(velocity && *velocity == 60);
+
+  // Same outcome as the direct edits
+  OX_CHECK(deferred.world.alive_count == direct.world.alive_count);
+  for (size_t i = 0; i < TEST_ENTITIES; ++i) {
+    OX_CHECK(ox_world_is_alive(&deferred.world, deferred.entities[i]) ==
+             ox_world_is_alive(&direct.world, direct.entities[i]));
+    OX_CHECK(test_same_component(&deferred, &direct, i, false));
+    OX_CHECK(test_same_component(&deferred, &direct, i, true));
+  }
+
+  // Spawns: the same rows as the direct edits, one batch per archetype in
+  // recording order
+  int deferred_positions[TEST_ENTITIES * 2];
+  int direct_positions[TEST_ENTITIES * 2];
+  for (int velocity_query = 0; velocity_query < 2; ++velocity_query) {
+    const size_t count =
+      test_positions(&deferred, velocity_query, deferred_positions,
+                     OX_ARRAY_SIZE(deferred_positions));
+    OX_CHECK(count == test_positions(&direct, velocity_query, direct_positions,
+                                     OX_ARRAY_SIZE(direct_positions)));
+
+    int deferred_sum = 0;
+    int direct_sum = 0;
+    for (size_t i = 0; i < count; ++i) {
+      deferred_sum += deferred_positions[i];
+      direct_sum += direct_positions[i];
+    }
+    OX_CHECK(deferred_sum == direct_sum);
+
+    OX_CHECK(velocity_query
+               ? test_spawns_grouped(deferred_positions, count, 100, 103)
+               : test_spawns_grouped(deferred_positions, count, 102, 105));
+  }
+
+  ox_command_queue_term(&queue);
+  ox_world_term(&deferred.world);
+  ox_world_term(&direct.world);
+  ox_job_exit();
+  ox_memory_exit();
+  ox_log_exit();
+
+  return OX_TEST_RESULT();
+}
@@ -0,0 +1,183 @@
+// Scheduler ordering and concurrency, run with OX_JOB_THREADS=4
+//
+// Conflicting systems must run one after the other in registration order,
+// systems without a conflict must be able to run at the same time.
+
+#include "ox_core.h"
+#include "ox_ecs.h"
+#include "ox_job.h"
+#include "ox_log.h"
+#include "ox_memory.h"
+#include "ox_scheduler.h"
+#include "ox_test.h"
+#include "ox_time.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <threads.h>
+
+#define TEST_FRAMES        10
+#define TEST_SYSTEM_SLEEP  2000000    // ns a timed system keeps running
+#define TEST_OVERLAP_LIMIT 1000000000 // ns to wait for the other system
+
+// Start and finish of a system in the frame, from one shared sequence
+typedef struct {
+  atomic_size_t* sequence;
+  atomic_size_t started;
+  atomic_size_t finished;
+} test_span_t;
+
+// Two systems that each wait for the other one to start
+typedef struct {
+  atomic_bool* self;
+  atomic_bool* other;
+  atomic_bool saw_other;
+} test_rendezvous_t;
+
+static void test_timed_system(ox_world_t* world, const ox_query_id query,
+                              ox_command_queue_t* commands, void* userdata)
+{
+  (void)world;
+  (void)query;
+  (void)commands;
+
+  test_span_t* span = userdata;
+  atomic_store(&span->started, atomic_fetch_add(span->sequence, 1) + 1);
+
+  const struct timespec duration = { 0, TEST_SYSTEM_SLEEP };
+  thrd_sleep(&duration, NULL);
+
+  atomic_store(&span->finished, atomic_fetch_add(span->sequence, 1) + 1);
+}
+
+static void test_rendezvous_system(ox_world_t* world, const ox_query_id query,
+                                   ox_command_queue_t* commands,
+                                   void* userdata)
+{
+  (void)world;
+  (void)query;
+  (void)commands;
+
+  test_rendezvous_t* rendezvous = userdata;
+  atomic_store(rendezvous->self, true);
+
+  const uint64_t deadline = ox_time_ns() + TEST_OVERLAP_LIMIT;
+  while (!atomic_load(rendezvous->other) && ox_time_ns() < deadline) {
+    thrd_yield();
+  }
+
+  atomic_store(&rendezvous->saw_other, atomic_load(rendezvous->other));
+}
+
+static ox_system_id test_register(ox_scheduler_t* scheduler, const char* name,
+                                  const ox_system_fn run, void* userdata,
+                                  const ox_component_id* component,
+                                  const bool write)
+{
+  const ox_system_desc_t desc = {
+    .name = name,
+    .run = run,
+    .userdata = userdata,
+    .query = { .include = component, .include_count = 1 },
+    .writes = write ? component : NULL,
+    .write_count = write ? 1 : 0,
+  };
+
+  return ox_scheduler_register(scheduler, &desc);
+}
+
+static void test_ordering(ox_world_t* world, const ox_component_id a,
+                          const ox_component_id b)
+{
+  static ox_scheduler_t scheduler;
+  OX_CHECK(ox_scheduler_init(&scheduler, world) == OX_SUCCESS);
+
+  atomic_size_t sequence;
+  test_span_t write_a = { .sequence = &sequence };
+  test_span_t read_a = { .sequence = &sequence };
+  test_span_t rewrite_a = { .sequence = &sequence };
+  test_span_t write_b = { .sequence = &sequence };
+
+  // read_a declares no reads, its query's include term alone orders it
+  test_register(&scheduler, "write a", test_timed_system, &write_a, &a, true);
+  test_register(&scheduler, "read a", test_timed_system, &read_a, &a, false);
+  test_register(&scheduler, "rewrite a", test_timed_system, &rewrite_a, &a,
+                true);
+  test_register(&scheduler, "write b", test_timed_system, &write_b, &b, true);
+
+  for (int frame = 0; frame < TEST_FRAMES; ++frame) {
+    atomic_store(&sequence, 0);
+    ox_scheduler_run(&scheduler);
+
+    // Read after write
+    OX_CHECK(atomic_load(&write_a.finished) < atomic_load(&read_a.started));
+    // Write after read
+    OX_CHECK(atomic_load(&read_a.finished) < atomic_load(&rewrite_a.started));
+    // Write after write
+    OX_CHECK(atomic_load(&write_a.finished) <
+             atomic_load(&rewrite_a.started));
+    OX_CHECK(atomic_load(&write_b.finished) != 0);
+  }
+
+  ox_scheduler_term(&scheduler);
+}
+
+static void test_overlap(ox_world_t* world, const ox_component_id a,
+                         const ox_component_id b)
+{
+  static ox_scheduler_t scheduler;
+  OX_CHECK(ox_scheduler_init(&scheduler, world) == OX_SUCCESS);
+
+  atomic_bool started_a;
+  atomic_bool started_b;
+  test_rendezvous_t system_a = { .self = &started_a, .other = &started_b };
+  test_rendezvous_t system_b = { .self = &started_b, .other = &started_a };
+
+  test_register(&scheduler, "write a", test_rendezvous_system, &system_a, &a,
+                true);
+  test_register(&scheduler, "write b", test_rendezvous_system, &system_b, &b,
+                true);
+
+  for (int frame = 0; frame < TEST_FRAMES; ++frame) {
+    atomic_store(&started_a, false);
+    atomic_store(&started_b, false);
+    ox_scheduler_run(&scheduler);
+
+    OX_CHECK(atomic_load(&system_a.saw_other));
+    OX_CHECK(atomic_load(&system_b.saw_other));
+  }
+
+  ox_scheduler_term(&scheduler);
+}
+
+int main(void)
+{
+  if (ox_log_init() != OX_SUCCESS || ox_memory_init() != OX_SUCCESS ||
+      ox_job_init() != OX_SUCCESS) {
+    return EXIT_FAILURE;
+  }
+
+  static ox_world_t world;
+  OX_CHECK(ox_world_init(&world) == OX_SUCCESS);
+
+  const ox_component_id a =
+    ox_component_register(&world.component_registry, "a", sizeof(int));
+  const ox_component_id b =
+    ox_component_register(&world.component_registry, "b", sizeof(int));
+
+  test_ordering(&world, a, b);
+
+  // Two systems can only overlap with a second job thread
+  if (ox_job_thread_count() > 1) {
+    test_overlap(&world, a, b);
+  } else {
+    (void)fprintf(stderr, "Single job thread, overlap not checked\n");
+  }
+
+  ox_world_term(&world);
+  ox_job_exit();
+  ox_memory_exit();
+  ox_log_exit();
+
+  return OX_TEST_RESULT();
+}
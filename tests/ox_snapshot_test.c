@@ -0,0 +1,246 @@
+// A saved world loaded into one that registers its components in another order
+//
+// Handles, component values and the free list survive the round trip, and
+// truncated files or columns outside the file are rejected on open.
+
+#include "ox_core.h"
+#include "ox_ecs.h"
+#include "ox_log.h"
+#include "ox_memory.h"
+#include "ox_snapshot.h"
+#include "ox_test.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_ENTITIES        3000
+#define TEST_DESTROY_EVERY   7
+#define TEST_SNAPSHOT_PATH   "ox_snapshot_test.snapshot"
+#define TEST_TRUNCATED_PATH  "ox_snapshot_test.truncated"
+#define TEST_BAD_COLUMN_PATH "ox_snapshot_test.bad_column"
+
+typedef struct {
+  float x;
+  float y;
+  float z;
+} test_position_t;
+
+typedef struct {
+  ox_world_t world;
+  ox_component_id position;
+  ox_component_id health;
+  ox_component_id tag;
+} test_world_t;
+
+static ox_entity_id test_entities[TEST_ENTITIES];
+
+static void test_fill(test_world_t* test)
+{
+  ox_world_t* world = &test->world;
+
+  for (int i = 0; i < TEST_ENTITIES; ++i) {
+    test_entities[i] = ox_world_create_entity(world);
+    if (i % 2) {
+      const test_position_t position = { (float)i, (float)i * 2, -(float)i };
+      ox_world_add_component(world, test_entities[i], test->position,
+                             &position);
+    }
+    if (i % 3) {
+      const int health = i * 7;
+      ox_world_add_component(world, test_entities[i], test->health, &health);
+    }
+    if (i % 5 == 0) {
+      ox_world_add_component(world, test_entities[i], test->tag, NULL);
+    }
+  }
+
+  for (int i = 0; i < TEST_ENTITIES; i += TEST_DESTROY_EVERY) {
+    ox_world_destroy_entity(world, test_entities[i]);
+  }
+}
+
+static bool test_same_entity(const test_world_t* saved,
+                             const test_world_t* loaded,
+                             const ox_entity_id entity)
+{
+  const bool alive = ox_world_is_alive(&saved->world, entity);
+  if (alive != ox_world_is_alive(&loaded->world, entity)) {
+    return false;
+  }
+  if (!alive) {
+    return true;
+  }
+
+  const test_position_t* position_a =
+    ox_world_get_component(&saved->world, entity, saved->position);
+  const test_position_t* position_b =
+    ox_world_get_component(&loaded->world, entity, loaded->position);
+  const int* health_a =
+    ox_world_get_component(&saved->world, entity, saved->health);
+  const int* health_b =
+    ox_world_get_component(&loaded->world, entity, loaded->health);
+
+  const ox_archetype_t* archetype_a =
+    saved->world.archetypes[saved->world.records[entity.index].archetype.value];
+  const ox_archetype_t* archetype_b =
+    loaded->world
+      .archetypes[loaded->world.records[entity.index].archetype.value];
+
+  return (position_a && position_b
+            ? memcmp(position_a, position_b, sizeof(test_position_t)) == 0
+            : position_a == position_b) &&
+         (health_a && health_b ? *health_a == *health_b
+                               : health_a == health_b) &&
+         ox_component_mask_has(&archetype_a->component_mask, saved->tag) ==
+           ox_component_mask_has(&archetype_b->component_mask, loaded->tag);
+}
+
+// Writes the first 'size' bytes of the snapshot to 'path', with the first
+// populated column moved to 'column_offset' unless that is zero
+static bool test_write_copy(const char* path, const size_t size,
+                            const uint64_t column_offset)
+{
+  ox_mem_file_t file;
+  if (ox_mem_map_file(&file, TEST_SNAPSHOT_PATH) != OX_SUCCESS) {
+    return false;
+  }
+
+  unsigned char* bytes = ox_mem_acquire(file.size, OX_SOURCE_LOCATION);
+  if (!bytes) {
+    ox_mem_unmap_file(&file);
+    return false;
+  }
+  memcpy(bytes, file.data, file.size);
+  ox_mem_unmap_file(&file);
+
+  bool patched = column_offset == 0;
+  const ox_snapshot_header_t* header = (const ox_snapshot_header_t*)bytes;
+  const ox_snapshot_archetype_t* archetypes =
+    (const ox_snapshot_archetype_t*)(bytes + header->archetypes_offset);
+  for (uint32_t i = 0; i < header->archetype_count && !patched; ++i) {
+    ox_snapshot_column_t* columns =
+      (ox_snapshot_column_t*)(bytes + archetypes[i].columns_offset);
+    for (uint32_t j = 0; j < archetypes[i].column_count && !patched; ++j) {
+      if (columns[j].size != 0 && archetypes[i].entity_count != 0) {
+        columns[j].offset = column_offset;
+        patched = true;
+      }
+    }
+  }
+
+  FILE* output = fopen(path, "wb");
+  const bool written = output && fwrite(bytes, 1, size, output) == size;
+  if (output) {
+    fclose(output);
+  }
+
+  ox_mem_release(bytes);
+  return patched && written;
+}
+
+static void test_round_trip(test_world_t* saved)
+{
+  ox_snapshot_t snapshot;
+  OX_CHECK(ox_snapshot_open(&snapshot, TEST_SNAPSHOT_PATH) == OX_SUCCESS);
+
+  // Another registration order, and a component the snapshot doesn't know,
+  // so every component id differs from the saved one
+  static test_world_t loaded;
+  OX_CHECK(ox_world_init(&loaded.world) == OX_SUCCESS);
+  ox_component_registry_t* registry = &loaded.world.component_registry;
+  ox_component_register(registry, "unused", sizeof(double));
+  loaded.tag = ox_component_register(registry, "tag", 0);
+  loaded.health = ox_component_register(registry, "health", sizeof(int));
+  loaded.position =
+    ox_component_register(registry, "position", sizeof(test_position_t));
+  OX_CHECK(loaded.position.value != saved->position.value);
+  OX_CHECK(loaded.health.value != saved->health.value);
+
+  OX_CHECK(ox_world_load_snapshot(&loaded.world, &snapshot) == OX_SUCCESS);
+  ox_snapshot_close(&snapshot);
+
+  OX_CHECK(loaded.world.alive_count == saved->world.alive_count);
+  OX_CHECK(loaded.world.free_count == saved->world.free_count);
+  for (int i = 0; i < TEST_ENTITIES; ++i) {
+    OX_CHECK(test_same_entity(saved, &loaded, test_entities[i]));
+  }
+
+  // Both free lists hand out the same recycled slots with bumped nonces
+  const size_t free_count = saved->world.free_count;
+  for (size_t i = 0; i < free_count; ++i) {
+    const ox_entity_id a = ox_world_create_entity(&saved->world);
+    const ox_entity_id b = ox_world_create_entity(&loaded.world);
+    OX_CHECK(a.index == b.index && a.nonce == b.nonce);
+    OX_CHECK(b.index < TEST_ENTITIES && b.index % TEST_DESTROY_EVERY == 0);
+    OX_CHECK(b.nonce != test_entities[b.index].nonce);
+
+    const int health = (int)i;
+    OX_CHECK(ox_world_add_component(&loaded.world, b, loaded.health,
+                                    &health) == OX_SUCCESS);
+  }
+  OX_CHECK(loaded.world.free_count == 0);
+
+  // Loaded entities still move between archetypes
+  OX_CHECK(ox_world_remove_component(&loaded.world, test_entities[1],
+                                     loaded.position) == OX_SUCCESS);
+  OX_CHECK(!ox_world_get_component(&loaded.world, test_entities[1],
+                                   loaded.position));
+
+  ox_world_term(&loaded.world);
+}
+
+static void test_rejects_damaged(void)
+{
+  ox_mem_file_t file;
+  OX_CHECK(ox_mem_map_file(&file, TEST_SNAPSHOT_PATH) == OX_SUCCESS);
+  const size_t size = file.size;
+  ox_mem_unmap_file(&file);
+
+  ox_snapshot_t snapshot;
+  OX_CHECK(test_write_copy(TEST_TRUNCATED_PATH, size - 1, 0));
+  OX_CHECK(ox_snapshot_open(&snapshot, TEST_TRUNCATED_PATH) == OX_FAILURE);
+
+  // Past the end of the file, then within it but misaligned
+  OX_CHECK(test_write_copy(TEST_BAD_COLUMN_PATH, size, size));
+  OX_CHECK(ox_snapshot_open(&snapshot, TEST_BAD_COLUMN_PATH) == OX_FAILURE);
+  OX_CHECK(test_write_copy(TEST_BAD_COLUMN_PATH, size,
+                           OX_SNAPSHOT_ALIGNMENT + 8));
+  OX_CHECK(ox_snapshot_open(&snapshot, TEST_BAD_COLUMN_PATH) == OX_FAILURE);
+
+  // The undamaged file still opens
+  OX_CHECK(ox_snapshot_open(&snapshot, TEST_SNAPSHOT_PATH) == OX_SUCCESS);
+  ox_snapshot_close(&snapshot);
+
+  remove(TEST_TRUNCATED_PATH);
+  remove(TEST_BAD_COLUMN_PATH);
+}
+
+int main(void)
+{
+  if (ox_log_init() != OX_SUCCESS || ox_memory_init() != OX_SUCCESS) {
+    return EXIT_FAILURE;
+  }
+
+  static test_world_t saved;
+  OX_CHECK(ox_world_init(&saved.world) == OX_SUCCESS);
+  ox_component_registry_t* registry = &saved.world.component_registry;
+  saved.position =
+    ox_component_register(registry, "position", sizeof(test_position_t));
+  saved.health = ox_component_register(registry, "health", sizeof(int));
+  saved.tag = ox_component_register(registry, "tag", 0);
+
+  test_fill(&saved);
+  OX_CHECK(ox_world_save_snapshot(&saved.world, TEST_SNAPSHOT_PATH) ==
+           OX_SUCCESS);
+
+  test_rejects_damaged();
+  test_round_trip(&saved);
+
+  remove(TEST_SNAPSHOT_PATH);
+  ox_world_term(&saved.world);
+  ox_memory_exit();
+  ox_log_exit();
+
+  return OX_TEST_RESULT();
+}
@@ -0,0 +1,21 @@
+// Checks shared by the test executables. A failed check prints its location
+// and expression and the executable keeps going, main returns
+// OX_TEST_RESULT() so ctest sees every failure of a run at once.
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int ox_test_failures = 0;
+
+#define OX_CHECK(condition)                                                    \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      (void)fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,  \
+                    #condition);                                               \
+      ++ox_test_failures;                                                      \
+    }                                                                          \
+  } while (0)
+
+#define OX_TEST_RESULT() (ox_test_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE)
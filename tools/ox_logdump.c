@@ -0,0 +1,244 @@
+// Turns a binary log written through OX_LOG_BINARY back into text, the same
+// lines the text sink would have printed
+//
+//   ox_logdump <binary log> [output]
+
+#include "ox_core.h"
+#include "ox_log.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define OX_LOGDUMP_LINE_SIZE 4096
+
+typedef struct {
+  unsigned line;
+  char* level;
+  char* file;
+  char* func;
+  char* format;
+} ox_logdump_callsite_t;
+
+typedef struct {
+  FILE* input;
+  ox_logdump_callsite_t* callsites;
+  size_t callsite_count;
+  size_t callsite_capacity;
+  time_t wall_base;
+  uint64_t time_base;
+} ox_logdump_t;
+
+static bool ox_logdump_read(ox_logdump_t* dump, void* data, const size_t size)
+{
+  return fread(data, 1, size, dump->input) == size;
+}
+
+static char* ox_logdump_read_string(ox_logdump_t* dump)
+{
+  uint16_t length;
+  if (!ox_logdump_read(dump, &length, sizeof(length))) {
+    return NULL;
+  }
+
+  char* text = malloc((size_t)length + 1);
+  if (!text) {
+    return NULL;
+  }
+
+  if (!ox_logdump_read(dump, text, length)) {
+    free(text);
+    return NULL;
+  }
+  text[length] = '\0';
+  return text;
+}
+
+static long ox_logdump_callsite(ox_logdump_t* dump)
+{
+  uint32_t id;
+  uint32_t line;
+  if (!ox_logdump_read(dump, &id, sizeof(id)) ||
+      !ox_logdump_read(dump, &line, sizeof(line))) {
+    return OX_FAILURE;
+  }
+
+  if (id >= dump->callsite_capacity) {
+    size_t capacity = dump->callsite_capacity ? dump->callsite_capacity : 64;
+    while (capacity <= id) {
+      capacity *= 2;
+    }
+
+    ox_logdump_callsite_t* callsites =
+      realloc(dump->callsites, capacity * sizeof(ox_logdump_callsite_t));
+    if (!callsites) {
+      return OX_FAILURE;
+    }
+    memset(&callsites[dump->callsite_capacity], 0,
+           (capacity - dump->callsite_capacity) * sizeof(*callsites));
+    dump->callsites = callsites;
+    dump->callsite_capacity = capacity;
+  }
+
+  ox_logdump_callsite_t* callsite = &dump->callsites[id];
+  free(callsite->level);
+  free(callsite->file);
+  free(callsite->func);
+  free(callsite->format);
+
+  callsite->line = line;
+  callsite->level = ox_logdump_read_string(dump);
+  callsite->file = ox_logdump_read_string(dump);
+  callsite->func = ox_logdump_read_string(dump);
+  callsite->format = ox_logdump_read_string(dump);
+  if (!callsite->level || !callsite->file || !callsite->func ||
+      !callsite->format) {
+    return OX_FAILURE;
+  }
+
+  if (id >= dump->callsite_count) {
+    dump->callsite_count = (size_t)id + 1;
+  }
+  return OX_SUCCESS;
+}
+
+static long ox_logdump_record(ox_logdump_t* dump, FILE* output)
+{
+  uint32_t id;
+  uint64_t time_ns;
+  uint8_t arg_count;
+  if (!ox_logdump_read(dump, &id, sizeof(id)) ||
+      !ox_logdump_read(dump, &time_ns, sizeof(time_ns)) ||
+      !ox_logdump_read(dump, &arg_count, sizeof(arg_count))) {
+    return OX_FAILURE;
+  }
+
+  if (id >= dump->callsite_count || !dump->callsites[id].format ||
+      arg_count > OX_LOG_ARGS_MAX) {
+    return OX_FAILURE;
+  }
+
+  ox_log_arg_t args[OX_LOG_ARGS_MAX];
+  char* strings[OX_LOG_ARGS_MAX] = { 0 };
+  long result = OX_SUCCESS;
+
+  for (uint8_t i = 0; i < arg_count && result == OX_SUCCESS; ++i) {
+    uint8_t type;
+    if (!ox_logdump_read(dump, &type, sizeof(type)) ||
+        type > OX_LOG_ARG_STR) {
+      result = OX_FAILURE;
+      break;
+    }
+
+    args[i].type = (ox_log_arg_type_t)type;
+    if (type == OX_LOG_ARG_STR) {
+      strings[i] = ox_logdump_read_string(dump);
+      args[i].s = strings[i];
+      if (!strings[i]) {
+        result = OX_FAILURE;
+      }
+    } else if (!ox_logdump_read(dump, &args[i].u, sizeof(args[i].u))) {
+      result = OX_FAILURE;
+    }
+  }
+
+  if (result == OX_SUCCESS) {
+    const ox_logdump_callsite_t* callsite = &dump->callsites[id];
+
+    const time_t wall =
+      dump->wall_base + (time_t)((time_ns - dump->time_base) / 1000000000ull);
+    char timestamp[16];
+    strftime(timestamp, sizeof(timestamp), "%H:%M:%S", localtime(&wall));
+
+    char message[OX_LOGDUMP_LINE_SIZE];
+    ox_log_format_message(message, sizeof(message), callsite->format, args,
+                          arg_count);
+    (void)fprintf(output, OX_LOG_FORMAT "%s\n", callsite->level, timestamp,
+                  callsite->file, callsite->line, callsite->func, message);
+  }
+
+  for (uint8_t i = 0; i < arg_count; ++i) {
+    free(strings[i]);
+  }
+  return result;
+}
+
+static long ox_logdump_run(ox_logdump_t* dump, FILE* output)
+{
+  ox_log_binary_header_t header;
+  if (!ox_logdump_read(dump, &header, sizeof(header)) ||
+      header.magic != OX_LOG_BINARY_MAGIC) {
+    (void)fprintf(stderr, "Not an ox binary log\n");
+    return OX_FAILURE;
+  }
+
+  if (header.version != OX_LOG_BINARY_VERSION) {
+    (void)fprintf(stderr, "Unsupported binary log version %u\n",
+                  (unsigned)header.version);
+    return OX_FAILURE;
+  }
+
+  dump->wall_base = (time_t)header.wall_base;
+  dump->time_base = header.time_base;
+
+  for (;;) {
+    uint8_t tag;
+    if (!ox_logdump_read(dump, &tag, sizeof(tag))) {
+      return OX_SUCCESS;
+    }
+
+    long result = OX_FAILURE;
+    if (tag == OX_LOG_TAG_CALLSITE) {
+      result = ox_logdump_callsite(dump);
+    } else if (tag == OX_LOG_TAG_RECORD) {
+      result = ox_logdump_record(dump, output);
+    }
+
+    // A log cut short by a crash still decodes up to its last full entry
+    if (result != OX_SUCCESS) {
+      (void)fprintf(stderr, "Corrupt or truncated entry at offset %ld\n",
+                    ftell(dump->input));
+      return OX_FAILURE;
+    }
+  }
+}
+
+int main(const int argc, char* argv[])
+{
+  if (argc < 2 || argc > 3) {
+    (void)fprintf(stderr, "Usage: %s <binary log> [output]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  ox_logdump_t dump = { 0 };
+  dump.input = fopen(argv[1], "rb");
+  if (!dump.input) {
+    (void)fprintf(stderr, "Can't open '%s'\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  FILE* output = argc == 3 ? fopen(argv[2], "w") : stdout;
+  if (!output) {
+    (void)fprintf(stderr, "Can't create '%s'\n", argv[2]);
+    fclose(dump.input);
+    return EXIT_FAILURE;
+  }
+
+  const long result = ox_logdump_run(&dump, output);
+
+  for (size_t i = 0; i < dump.callsite_capacity; ++i) {
+    free(dump.callsites[i].level);
+    free(dump.callsites[i].file);
+    free(dump.callsites[i].func);
+    free(dump.callsites[i].format);
+  }
+  free(dump.callsites);
+
+  if (output != stdout) {
+    fclose(output);
+  }
+  fclose(dump.input);
+  return result == OX_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+}